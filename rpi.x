@@ -168,6 +168,13 @@ SECTIONS
     SORT(CONSTRUCTORS)
   }
   .data1          : { *(.data1) }
+  /* Every pool defined with POOL_DEFINE(), see kernel/pool.h */
+  .pool_table     :
+  {
+    __pool_table_start = .;
+    KEEP (*(.pool_table))
+    __pool_table_end = .;
+  }
   _edata = .; PROVIDE (edata = .);
   __bss_start = .;
   __bss_start__ = .;
@@ -184,10 +191,32 @@ SECTIONS
    . = ALIGN(. != 0 ? 32 / 8 : 1);
   }
   _bss_end__ = . ; __bss_end__ = . ;
+  /* Per-core stacks, set up by start.S. Not part of .bss as core 0 is
+     running on its stack while .bss is cleared */
+  __irq_stack_size = 0x1000;
+  __svc_stack_size = 0x4000;
+  __core_stacks_size = __irq_stack_size + __svc_stack_size;
+  .stacks (NOLOAD) : ALIGN(64)
+  {
+    __stacks_start = .;
+    . += 4 * __core_stacks_size;
+    __stacks_end = .;
+  }
+  /* Storage for the fixed size object pools, carved up by pool_init() */
+  .pools (NOLOAD) : ALIGN(64)
+  {
+    __pools_start = .;
+    *(.pools)
+    __pools_end = .;
+  }
   . = ALIGN(32 / 8);
   . = ALIGN(32 / 8);
   __end__ = . ;
   _end = .; PROVIDE (end = .);
+  /* LOG() format strings, at 0 so each one's address is its offset in the
+     section. Not loaded, tools/logdecode.py reads them from the ELF */
+  .logstr        0 (INFO) : { KEEP (*(.logstr)) }
+  ASSERT (SIZEOF (.logstr) <= 0x10000, "LOG() formats must fit in 64KB")
   /* Stabs debugging sections.  */
   .stab          0 : { *(.stab) }
   .stabstr       0 : { *(.stabstr) }
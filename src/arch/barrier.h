@@ -0,0 +1,57 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef ARCH_BARRIER_H
+#define ARCH_BARRIER_H
+
+#include <stdint.h>
+
+/** @brief Sense-reversing barrier for a fixed number of cores
+
+    Each core keeps its own sense, flipped on every use. The last core to
+    arrive resets the count and publishes its sense, releasing the others
+    which sleep in WFE until then. As the count is reset before anyone is
+    released the barrier can be reused straight away. */
+typedef struct {
+    volatile uint32_t remaining;
+    volatile uint32_t sense;
+    uint32_t cores;
+    } barrier_t;
+
+
+static inline void barrier_init( barrier_t* barrier, uint32_t cores )
+{
+    barrier->cores = cores;
+    barrier->remaining = cores;
+    barrier->sense = 0;
+}
+
+
+/**
+    @brief Wait until every core has arrived. local_sense belongs to the
+    calling core and must start at 0
+*/
+static inline void barrier_wait( barrier_t* barrier, uint32_t* local_sense )
+{
+    uint32_t sense = !*local_sense;
+
+    *local_sense = sense;
+
+    if( __atomic_sub_fetch( &barrier->remaining, 1, __ATOMIC_ACQ_REL ) == 0 )
+    {
+        barrier->remaining = barrier->cores;
+        __atomic_store_n( &barrier->sense, sense, __ATOMIC_RELEASE );
+        __asm__ __volatile__( "dsb\n\tsev" ::: "memory" );
+    }
+    else
+    {
+        while( __atomic_load_n( &barrier->sense, __ATOMIC_ACQUIRE ) != sense )
+            __asm__ __volatile__( "wfe" );
+    }
+}
+
+#endif
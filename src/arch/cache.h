@@ -0,0 +1,72 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef ARCH_CACHE_H
+#define ARCH_CACHE_H
+
+#include <stdint.h>
+
+/* Data cache maintenance by address, for sharing buffers with the VideoCore
+   and DMA which don't snoop the ARM caches. See the ARM ARM section B4.2.1
+   (Cache and branch predictor maintenance operations) */
+
+/** @brief Cortex-A7 L1 and L2 cache line size */
+#define CACHE_LINE_SIZE             64
+
+#define CACHE_LINE_MASK             ( CACHE_LINE_SIZE - 1 )
+
+
+/**
+    @brief Write any dirty lines covering the range back to memory so that
+    another bus master sees what the ARM wrote (DCCMVAC)
+*/
+static inline void cache_clean_range( const void* start, uint32_t length )
+{
+    uint32_t line = (uint32_t)start & ~CACHE_LINE_MASK;
+    uint32_t end = (uint32_t)start + length;
+
+    for( ; line < end; line += CACHE_LINE_SIZE )
+        __asm__ __volatile__( "mcr p15, 0, %0, c7, c10, 1" :: "r" (line) : "memory" );
+
+    __asm__ __volatile__( "dsb" ::: "memory" );
+}
+
+
+/**
+    @brief Discard the lines covering the range so the next read comes from
+    memory and sees what another bus master wrote (DCIMVAC)
+
+    Any dirty data in the lines is lost, including data outside the range
+    that shares a line with it, so the range should be cache line aligned
+*/
+static inline void cache_invalidate_range( const void* start, uint32_t length )
+{
+    uint32_t line = (uint32_t)start & ~CACHE_LINE_MASK;
+    uint32_t end = (uint32_t)start + length;
+
+    for( ; line < end; line += CACHE_LINE_SIZE )
+        __asm__ __volatile__( "mcr p15, 0, %0, c7, c6, 1" :: "r" (line) : "memory" );
+
+    __asm__ __volatile__( "dsb" ::: "memory" );
+}
+
+
+/**
+    @brief Write back and then discard the lines covering the range (DCCIMVAC)
+*/
+static inline void cache_clean_invalidate_range( const void* start, uint32_t length )
+{
+    uint32_t line = (uint32_t)start & ~CACHE_LINE_MASK;
+    uint32_t end = (uint32_t)start + length;
+
+    for( ; line < end; line += CACHE_LINE_SIZE )
+        __asm__ __volatile__( "mcr p15, 0, %0, c7, c14, 1" :: "r" (line) : "memory" );
+
+    __asm__ __volatile__( "dsb" ::: "memory" );
+}
+
+#endif
@@ -62,8 +62,16 @@ extern int errno;
 /* Required include for times() */
 #include <sys/times.h>
 
-/* Prototype for the UART write function */
-#include "hal/aux.h"
+/* Required includes for the memory allocation functions */
+#include <reent.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Prototype for the UART read and write functions */
+#include "hal/console.h"
+
+/* The heap that malloc and friends are built on */
+#include "kernel/heap.h"
 
 /* A pointer to a list of environment variables and their values. For a minimal
    environment, this empty list is adequate: */
@@ -173,30 +181,109 @@ int open( const char *name, int flags, int mode )
 }
 
 
-/* Read from a file. Minimal implementation: */
+/* Read from a file. Everything reads from the UART console, which blocks
+   or not depending on the mode set with RPI_ConsoleSetRxMode(). A
+   non-blocking read with nothing available fails with EAGAIN rather than
+   returning 0, which newlib would take as end-of-file */
 int _read( int file, char *ptr, int len )
 {
-    return 0;
+    int count = RPI_ConsoleRead( ptr, len );
+
+    if( ( count == 0 ) && ( len > 0 ) )
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return count;
 }
 
 
-/* Increase program data space. As malloc and related functions depend on this,
-   it is useful to have a working implementation. The following suffices for a
-   standalone system; it exploits the symbol _end automatically defined by the
-   GNU linker. */
+/* Increase program data space. Everything after _end belongs to the heap in
+   kernel/heap.c and malloc no longer comes through here, so there is nothing
+   to give out. Fail rather than hand out memory the heap owns */
 caddr_t _sbrk( int incr )
 {
-    extern char _end;
-    static char* heap_end = 0;
-    char* prev_heap_end;
+    errno = ENOMEM;
+    return (caddr_t)-1;
+}
+
+
+/* The memory allocation functions. newlib's own malloc sits on top of _sbrk
+   and takes an unpredictable time, so replace it (and the reentrant versions
+   the rest of the library calls) with the constant time heap */
+void* _malloc_r( struct _reent* r, size_t size )
+{
+    return heap_malloc( size );
+}
+
+
+void _free_r( struct _reent* r, void* ptr )
+{
+    heap_free( ptr );
+}
+
+
+void* _calloc_r( struct _reent* r, size_t count, size_t size )
+{
+    size_t total = count * size;
+    void* ptr;
+
+    if( ( size != 0 ) && ( ( total / size ) != count ) )
+        return NULL;
+
+    if( ( ptr = heap_malloc( total ) ) )
+        memset( ptr, 0, total );
+
+    return ptr;
+}
+
+
+void* _realloc_r( struct _reent* r, void* ptr, size_t size )
+{
+    return heap_realloc( ptr, size );
+}
+
+
+void* _memalign_r( struct _reent* r, size_t align, size_t size )
+{
+    return heap_memalign( align, size );
+}
+
+
+size_t _malloc_usable_size_r( struct _reent* r, void* ptr )
+{
+    return heap_usable_size( ptr );
+}
+
+
+void* malloc( size_t size )
+{
+    return heap_malloc( size );
+}
+
 
-    if( heap_end == 0 )
-        heap_end = &_end;
+void free( void* ptr )
+{
+    heap_free( ptr );
+}
 
-     prev_heap_end = heap_end;
-     heap_end += incr;
 
-     return (caddr_t)prev_heap_end;
+void* calloc( size_t count, size_t size )
+{
+    return _calloc_r( NULL, count, size );
+}
+
+
+void* realloc( void* ptr, size_t size )
+{
+    return heap_realloc( ptr, size );
+}
+
+
+void* memalign( size_t align, size_t size )
+{
+    return heap_memalign( align, size );
 }
 
 
@@ -233,7 +320,7 @@ int wait( int *status )
 
 void outbyte( char b )
 {
-    RPI_AuxMiniUartWrite( b );
+    RPI_ConsoleWrite( b );
 }
 
 /* Write to a file. libc subroutines will use this system routine for output to
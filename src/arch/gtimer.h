@@ -0,0 +1,48 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef ARCH_GTIMER_H
+#define ARCH_GTIMER_H
+
+#include <stdint.h>
+
+/* Cortex-A7 generic timer. See the ARM ARM section B8 (The Generic Timer).
+   Every core sees the same system counter through its own CP15 registers,
+   so a read costs a few cycles rather than a trip out to a peripheral and
+   timestamps from different cores can be compared */
+
+
+/** @brief Read the physical count (CNTPCT). The isb stops it being read
+    early, ahead of the code being timed */
+static inline uint64_t gtimer_count( void )
+{
+    uint64_t value;
+    __asm__ __volatile__( "isb" ::: "memory" );
+    __asm__ __volatile__( "mrrc p15, 0, %Q0, %R0, c14" : "=r" (value) );
+    return value;
+}
+
+/** @brief Read the physical count without the isb. It may be read a few
+    instructions early, which doesn't matter for a trace timestamp but
+    saves flushing the pipeline on every one */
+static inline uint64_t gtimer_count_unordered( void )
+{
+    uint64_t value;
+    __asm__ __volatile__( "mrrc p15, 0, %Q0, %R0, c14" : "=r" (value) );
+    return value;
+}
+
+/** @brief Read the counter frequency (CNTFRQ). This is whatever the boot
+    code wrote there, which isn't necessarily right */
+static inline uint32_t gtimer_frequency( void )
+{
+    uint32_t value;
+    __asm__ __volatile__( "mrc p15, 0, %0, c14, c0, 0" : "=r" (value) );
+    return value;
+}
+
+#endif
@@ -0,0 +1,73 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef ARCH_LOCKFREE_H
+#define ARCH_LOCKFREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief A lock-free LIFO list of nodes whose first word is the link to the
+    next node. Any core, and IRQ handlers, can push and pop at the same time.
+
+    Popping uses LDREX/STREX directly rather than a compare-and-swap. The
+    STREX fails if anything has stored to the head since the LDREX, so a node
+    popped and pushed back in between (the ABA problem) can't fool it.
+    Like spinlocks they need the MMU on for the exclusive monitors */
+typedef struct {
+    void* volatile head;
+    } lf_stack_t;
+
+
+static inline void lf_stack_push( lf_stack_t* stack, void* node )
+{
+    void* head = stack->head;
+
+    /* Pushing can't be fooled by ABA, so an ordinary compare-and-swap does.
+       Release ordering makes the node's contents visible before it is */
+    do
+    {
+        *(void**)node = head;
+
+    } while( !__atomic_compare_exchange_n( &stack->head, &head, node, 1,
+                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+}
+
+
+/** @brief Take the most recently pushed node, NULL if the list is empty */
+static inline void* lf_stack_pop( lf_stack_t* stack )
+{
+    void* head;
+    void* next;
+    uint32_t failed;
+
+    do
+    {
+        __asm__ __volatile__(
+            "ldrex  %0, [%3]\n\t"
+            "cmp    %0, #0\n\t"
+            "beq    1f\n\t"
+            "ldr    %1, [%0]\n\t"
+            "strex  %2, %1, [%3]\n\t"
+            "b      2f\n"
+            "1:\n\t"
+            "clrex\n\t"
+            "mov    %2, #0\n"
+            "2:"
+            : "=&r" (head), "=&r" (next), "=&r" (failed)
+            : "r" (&stack->head)
+            : "cc", "memory" );
+
+    } while( failed );
+
+    /* Nothing in the node can be read before it is ours */
+    __asm__ __volatile__( "dmb" ::: "memory" );
+
+    return head;
+}
+
+#endif
@@ -0,0 +1,186 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stdint.h>
+
+#include "hal/base.h"
+
+#include "cache.h"
+#include "mmu.h"
+
+/* The first level table has to be aligned to its own size */
+static uint32_t page_table[MMU_SECTIONS] __attribute__((aligned(16384)));
+
+
+/**
+    @brief Invalidate the data and unified caches by set/way
+
+    Done before the MMU is turned on so no stale lines left by the firmware
+    can be hit. Nothing can be dirty in them yet as all data accesses from
+    this core have been uncached up to this point. Only core 0 may go beyond
+    level 1, the L2 is shared and the other cores may have data in it.
+*/
+static void dcache_invalidate( uint32_t levels )
+{
+    uint32_t clidr, ccsidr;
+    uint32_t level, ways, sets, way, set;
+    uint32_t line_shift, way_shift;
+
+    __asm__ __volatile__( "mrc p15, 1, %0, c0, c0, 1" : "=r" (clidr) );
+
+    for( level = 0; level < levels; level++ )
+    {
+        /* Only levels with a data or unified cache (type 2 or more) */
+        if( ( ( clidr >> ( level * 3 ) ) & 7 ) < 2 )
+            continue;
+
+        /* CSSELR selects the level, CCSIDR then describes it */
+        __asm__ __volatile__( "mcr p15, 2, %0, c0, c0, 0" :: "r" (level << 1) );
+        __asm__ __volatile__( "isb" );
+        __asm__ __volatile__( "mrc p15, 1, %0, c0, c0, 0" : "=r" (ccsidr) );
+
+        line_shift = ( ccsidr & 7 ) + 4;
+        ways = ( ( ccsidr >> 3 ) & 0x3FF ) + 1;
+        sets = ( ( ccsidr >> 13 ) & 0x7FFF ) + 1;
+        way_shift = ( ways > 1 ) ? __builtin_clz( ways - 1 ) : 0;
+
+        for( way = 0; way < ways; way++ )
+        {
+            for( set = 0; set < sets; set++ )
+            {
+                /* DCISW */
+                __asm__ __volatile__( "mcr p15, 0, %0, c7, c6, 2" ::
+                        "r" ( ( way << way_shift ) | ( set << line_shift ) | ( level << 1 ) ) );
+            }
+        }
+    }
+
+    __asm__ __volatile__( "dsb" ::: "memory" );
+}
+
+
+/**
+    @brief Throw away every cached translation once the table has changed
+
+    The inner shareable forms are broadcast, so any other core that is up
+    drops its copies too
+*/
+static void tlb_invalidate( void )
+{
+    /* TLBIALLIS, BPIALLIS */
+    __asm__ __volatile__( "mcr p15, 0, %0, c8, c3, 0" :: "r" (0) );
+    __asm__ __volatile__( "mcr p15, 0, %0, c7, c1, 6" :: "r" (0) );
+    __asm__ __volatile__( "dsb" ::: "memory" );
+    __asm__ __volatile__( "isb" ::: "memory" );
+}
+
+
+/**
+    @brief Change the memory type of every section overlapping a region
+
+    Sections are 1MB, so the whole of any partially covered section takes the
+    new attributes. The region is flat mapped.
+
+    Once the MMU is on, lines for the sections may be in the data cache.
+    They are written back and dropped before the descriptors change, so
+    nothing dirty is stranded behind a non-cacheable mapping, and again
+    after, for any line fetched speculatively in between. Only do this
+    before the other cores are started; they would have to stay out of
+    the region while it changes.
+*/
+void mmu_set_region( uint32_t base, uint32_t size, uint32_t attributes )
+{
+    uint32_t first = base >> MMU_SECTION_SHIFT;
+    uint32_t last = ( base + size - 1 ) >> MMU_SECTION_SHIFT;
+    uint32_t start = first << MMU_SECTION_SHIFT;
+    uint32_t length = ( last - first + 1 ) << MMU_SECTION_SHIFT;
+    uint32_t section;
+    uint32_t reg;
+
+    if( size == 0 )
+        return;
+
+    __asm__ __volatile__( "mrc p15, 0, %0, c1, c0, 0" : "=r" (reg) );
+
+    if( reg & SCTLR_MMU )
+        cache_clean_invalidate_range( (const void*)start, length );
+
+    for( section = first; section <= last; section++ )
+        page_table[section] = ( section << MMU_SECTION_SHIFT ) | attributes;
+
+    /* The table walker may not look in the L1 data cache */
+    cache_clean_range( &page_table[first], ( last - first + 1 ) * sizeof( uint32_t ) );
+
+    tlb_invalidate();
+
+    if( reg & SCTLR_MMU )
+        cache_clean_invalidate_range( (const void*)start, length );
+}
+
+
+/**
+    @brief Turn on the MMU and caches on the calling core using the table
+    built by mmu_init()
+*/
+void mmu_enable( void )
+{
+    uint32_t reg;
+
+    /* Take part in coherency, required before the data cache is enabled */
+    __asm__ __volatile__( "mrc p15, 0, %0, c1, c0, 1" : "=r" (reg) );
+    reg |= ACTLR_SMP;
+    __asm__ __volatile__( "mcr p15, 0, %0, c1, c0, 1" :: "r" (reg) );
+
+    dcache_invalidate( 1 );
+
+    /* ICIALLU */
+    __asm__ __volatile__( "mcr p15, 0, %0, c7, c5, 0" :: "r" (0) );
+
+    /* All of the table is in domain 0, make that a client so the access
+       permissions in the descriptors are checked */
+    __asm__ __volatile__( "mcr p15, 0, %0, c3, c0, 0" :: "r" (1) );
+
+    /* TTBCR: only use TTBR0 */
+    __asm__ __volatile__( "mcr p15, 0, %0, c2, c0, 2" :: "r" (0) );
+
+    __asm__ __volatile__( "mcr p15, 0, %0, c2, c0, 0" ::
+            "r" ( (uint32_t)page_table | TTBR_IRGN_WBWA | TTBR_RGN_WBWA | TTBR_S ) );
+
+    tlb_invalidate();
+
+    __asm__ __volatile__( "mrc p15, 0, %0, c1, c0, 0" : "=r" (reg) );
+    reg |= SCTLR_MMU | SCTLR_DCACHE | SCTLR_ICACHE | SCTLR_BRANCH_PREDICTION;
+    __asm__ __volatile__( "mcr p15, 0, %0, c1, c0, 0" :: "r" (reg) : "memory" );
+    __asm__ __volatile__( "isb" ::: "memory" );
+}
+
+
+/**
+    @brief Build a flat mapping of the address space and turn on the MMU and
+    caches
+
+    RAM (including the VideoCore's share, which the firmware hands out
+    framebuffers from) is normal cached memory and the peripherals are
+    device memory. Everything else faults. Until this runs every data access
+    is treated as strongly ordered and the data cache is never used, even
+    with SCTLR.C set. Called once on core 0, the other cores then only need
+    mmu_enable().
+*/
+void mmu_init( void )
+{
+    mmu_set_region( 0, PERIPHERAL_BASE, MMU_NORMAL_CACHED );
+
+    /* BCM2835 peripherals up to the end of the ARM physical address space,
+       then the BCM2836 local peripherals (core timers and mailboxes) */
+    mmu_set_region( PERIPHERAL_BASE, 0x40000000 - PERIPHERAL_BASE, MMU_DEVICE );
+    mmu_set_region( 0x40000000, MMU_SECTION_SIZE, MMU_DEVICE );
+
+    /* Nothing else is running yet so the shared L2 can go too */
+    dcache_invalidate( 7 );
+
+    mmu_enable();
+}
@@ -0,0 +1,64 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef ARCH_MMU_H
+#define ARCH_MMU_H
+
+#include <stdint.h>
+
+/* Short-descriptor translation table using 1MB sections only. See the ARM
+   ARM section B3.5 (Short-descriptor translation table format) */
+
+#define MMU_SECTION_SIZE            0x100000
+#define MMU_SECTION_SHIFT           20
+
+/** @brief One first level descriptor per 1MB of the 4GB address space */
+#define MMU_SECTIONS                4096
+
+#define MMU_SECTION                 ( 2 << 0 )
+#define MMU_SECTION_B               ( 1 << 2 )
+#define MMU_SECTION_C               ( 1 << 3 )
+#define MMU_SECTION_XN              ( 1 << 4 )
+#define MMU_SECTION_AP_RW           ( 3 << 10 )
+#define MMU_SECTION_TEX(x)          ( (x) << 12 )
+#define MMU_SECTION_S               ( 1 << 16 )
+
+/** @brief Normal memory, inner and outer write-back write-allocate */
+#define MMU_NORMAL_CACHED           ( MMU_SECTION | MMU_SECTION_AP_RW | \
+                                      MMU_SECTION_TEX(1) | MMU_SECTION_C | \
+                                      MMU_SECTION_B | MMU_SECTION_S )
+
+/** @brief Normal memory, not cached. Stores are still buffered and merged
+    which makes this the write-combining type for the framebuffer */
+#define MMU_NORMAL_UNCACHED         ( MMU_SECTION | MMU_SECTION_AP_RW | \
+                                      MMU_SECTION_TEX(1) | MMU_SECTION_S | \
+                                      MMU_SECTION_XN )
+
+/** @brief Shareable device memory for peripheral registers */
+#define MMU_DEVICE                  ( MMU_SECTION | MMU_SECTION_AP_RW | \
+                                      MMU_SECTION_B | MMU_SECTION_XN )
+
+/** @brief TTBR0 walk attributes, inner and outer write-back write-allocate
+    shareable to match MMU_NORMAL_CACHED */
+#define TTBR_IRGN_WBWA              ( 1 << 6 )
+#define TTBR_RGN_WBWA               ( 1 << 3 )
+#define TTBR_S                      ( 1 << 1 )
+
+#define SCTLR_MMU                   ( 1 << 0 )
+#define SCTLR_DCACHE                ( 1 << 2 )
+#define SCTLR_BRANCH_PREDICTION     ( 1 << 11 )
+#define SCTLR_ICACHE                ( 1 << 12 )
+
+/** @brief ACTLR.SMP, the Cortex-A7 caches are only coherent, and the data
+    cache only used, when this is set */
+#define ACTLR_SMP                   ( 1 << 6 )
+
+extern void mmu_init( void );
+extern void mmu_enable( void );
+extern void mmu_set_region( uint32_t base, uint32_t size, uint32_t attributes );
+
+#endif
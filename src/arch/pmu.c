@@ -0,0 +1,44 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stdint.h>
+
+#include "pmu.h"
+
+/* The events counted, indexed by PMU_COUNTER_xxx */
+static const uint32_t events[PMU_COUNTERS] = {
+    PMU_EVENT_INST_RETIRED,
+    PMU_EVENT_L1D_CACHE_REFILL,
+    PMU_EVENT_L2D_CACHE_REFILL,
+    PMU_EVENT_BR_MIS_PRED,
+    };
+
+
+/**
+    @brief Reset and start the cycle counter and the event counters on the
+    calling core
+*/
+void pmu_init( void )
+{
+    int counter;
+
+    for( counter = 0; counter < PMU_COUNTERS; counter++ )
+    {
+        /* PMSELR = counter, PMXEVTYPER = event */
+        __asm__ __volatile__( "mcr p15, 0, %0, c9, c12, 5" :: "r" (counter) );
+        __asm__ __volatile__( "isb" );
+        __asm__ __volatile__( "mcr p15, 0, %0, c9, c13, 1" :: "r" (events[counter]) );
+    }
+
+    /* PMCR: reset and enable all of the counters */
+    __asm__ __volatile__( "mcr p15, 0, %0, c9, c12, 0" ::
+            "r" (PMCR_ENABLE | PMCR_EVENT_RESET | PMCR_CYCLE_RESET) );
+
+    /* PMCNTENSET: enable the cycle counter and every event counter */
+    __asm__ __volatile__( "mcr p15, 0, %0, c9, c12, 1" ::
+            "r" (PMCNTEN_CYCLES | ( ( 1 << PMU_COUNTERS ) - 1 )) );
+}
@@ -0,0 +1,63 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef ARCH_PMU_H
+#define ARCH_PMU_H
+
+#include <stdint.h>
+
+/* Cortex-A7 performance monitor unit. See the ARM ARM section C12 (The
+   Performance Monitors Extension) and the Cortex-A7 TRM section 11 for the
+   event numbers */
+
+/** @brief The Cortex-A7 has four event counters next to the cycle counter */
+#define PMU_COUNTERS                4
+
+#define PMU_EVENT_L1I_CACHE_REFILL  0x01
+#define PMU_EVENT_L1D_CACHE_REFILL  0x03
+#define PMU_EVENT_INST_RETIRED      0x08
+#define PMU_EVENT_BR_MIS_PRED       0x10
+#define PMU_EVENT_L2D_CACHE_REFILL  0x17
+
+/** @brief What each event counter is programmed to count by pmu_init() */
+#define PMU_COUNTER_INSTRUCTIONS    0
+#define PMU_COUNTER_L1D_MISSES      1
+#define PMU_COUNTER_L2_MISSES       2
+#define PMU_COUNTER_BRANCH_MISSES   3
+
+#define PMCR_ENABLE                 ( 1 << 0 )
+#define PMCR_EVENT_RESET            ( 1 << 1 )
+#define PMCR_CYCLE_RESET            ( 1 << 2 )
+
+#define PMCNTEN_CYCLES              ( 1 << 31 )
+
+
+/** @brief Read the cycle counter (PMCCNTR) */
+static inline uint32_t pmu_cycles( void )
+{
+    uint32_t value;
+    __asm__ __volatile__( "mrc p15, 0, %0, c9, c13, 0" : "=r" (value) );
+    return value;
+}
+
+/** @brief Read one of the event counters (PMSELR then PMXEVCNTR). IRQs are
+    masked in between so a handler can't select another counter under us */
+static inline uint32_t pmu_read( int counter )
+{
+    uint32_t value;
+    uint32_t cpsr;
+    __asm__ __volatile__( "mrs %0, cpsr\n\tcpsid i" : "=r" (cpsr) :: "memory" );
+    __asm__ __volatile__( "mcr p15, 0, %0, c9, c12, 5" :: "r" (counter) );
+    __asm__ __volatile__( "isb" );
+    __asm__ __volatile__( "mrc p15, 0, %0, c9, c13, 2" : "=r" (value) );
+    __asm__ __volatile__( "msr cpsr_c, %0" :: "r" (cpsr) : "memory" );
+    return value;
+}
+
+extern void pmu_init( void );
+
+#endif
@@ -0,0 +1,97 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stdint.h>
+
+#include "hal/local.h"
+#include "hal/systimer.h"
+
+#include "cache.h"
+#include "mmu.h"
+#include "pmu.h"
+#include "smp.h"
+
+/* Per-core stacks, from the linker script */
+extern char __stacks_start[];
+extern char __core_stacks_size[];
+
+/* Where the secondary cores enter, in start.S */
+extern void _secondary_start( void );
+
+/* Where the secondary cores end up once they are running C with the caches
+   on, never returns */
+extern void kernel_secondary_main( int core );
+
+/* Each core sets its bit once it is up */
+static volatile uint32_t online = 1;
+
+
+/**
+    @brief Number of cores running, including this one
+*/
+int smp_cores_online( void )
+{
+    return __builtin_popcount( online );
+}
+
+
+/**
+    @brief Start the secondary cores
+
+    The firmware parks cores 1-3 in WFE waiting for an entry address in their
+    local mailbox 3. Each is sent to _secondary_start and given a moment to
+    check in. Must be called on core 0 after mmu_init().
+
+    @return The number of cores running
+*/
+int smp_init( void )
+{
+    uint32_t start;
+    int core;
+
+    for( core = 1; core < SMP_CORES; core++ )
+    {
+        /* The core writes its stack before its MMU and data cache are on,
+           make sure nothing of that memory is in the shared L2 */
+        cache_clean_invalidate_range( __stacks_start + ( core * (uint32_t)__core_stacks_size ),
+                                      (uint32_t)__core_stacks_size );
+
+        RPI_GetLocal()->mailbox_set[core][RPI_LOCAL_MAILBOX_WAKE] = (uint32_t)_secondary_start;
+        __asm__ __volatile__( "dsb\n\tsev" ::: "memory" );
+
+        start = RPI_GetSystemTimer()->counter_lo;
+        while( ( online & ( 1 << core ) ) == 0 )
+        {
+            if( ( RPI_GetSystemTimer()->counter_lo - start ) > SMP_START_TIMEOUT_US )
+                break;
+        }
+    }
+
+    return smp_cores_online();
+}
+
+
+/**
+    @brief C entry point for the secondary cores, called from start.S with
+    the stacks set up and VFP enabled
+*/
+void smp_secondary_main( int core )
+{
+    /* Use the page table core 0 built, after this the caches are coherent
+       with the other cores */
+    mmu_enable();
+    pmu_init();
+
+    __atomic_or_fetch( &online, 1 << core, __ATOMIC_SEQ_CST );
+
+    kernel_secondary_main( core );
+
+    while( 1 )
+    {
+        __asm__ __volatile__( "wfe" );
+    }
+}
@@ -0,0 +1,32 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef ARCH_SMP_H
+#define ARCH_SMP_H
+
+#include <stdint.h>
+
+/** @brief Number of Cortex-A7 cores in the BCM2836 */
+#define SMP_CORES                   4
+
+/** @brief How long smp_init() waits for each core to check in */
+#define SMP_START_TIMEOUT_US        100000
+
+
+/** @brief The number of the calling core, from MPIDR */
+static inline int smp_core_id( void )
+{
+    uint32_t mpidr;
+    __asm__ __volatile__( "mrc p15, 0, %0, c0, c0, 5" : "=r" (mpidr) );
+    return mpidr & 3;
+}
+
+extern int smp_init( void );
+extern int smp_cores_online( void );
+extern void smp_secondary_main( int core );
+
+#endif
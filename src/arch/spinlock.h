@@ -0,0 +1,46 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef ARCH_SPINLOCK_H
+#define ARCH_SPINLOCK_H
+
+#include <stdint.h>
+
+/** @brief A lock shared between cores. The exclusive monitors only work on
+    normal cacheable memory, so the MMU must be on in every core using it.
+    Waiters sleep in WFE and are woken by the SEV in spin_unlock().
+
+    Interrupts are left alone, so a lock taken by an IRQ handler must only
+    be taken with interrupts masked everywhere else on that core */
+typedef volatile uint32_t spinlock_t;
+
+#define SPINLOCK_UNLOCKED           0
+
+
+static inline int spin_trylock( spinlock_t* lock )
+{
+    return __atomic_exchange_n( lock, 1, __ATOMIC_ACQUIRE ) == 0;
+}
+
+
+static inline void spin_lock( spinlock_t* lock )
+{
+    while( !spin_trylock( lock ) )
+    {
+        while( *lock )
+            __asm__ __volatile__( "wfe" );
+    }
+}
+
+
+static inline void spin_unlock( spinlock_t* lock )
+{
+    __atomic_store_n( lock, SPINLOCK_UNLOCKED, __ATOMIC_RELEASE );
+    __asm__ __volatile__( "dsb\n\tsev" ::: "memory" );
+}
+
+#endif
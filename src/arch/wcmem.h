@@ -0,0 +1,19 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef ARCH_WCMEM_H
+#define ARCH_WCMEM_H
+
+#include <stddef.h>
+
+/* memcpy and memset for a destination in write-combined memory, such as the
+   framebuffer, see string.S. The ordinary versions are fine for it too but
+   these keep every store a whole 64 byte burst */
+extern void* memcpy_wc( void* dst, const void* src, size_t n );
+extern void* memset_wc( void* dst, int c, size_t n );
+
+#endif
@@ -1,9 +1,31 @@
 
+#include <stddef.h>
+
 #include "aux.h"
 #include "base.h"
 #include "gpio.h"
+#include "interrupts.h"
+#include "mailbox-interface.h"
+#include "ring.h"
+
+static struct AUX_REGISTERS* auxillary = (struct AUX_REGISTERS*)AUX_BASE;
+
+/* Transmit ring, filled by RPI_AuxMiniUartWrite() and drained into the
+   hardware FIFO by the mini UART transmit interrupt */
+static uint8_t tx_buffer[AUX_TX_BUFFER_SIZE];
+static rpi_ring_t tx_ring;
+static aux_tx_mode_t tx_mode = AUX_TX_BLOCK;
 
-static aux_t* auxillary = (aux_t*)AUX_BASE;
+/* Receive ring, filled by the mini UART receive interrupt and drained by
+   RPI_AuxMiniUartRead() */
+static uint8_t rx_buffer[AUX_RX_BUFFER_SIZE];
+static rpi_ring_t rx_ring;
+static aux_rx_mode_t rx_mode = AUX_RX_BLOCK;
+
+static aux_notify_t notify = NULL;
+static void* notify_param;
+
+static aux_stats_t stats;
 
 
 aux_t* RPI_GetAux( void )
@@ -11,14 +33,22 @@ aux_t* RPI_GetAux( void )
     return auxillary;
 }
 
-/* Define the system clock frequency in MHz for the baud rate calculation.
-   This is clearly defined on the BCM2835 datasheet errata page:
-   http://elinux.org/BCM2835_datasheet_errata */
+/* The core clock the mini UART runs from, used if the firmware won't tell us
+   the real one. This is clearly defined on the BCM2835 datasheet errata
+   page: http://elinux.org/BCM2835_datasheet_errata */
 #define SYS_FREQ    250000000
 
 void RPI_AuxMiniUartInit( int baud, int bits )
 {
-    volatile int i;
+    uint32_t core_clock;
+
+    /* The mini UART is clocked from the core clock, which config.txt or the
+       firmware's own frequency scaling can move away from 250MHz */
+    if( ( core_clock = RPI_PropertyGetClockRate( TAG_CLOCK_CORE ) ) == 0 )
+        core_clock = SYS_FREQ;
+
+    RPI_RingInit( &tx_ring, tx_buffer, AUX_TX_BUFFER_SIZE );
+    RPI_RingInit( &rx_ring, rx_buffer, AUX_RX_BUFFER_SIZE );
 
     /* As this is a mini uart the configuration is complete! Now just
        enable the uart. Note from the documentation in section 2.1.1 of
@@ -26,54 +56,289 @@ void RPI_AuxMiniUartInit( int baud, int bits )
 
        If the enable bits are clear you will have no access to a
        peripheral. You can not even read or write the registers */
-    auxillary->ENABLES = AUX_ENA_MINIUART;
+    auxillary->enables = AUX_ENA_MINIUART;
 
     /* Disable interrupts for now */
     /* auxillary->IRQ &= ~AUX_IRQ_MU; */
 
-    auxillary->MU_IER = 0;
+    auxillary->mini_uart.ier = 0;
 
     /* Disable flow control,enable transmitter and receiver! */
-    auxillary->MU_CNTL = 0;
+    auxillary->mini_uart.cntl = 0;
 
     /* Decide between seven or eight-bit mode */
     if( bits == 8 )
-        auxillary->MU_LCR = AUX_MULCR_8BIT_MODE;
+        auxillary->mini_uart.lcr = AUX_MULCR_8BIT_MODE;
     else
-        auxillary->MU_LCR = 0;
+        auxillary->mini_uart.lcr = 0;
 
-    auxillary->MU_MCR = 0;
+    auxillary->mini_uart.mcr = 0;
 
     /* Disable all interrupts from MU and clear the fifos */
-    auxillary->MU_IER = 0;
+    auxillary->mini_uart.ier = 0;
 
-    auxillary->MU_IIR = 0xC6;
+    auxillary->mini_uart.iir = 0xC6;
 
     /* Transposed calculation from Section 2.2.1 of the ARM peripherals
        manual */
-    auxillary->MU_BAUD = ( SYS_FREQ / ( 8 * baud ) ) - 1;
+    auxillary->mini_uart.baud = ( core_clock / ( 8 * baud ) ) - 1;
 
      /* Setup GPIO 14 and 15 as alternative function 5 which is
         UART 1 TXD/RXD. These need to be set before enabling the UART */
     RPI_SetGpioPinFunction( RPI_GPIO14, FS_ALT5 );
     RPI_SetGpioPinFunction( RPI_GPIO15, FS_ALT5 );
 
-    RPI_GetGpio()->GPPUD = 0;
-    for( i=0; i<150; i++ ) { }
-    RPI_GetGpio()->GPPUDCLK0 = ( 1 << 14 );
-    for( i=0; i<150; i++ ) { }
-    RPI_GetGpio()->GPPUDCLK0 = 0;
+    RPI_SetGpioPull( ( 1 << 14 ) | ( 1 << 15 ), RPI_GPIO_PULL_OFF );
 
     /* Disable flow control,enable transmitter and receiver! */
-    auxillary->MU_CNTL = AUX_MUCNTL_TX_ENABLE;
+    auxillary->mini_uart.cntl = AUX_MUCNTL_TX_ENABLE | AUX_MUCNTL_RX_ENABLE;
+
+    /* The receive interrupt is always on. The transmit interrupt is only
+       enabled while there is something in the ring */
+    auxillary->mini_uart.ier = AUX_MUIER_IRQ_ENABLE | AUX_MUIER_RX_IRQ;
+
+    /* Route the AUX interrupt through to the ARM */
+    RPI_IrqRegister( RPI_IRQ_AUX, RPI_AuxIrqHandler, NULL );
+    RPI_IrqEnable( RPI_IRQ_AUX );
+}
+
+
+/**
+    @brief Select what happens when the transmit ring is full
+*/
+void RPI_AuxMiniUartSetTxMode( aux_tx_mode_t mode )
+{
+    tx_mode = mode;
+}
+
+
+/**
+    @brief Select whether reads wait for data
+*/
+void RPI_AuxMiniUartSetRxMode( aux_rx_mode_t mode )
+{
+    rx_mode = mode;
+}
+
+
+/**
+    @brief Read the line status register
+
+    Reading LSR clears the receiver overrun flag (and the copy in the extra
+    status register) so every read has to go through here for overruns to
+    be counted
+*/
+static inline uint32_t read_lsr( void )
+{
+    uint32_t lsr = auxillary->mini_uart.lsr;
+
+    if( lsr & AUX_MULSR_RX_OVERRUN )
+        stats.rx_overruns++;
+
+    return lsr;
+}
+
+
+/**
+    @brief Move as much of the transmit ring into the hardware FIFO as it
+    will accept
+
+    @return non-zero if the ring still has data waiting
+*/
+static int tx_drain( void )
+{
+    uint8_t c;
+
+    while( read_lsr() & AUX_MULSR_TX_EMPTY )
+    {
+        if( !RPI_RingGet( &tx_ring, &c ) )
+            return 0;
+
+        auxillary->mini_uart.io = c;
+        stats.tx_bytes++;
+    }
+
+    return 1;
 }
 
 
 void RPI_AuxMiniUartWrite( char c )
 {
-    /* Wait until the UART has an empty space in the FIFO */
-    while( ( auxillary->MU_LSR & AUX_MULSR_TX_EMPTY ) == 0 ) { }
+    uint32_t level;
+
+    switch( tx_mode )
+    {
+        case AUX_TX_OVERWRITE:
+            if( !RPI_RingPutOverwrite( &tx_ring, c ) )
+                stats.tx_dropped++;
+            break;
+
+        case AUX_TX_BLOCK:
+            while( !RPI_RingPut( &tx_ring, c ) )
+            {
+                /* Nobody else is going to drain the ring if interrupts are
+                   off, so feed the FIFO ourselves */
+                if( RPI_InterruptsMasked() )
+                    tx_drain();
+            }
+            break;
+
+        case AUX_TX_DROP:
+        default:
+            if( !RPI_RingPut( &tx_ring, c ) )
+                stats.tx_dropped++;
+            break;
+    }
+
+    level = RPI_RingCount( &tx_ring );
+    if( level > stats.tx_high_water )
+        stats.tx_high_water = level;
+
+    /* Kick the transmit interrupt. The IRQ handler turns it off again when
+       it finds the ring empty, and as it can't run part way through this
+       write the enable is never lost */
+    auxillary->mini_uart.ier = AUX_MUIER_IRQ_ENABLE | AUX_MUIER_RX_IRQ | AUX_MUIER_TX_IRQ;
+}
+
+
+/**
+    @brief Empty the hardware receive FIFO into the receive ring
+*/
+static void rx_fill( void )
+{
+    while( read_lsr() & AUX_MULSR_DATA_READY )
+    {
+        if( RPI_RingPut( &rx_ring, auxillary->mini_uart.io & 0xFF ) )
+            stats.rx_bytes++;
+        else
+            stats.rx_dropped++;
+    }
+}
+
+
+/**
+    @brief Read up to length bytes that have been received
+
+    In AUX_RX_BLOCK mode this sleeps until at least one byte is available,
+    otherwise it returns straight away.
+
+    @return The number of bytes copied into buffer
+*/
+int RPI_AuxMiniUartRead( char* buffer, int length )
+{
+    int count = 0;
+    uint8_t c;
+    uint32_t cpsr;
+
+    while( count < length )
+    {
+        if( RPI_RingGet( &rx_ring, &c ) )
+        {
+            buffer[count++] = c;
+            continue;
+        }
+
+        if( ( count > 0 ) || ( rx_mode == AUX_RX_NONBLOCK ) )
+            break;
+
+        /* Nothing yet. The receive interrupt wakes us up, unless interrupts
+           are off in which case go and get the data ourselves. Masking
+           before checking the ring again closes the race with a byte
+           arriving just before going to sleep, WFI still wakes for the
+           pending interrupt and it is taken once they're restored */
+        cpsr = RPI_InterruptsSave();
+
+        if( cpsr & 0x80 )
+            rx_fill();
+        else if( RPI_RingEmpty( &rx_ring ) )
+            __asm__ __volatile__( "dsb\n\twfi" ::: "memory" );
+
+        RPI_InterruptsRestore( cpsr );
+    }
+
+    return count;
+}
+
+
+/**
+    @brief Wait until everything queued has been handed to the hardware
+*/
+void RPI_AuxMiniUartFlush( void )
+{
+    while( !RPI_RingEmpty( &tx_ring ) )
+    {
+        if( RPI_InterruptsMasked() )
+            tx_drain();
+    }
+}
+
+
+/**
+    @brief Bytes that can be written without the ring filling up
+*/
+int RPI_AuxMiniUartTxSpace( void )
+{
+    return ( tx_ring.mask + 1 ) - RPI_RingCount( &tx_ring );
+}
+
+
+/**
+    @brief Have a function called from the interrupt whenever there is new
+    data to read or more room to write, NULL to stop
+*/
+void RPI_AuxMiniUartSetNotify( aux_notify_t func, void* param )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+
+    notify = func;
+    notify_param = param;
+
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+static inline void notify_waiter( void )
+{
+    if( notify )
+        notify( notify_param );
+}
+
+
+const aux_stats_t* RPI_AuxMiniUartGetStats( void )
+{
+    return &stats;
+}
+
+
+/**
+    @brief Service the AUX interrupt, registered with the IRQ dispatcher
+*/
+void RPI_AuxIrqHandler( void* param )
+{
+    uint32_t iir;
+
+    if( ( auxillary->irq & AUX_IRQ_MU ) == 0 )
+        return;
+
+    while( ( ( iir = auxillary->mini_uart.iir ) & AUX_MUIIR_NOT_PENDING ) == 0 )
+    {
+        switch( iir & AUX_MUIIR_ID_MASK )
+        {
+            case AUX_MUIIR_ID_RX_VALID:
+                rx_fill();
+                break;
+
+            case AUX_MUIIR_ID_TX_EMPTY:
+                /* Stop the interrupt once there is nothing left to send */
+                if( !tx_drain() )
+                    auxillary->mini_uart.ier = AUX_MUIER_IRQ_ENABLE | AUX_MUIER_RX_IRQ;
+                break;
+
+            default:
+                notify_waiter();
+                return;
+        }
+    }
 
-    /* Write the character to the FIFO for transmission */
-    auxillary->MU_IO = c;
+    notify_waiter();
 }
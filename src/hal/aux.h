@@ -57,6 +57,17 @@
 #define AUX_MULCR_BREAK             ( 1 << 6 )
 #define AUX_MULCR_DLAB_ACCESS       ( 1 << 7 )
 
+#define AUX_MUIER_RX_IRQ            ( 1 << 0 )  /* See errata, bits 1:0 are swapped */
+#define AUX_MUIER_TX_IRQ            ( 1 << 1 )
+#define AUX_MUIER_IRQ_ENABLE        ( 3 << 2 )  /* See errata, required for any IRQ */
+
+#define AUX_MUIIR_NOT_PENDING       ( 1 << 0 )
+#define AUX_MUIIR_ID_MASK           ( 3 << 1 )
+#define AUX_MUIIR_ID_TX_EMPTY       ( 1 << 1 )
+#define AUX_MUIIR_ID_RX_VALID       ( 2 << 1 )
+#define AUX_MUIIR_CLEAR_RX_FIFO     ( 1 << 1 )
+#define AUX_MUIIR_CLEAR_TX_FIFO     ( 1 << 2 )
+
 #define AUX_MUMCR_RTS               ( 1 << 1 )
 
 #define AUX_MULSR_DATA_READY        ( 1 << 0 )
@@ -536,7 +547,7 @@ struct AUX_REGISTERS {
 
 	struct AUX_UART_REGISTERS mini_uart;
 
-	sfr_reg_t reserved2[(0x80 - 0x68) / 4];
+	sfr_reg_t reserved2[(0x80 - 0x6C) / 4];
 
 	/**
 	 * @brief      SPI 0 register set 
@@ -554,9 +565,55 @@ struct AUX_REGISTERS {
 };
 
 
+/** @brief Size of the mini UART transmit ring, must be a power of two */
+#ifndef AUX_TX_BUFFER_SIZE
+    #define AUX_TX_BUFFER_SIZE      4096
+#endif
+
+/** @brief Size of the mini UART receive ring, must be a power of two */
+#ifndef AUX_RX_BUFFER_SIZE
+    #define AUX_RX_BUFFER_SIZE      1024
+#endif
+
+/** @brief What RPI_AuxMiniUartWrite() does when the transmit ring is full */
+typedef enum {
+    AUX_TX_DROP = 0,            /**< Discard the new byte */
+    AUX_TX_BLOCK,               /**< Wait for the IRQ to make space */
+    AUX_TX_OVERWRITE,           /**< Discard the oldest queued byte */
+    } aux_tx_mode_t;
+
+/** @brief What RPI_AuxMiniUartRead() does when nothing has been received */
+typedef enum {
+    AUX_RX_NONBLOCK = 0,        /**< Return straight away with nothing */
+    AUX_RX_BLOCK,               /**< Sleep until at least one byte arrives */
+    } aux_rx_mode_t;
+
+/** @brief Mini UART transfer statistics */
+typedef struct {
+    uint32_t tx_bytes;          /**< Bytes handed to the FIFO */
+    uint32_t tx_dropped;        /**< Bytes lost to a full ring */
+    uint32_t tx_high_water;     /**< Most bytes ever queued in the ring */
+    uint32_t rx_bytes;          /**< Bytes taken from the FIFO */
+    uint32_t rx_dropped;        /**< Bytes lost to a full receive ring */
+    uint32_t rx_overruns;       /**< Times the hardware FIFO overflowed */
+    } aux_stats_t;
+
+/** @brief Called from the interrupt when bytes have been received or room
+    has been made in the transmit ring, so a task waiting on either can be
+    woken rather than spin */
+typedef void (*aux_notify_t)( void* param );
+
 typedef void aux_t;
 extern aux_t* RPI_GetAux( void );
 extern void RPI_AuxMiniUartInit( int baud, int bits );
+extern void RPI_AuxMiniUartSetTxMode( aux_tx_mode_t mode );
+extern void RPI_AuxMiniUartSetRxMode( aux_rx_mode_t mode );
 extern void RPI_AuxMiniUartWrite( char c );
+extern int RPI_AuxMiniUartRead( char* buffer, int length );
+extern void RPI_AuxMiniUartFlush( void );
+extern int RPI_AuxMiniUartTxSpace( void );
+extern void RPI_AuxMiniUartSetNotify( aux_notify_t notify, void* param );
+extern const aux_stats_t* RPI_AuxMiniUartGetStats( void );
+extern void RPI_AuxIrqHandler( void* param );
 
 #endif
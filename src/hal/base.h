@@ -39,6 +39,22 @@
     #define PERIPHERAL_BASE     0x20000000UL
 #endif
 
+/** @brief The VideoCore and DMA engines see memory through bus addresses.
+    The top two bits select a cache alias, the ARM sets up its buffers
+    through the alias that bypasses the VideoCore L2 cache */
+#ifdef RPI2
+    #define RPI_BUS_ALIAS       0xC0000000UL
+#else
+    #define RPI_BUS_ALIAS       0x40000000UL
+#endif
+
+#define RPI_PHYS_TO_BUS(x)      ( (uint32_t)(x) | RPI_BUS_ALIAS )
+#define RPI_BUS_TO_PHYS(x)      ( (uint32_t)(x) & 0x3FFFFFFF )
+
+/** @brief Peripherals have bus addresses of their own, at 0x7E000000
+    wherever the ARM sees them */
+#define RPI_PERIPHERAL_TO_BUS(x)    ( (uint32_t)(x) - PERIPHERAL_BASE + 0x7E000000UL )
+
 typedef volatile uint32_t rpi_reg_rw_t;
 typedef volatile const uint32_t rpi_reg_ro_t;
 typedef volatile uint32_t rpi_reg_wo_t;
@@ -0,0 +1,63 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef RPI_CONSOLE_H
+#define RPI_CONSOLE_H
+
+/* The console is the mini UART unless CONSOLE_PL011 is set, both come out
+   on GPIO 14 and 15 so only one of them can be used */
+#if( CONSOLE_PL011 == 1 )
+
+    #include "uart.h"
+
+    /** @brief The PL011 can go a lot faster than the mini UART, 3Mbaud is
+        as fast as a 48MHz UART clock allows */
+    #ifndef CONSOLE_BAUD
+        #define CONSOLE_BAUD        3000000
+    #endif
+
+    typedef rpi_uart_stats_t rpi_console_stats_t;
+
+    #define RPI_CONSOLE_RX_NONBLOCK     RPI_UART_RX_NONBLOCK
+
+    #define RPI_ConsoleInit()           RPI_UartInit( CONSOLE_BAUD )
+    #define RPI_ConsoleSetRxMode( m )   RPI_UartSetRxMode( m )
+    #define RPI_ConsoleWrite( c )       RPI_UartWrite( c )
+    #define RPI_ConsoleRead( b, n )     RPI_UartRead( b, n )
+    #define RPI_ConsoleFlush()          RPI_UartFlush()
+    #define RPI_ConsoleTxSpace()        RPI_UartTxSpace()
+    #define RPI_ConsoleSetNotify( f, p ) RPI_UartSetNotify( f, p )
+    #define RPI_ConsoleGetStats()       RPI_UartGetStats()
+    #define RPI_ConsoleEnableDma()      RPI_UartEnableDma()
+
+#else
+
+    #include "aux.h"
+
+    #ifndef CONSOLE_BAUD
+        #define CONSOLE_BAUD        115200
+    #endif
+
+    typedef aux_stats_t rpi_console_stats_t;
+
+    #define RPI_CONSOLE_RX_NONBLOCK     AUX_RX_NONBLOCK
+
+    #define RPI_ConsoleInit()           RPI_AuxMiniUartInit( CONSOLE_BAUD, 8 )
+    #define RPI_ConsoleSetRxMode( m )   RPI_AuxMiniUartSetRxMode( m )
+    #define RPI_ConsoleWrite( c )       RPI_AuxMiniUartWrite( c )
+    #define RPI_ConsoleRead( b, n )     RPI_AuxMiniUartRead( b, n )
+    #define RPI_ConsoleFlush()          RPI_AuxMiniUartFlush()
+    #define RPI_ConsoleTxSpace()        RPI_AuxMiniUartTxSpace()
+    #define RPI_ConsoleSetNotify( f, p ) RPI_AuxMiniUartSetNotify( f, p )
+    #define RPI_ConsoleGetStats()       RPI_AuxMiniUartGetStats()
+
+    /* The mini UART has no DREQ of its own */
+    #define RPI_ConsoleEnableDma()      ( -1 )
+
+#endif
+
+#endif
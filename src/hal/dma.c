@@ -0,0 +1,318 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arch/cache.h"
+#include "kernel/pool.h"
+
+#include "dma.h"
+#include "interrupts.h"
+
+/* Enough control blocks for a few chains in flight at once */
+#define DMA_CB_POOL_SIZE        64
+
+POOL_DECLARE( dma_cb_pool, rpi_dma_cb_t )
+POOL_DEFINE_ALIGNED( dma_cb_pool, rpi_dma_cb_t, DMA_CB_POOL_SIZE, 32 );
+
+typedef struct {
+    rpi_dma_cb_t* chain;
+    rpi_dma_callback_t callback;
+    void* param;
+    volatile int busy;
+    volatile int error;
+    } dma_state_t;
+
+static dma_state_t state[RPI_DMA_CHANNELS];
+
+/* Channels the firmware has left for the ARM, and those of them in use */
+static uint32_t available = 0;
+static uint32_t allocated = 0;
+
+
+static inline rpi_dma_channel_t* dma_channel( int channel )
+{
+    return (rpi_dma_channel_t*)( RPI_DMA_BASE + ( channel * 0x100 ) );
+}
+
+
+/**
+    @brief Set up the channels the firmware says are free for the ARM to use,
+    the mask from TAG_GET_DMA_CHANNELS
+*/
+void RPI_DmaInit( uint32_t channel_mask )
+{
+    int channel;
+
+    available = channel_mask & ( ( 1 << RPI_DMA_CHANNELS ) - 1 );
+    allocated = 0;
+
+    for( channel = 0; channel < RPI_DMA_CHANNELS; channel++ )
+    {
+        if( ( available & ( 1 << channel ) ) == 0 )
+            continue;
+
+        dma_channel( channel )->CS = RPI_DMA_CS_RESET;
+
+        RPI_IrqRegister( RPI_IRQ_DMA_0 + channel, RPI_DmaIrqHandler, (void*)channel );
+        RPI_IrqEnable( RPI_IRQ_DMA_0 + channel );
+    }
+}
+
+
+/**
+    @brief Claim a channel
+
+    Callers that don't ask for RPI_DMA_CHANNEL_FULL get a lite channel if
+    one is free, so the full channels are left for 2D transfers.
+
+    @return The channel number, -1 if none is free
+*/
+int RPI_DmaChannelAlloc( int flags )
+{
+    const uint32_t full = ( 1u << RPI_DMA_LITE_FIRST ) - 1;
+    uint32_t free;
+    uint32_t cpsr;
+    int channel;
+
+    cpsr = RPI_InterruptsSave();
+
+    free = available & ~allocated;
+
+    if( flags & RPI_DMA_CHANNEL_FULL )
+        free &= full;
+    else if( free & ~full )
+        free &= ~full;
+
+    channel = free ? __builtin_ctz( free ) : -1;
+
+    if( channel >= 0 )
+        allocated |= ( 1u << channel );
+
+    RPI_InterruptsRestore( cpsr );
+
+    return channel;
+}
+
+
+/**
+    @brief Give a channel back. It must not be busy
+*/
+void RPI_DmaChannelFree( int channel )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+
+    allocated &= ~( 1 << channel );
+
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+/**
+    @brief Get a control block from the pool, set to a transfer of nothing
+    that ends the chain
+
+    @return The block, NULL if the pool is empty
+*/
+rpi_dma_cb_t* RPI_DmaCbAlloc( void )
+{
+    rpi_dma_cb_t* cb = dma_cb_pool_alloc();
+
+    if( cb )
+    {
+        cb->ti = 0;
+        cb->source_ad = 0;
+        cb->dest_ad = 0;
+        cb->txfr_len = 0;
+        cb->stride = 0;
+        cb->nextconbk = 0;
+        cb->next = NULL;
+    }
+
+    return cb;
+}
+
+
+/**
+    @brief Give a control block, and every block chained after it, back to
+    the pool
+*/
+void RPI_DmaCbFree( rpi_dma_cb_t* chain )
+{
+    rpi_dma_cb_t* next;
+
+    while( chain )
+    {
+        next = chain->next;
+        dma_cb_pool_free( chain );
+        chain = next;
+    }
+}
+
+
+/**
+    @brief Have the engine go on to next once cb is done
+*/
+void RPI_DmaCbLink( rpi_dma_cb_t* cb, rpi_dma_cb_t* next )
+{
+    cb->next = next;
+    cb->nextconbk = next ? RPI_PHYS_TO_BUS( next ) : 0;
+}
+
+
+/**
+    @brief Fill in a 2D transfer of height rows of width bytes
+
+    The strides are the distance from the start of one row to the start of
+    the next, which may be negative to work up the screen. A source stride of
+    0 with ti not including RPI_DMA_TI_SRC_INC reads the same word over and
+    over, which is how fills are done. Needs a full channel.
+
+    @return 0, or -1 if the size can't be done in one block, in which case
+            the block is left alone
+*/
+int RPI_DmaCb2D( rpi_dma_cb_t* cb, uint32_t ti,
+                 void* dest, int dest_stride,
+                 const void* source, int source_stride,
+                 uint32_t width, uint32_t height )
+{
+    /* The engine adds the stride on to where the row left off */
+    int dest_skip = dest_stride - (int)width;
+    int source_skip = ( ti & RPI_DMA_TI_SRC_INC ) ? ( source_stride - (int)width ) : 0;
+
+    if( ( width == 0 ) || ( width > 0xFFFF ) || ( height == 0 ) || ( height > 0x4000 ) )
+        return -1;
+
+    cb->ti = ti | RPI_DMA_TI_TDMODE;
+    cb->source_ad = RPI_PHYS_TO_BUS( source );
+    cb->dest_ad = RPI_PHYS_TO_BUS( dest );
+
+    /* YLENGTH is one less than the number of rows, the engine always does
+       one more than it says */
+    cb->txfr_len = ( ( height - 1 ) << 16 ) | width;
+    cb->stride = ( ( dest_skip & 0xFFFF ) << 16 ) | ( source_skip & 0xFFFF );
+
+    return 0;
+}
+
+
+/**
+    @brief Start a chain of control blocks on a channel
+
+    The blocks are pushed out of the data cache first, but any source data
+    in cached memory is the caller's to clean. Only the last block in the
+    chain raises the interrupt, at which point callback (if not NULL) is
+    called and the channel is free for the next chain. The blocks still
+    belong to the caller.
+
+    @return 0 if the chain was started, -1 if the channel is busy
+*/
+int RPI_DmaStart( int channel, rpi_dma_cb_t* chain,
+                  rpi_dma_callback_t callback, void* param )
+{
+    rpi_dma_channel_t* regs = dma_channel( channel );
+    rpi_dma_cb_t* cb;
+
+    if( state[channel].busy )
+        return -1;
+
+    for( cb = chain; cb; cb = cb->next )
+    {
+        if( cb->next )
+            cb->ti &= ~RPI_DMA_TI_INTEN;
+        else
+            cb->ti |= RPI_DMA_TI_INTEN;
+
+        cache_clean_range( cb, sizeof( *cb ) );
+    }
+
+    state[channel].chain = chain;
+    state[channel].callback = callback;
+    state[channel].param = param;
+    state[channel].error = 0;
+    state[channel].busy = 1;
+
+    /* The blocks have to be in memory before the engine is told where */
+    __asm__ __volatile__( "dsb" ::: "memory" );
+
+    regs->CS = RPI_DMA_CS_END | RPI_DMA_CS_INT;
+    regs->CONBLK_AD = RPI_PHYS_TO_BUS( chain );
+    regs->CS = RPI_DMA_CS_ACTIVE | RPI_DMA_CS_PRIORITY( 8 ) |
+               RPI_DMA_CS_PANIC_PRIORITY( 8 ) | RPI_DMA_CS_WAIT_FOR_WRITES;
+
+    return 0;
+}
+
+
+int RPI_DmaBusy( int channel )
+{
+    return state[channel].busy;
+}
+
+
+/**
+    @brief Wait for the chain on a channel to finish
+
+    @return 0 if it finished, -1 if the engine stopped with an error
+*/
+int RPI_DmaWait( int channel )
+{
+    rpi_dma_channel_t* regs = dma_channel( channel );
+    uint32_t cpsr;
+
+    while( state[channel].busy )
+    {
+        /* The interrupt will wake us, unless interrupts are off in which
+           case do its job here. Masking before checking again closes the
+           race with the chain finishing just before going to sleep */
+        cpsr = RPI_InterruptsSave();
+
+        if( cpsr & 0x80 )
+        {
+            if( ( regs->CS & RPI_DMA_CS_ACTIVE ) == 0 )
+                RPI_DmaIrqHandler( (void*)channel );
+        }
+        else if( state[channel].busy )
+        {
+            __asm__ __volatile__( "dsb\n\twfi" ::: "memory" );
+        }
+
+        RPI_InterruptsRestore( cpsr );
+    }
+
+    return state[channel].error ? -1 : 0;
+}
+
+
+/**
+    @brief Service a channel's interrupt, registered with the IRQ dispatcher
+    with the channel number as the parameter
+*/
+void RPI_DmaIrqHandler( void* param )
+{
+    int channel = (int)param;
+    rpi_dma_channel_t* regs = dma_channel( channel );
+    dma_state_t* dma = &state[channel];
+    uint32_t cs = regs->CS;
+
+    /* Writing the bits back clears them */
+    regs->CS = cs & ( RPI_DMA_CS_END | RPI_DMA_CS_INT );
+
+    if( !dma->busy )
+        return;
+
+    dma->error = ( cs & RPI_DMA_CS_ERROR ) != 0;
+
+    if( dma->error )
+        regs->CS = RPI_DMA_CS_RESET;
+
+    dma->busy = 0;
+
+    if( dma->callback )
+        dma->callback( channel, dma->error, dma->param );
+}
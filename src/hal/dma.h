@@ -0,0 +1,119 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef RPI_DMA_H
+#define RPI_DMA_H
+
+#include <stdint.h>
+
+#include "base.h"
+
+#define RPI_DMA_BASE            ( PERIPHERAL_BASE + 0x7000 )
+
+/** @brief Channels 0-14 share a register block, channel 15 is elsewhere and
+    not used. Channels 13 and 14 have no interrupt of their own so aren't
+    used either */
+#define RPI_DMA_CHANNELS        13
+
+/** @brief Channels from here on are DMA lite channels, with no 2D mode and
+    transfers of no more than 64KB */
+#define RPI_DMA_LITE_FIRST      7
+
+/** @brief Largest 2D transfer, XLENGTH is 16 bits and YLENGTH 14 */
+#define RPI_DMA_2D_MAX_X        0xFFFF
+#define RPI_DMA_2D_MAX_Y        0x3FFF
+
+/* Control and status register */
+#define RPI_DMA_CS_ACTIVE       ( 1 << 0 )
+#define RPI_DMA_CS_END          ( 1 << 1 )
+#define RPI_DMA_CS_INT          ( 1 << 2 )
+#define RPI_DMA_CS_ERROR        ( 1 << 8 )
+#define RPI_DMA_CS_PRIORITY( x )        ( ( x ) << 16 )
+#define RPI_DMA_CS_PANIC_PRIORITY( x )  ( ( x ) << 20 )
+#define RPI_DMA_CS_WAIT_FOR_WRITES      ( 1 << 28 )
+#define RPI_DMA_CS_ABORT        ( 1 << 30 )
+#define RPI_DMA_CS_RESET        ( 1 << 31 )
+
+/* Transfer information, in the control block */
+#define RPI_DMA_TI_INTEN        ( 1 << 0 )
+#define RPI_DMA_TI_TDMODE       ( 1 << 1 )
+#define RPI_DMA_TI_WAIT_RESP    ( 1 << 3 )
+#define RPI_DMA_TI_DEST_INC     ( 1 << 4 )
+#define RPI_DMA_TI_DEST_WIDTH   ( 1 << 5 )
+#define RPI_DMA_TI_DEST_DREQ    ( 1 << 6 )
+#define RPI_DMA_TI_SRC_INC      ( 1 << 8 )
+#define RPI_DMA_TI_SRC_WIDTH    ( 1 << 9 )
+#define RPI_DMA_TI_SRC_DREQ     ( 1 << 10 )
+#define RPI_DMA_TI_SRC_IGNORE   ( 1 << 11 )
+#define RPI_DMA_TI_BURST( x )   ( ( x ) << 12 )
+#define RPI_DMA_TI_PERMAP( x )  ( ( x ) << 16 )
+#define RPI_DMA_TI_NO_WIDE_BURSTS       ( 1 << 26 )
+
+/* Peripherals that pace a transfer through DREQ, for RPI_DMA_TI_PERMAP() */
+#define RPI_DMA_DREQ_UART_TX    12
+#define RPI_DMA_DREQ_UART_RX    14
+
+/* Debug register, the same bit says whether a channel is a lite one */
+#define RPI_DMA_DEBUG_LITE      ( 1 << 28 )
+
+/** @brief One channel's registers, each channel is 0x100 on from the last */
+typedef struct {
+    rpi_reg_rw_t CS;
+    rpi_reg_rw_t CONBLK_AD;
+    rpi_reg_ro_t TI;
+    rpi_reg_ro_t SOURCE_AD;
+    rpi_reg_ro_t DEST_AD;
+    rpi_reg_ro_t TXFR_LEN;
+    rpi_reg_ro_t STRIDE;
+    rpi_reg_ro_t NEXTCONBK;
+    rpi_reg_rw_t DEBUG;
+    } rpi_dma_channel_t;
+
+/** @brief A control block, read by the DMA engine from memory so must be
+    32 byte aligned. The engine ignores the last two words so they are used
+    to keep the chain in a form the ARM can walk */
+typedef struct rpi_dma_cb {
+    uint32_t ti;
+    uint32_t source_ad;
+    uint32_t dest_ad;
+    uint32_t txfr_len;
+    uint32_t stride;
+
+    /** Bus address of the next block, 0 to stop */
+    uint32_t nextconbk;
+
+    struct rpi_dma_cb* next;
+    uint32_t reserved;
+    } __attribute__((aligned(32))) rpi_dma_cb_t;
+
+/** @brief Called from the channel's interrupt when a chain has finished,
+    error is non-zero if the engine stopped with an error */
+typedef void (*rpi_dma_callback_t)( int channel, int error, void* param );
+
+/** @brief Ask RPI_DmaChannelAlloc() for a full channel, one that can do 2D
+    transfers */
+#define RPI_DMA_CHANNEL_FULL    0x1
+
+extern void RPI_DmaInit( uint32_t channel_mask );
+extern int RPI_DmaChannelAlloc( int flags );
+extern void RPI_DmaChannelFree( int channel );
+
+extern rpi_dma_cb_t* RPI_DmaCbAlloc( void );
+extern void RPI_DmaCbFree( rpi_dma_cb_t* chain );
+extern void RPI_DmaCbLink( rpi_dma_cb_t* cb, rpi_dma_cb_t* next );
+extern int RPI_DmaCb2D( rpi_dma_cb_t* cb, uint32_t ti,
+                        void* dest, int dest_stride,
+                        const void* source, int source_stride,
+                        uint32_t width, uint32_t height );
+
+extern int RPI_DmaStart( int channel, rpi_dma_cb_t* chain,
+                         rpi_dma_callback_t callback, void* param );
+extern int RPI_DmaBusy( int channel );
+extern int RPI_DmaWait( int channel );
+extern void RPI_DmaIrqHandler( void* param );
+
+#endif
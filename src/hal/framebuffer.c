@@ -0,0 +1,457 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arch/cache.h"
+#include "arch/mmu.h"
+
+#include "dma.h"
+#include "framebuffer.h"
+#include "mailbox-interface.h"
+#include "systimer.h"
+
+static rpi_framebuffer_t framebuffer;
+
+/* Flips go through a property buffer of their own so they can be in flight
+   whilst the default buffer is used for anything else */
+static uint32_t present_pt[64] __attribute__((aligned(CACHE_LINE_SIZE)));
+static rpi_property_t present_property;
+
+/* Fills and blits are collected into a chain of DMA control blocks that is
+   started by RPI_FramebufferDmaSubmit(). The channel is claimed on first
+   use */
+static int dma_channel = -1;
+static rpi_dma_cb_t* dma_head = NULL;
+static rpi_dma_cb_t* dma_tail = NULL;
+
+
+rpi_framebuffer_t* RPI_GetFramebuffer( void )
+{
+    return &framebuffer;
+}
+
+
+/**
+    @brief Add the tags that allocate the framebuffer to the current property
+    buffer, so they can go to the firmware along with other requests
+
+    The virtual height is set to twice the physical height so that one page
+    can be drawn whilst the other is scanned out. Once the buffer has been
+    processed RPI_FramebufferParseTags() picks up the result.
+*/
+void RPI_FramebufferAddTags( int width, int height, int bpp )
+{
+    rpi_tag_buffer_t* buffer;
+    rpi_tag_size_t* size;
+    rpi_tag_virtual_offset_t* offset;
+    rpi_tag_u32_t* value;
+
+    framebuffer.width = width;
+    framebuffer.height = height;
+    framebuffer.bpp = bpp;
+    framebuffer.pages = 1;
+    framebuffer.front = 0;
+    framebuffer.base = NULL;
+    framebuffer.flip_pending = 0;
+
+    RPI_PropertyBufferInit( &present_property, present_pt, sizeof( present_pt ) / sizeof( present_pt[0] ) );
+
+    buffer = RPI_PROPERTY_ADD( TAG_ALLOCATE_BUFFER, rpi_tag_buffer_t );
+    buffer->base = 16;
+
+    size = RPI_PROPERTY_ADD( TAG_SET_PHYSICAL_SIZE, rpi_tag_size_t );
+    size->width = width;
+    size->height = height;
+
+    size = RPI_PROPERTY_ADD( TAG_SET_VIRTUAL_SIZE, rpi_tag_size_t );
+    size->width = width;
+    size->height = height * RPI_FRAMEBUFFER_PAGES;
+
+    offset = RPI_PROPERTY_ADD( TAG_SET_VIRTUAL_OFFSET, rpi_tag_virtual_offset_t );
+    offset->x = 0;
+    offset->y = 0;
+
+    value = RPI_PROPERTY_ADD( TAG_SET_DEPTH, rpi_tag_u32_t );
+    value->value = bpp;
+
+    RPI_PROPERTY_ADD( TAG_GET_PITCH, rpi_tag_u32_t );
+    RPI_PROPERTY_ADD( TAG_GET_PHYSICAL_SIZE, rpi_tag_size_t );
+    RPI_PROPERTY_ADD( TAG_GET_VIRTUAL_SIZE, rpi_tag_size_t );
+    RPI_PROPERTY_ADD( TAG_GET_DEPTH, rpi_tag_u32_t );
+
+    /* Find out if the firmware can block until vsync. Older firmware leaves
+       the tag unanswered, in which case we fall back to the system timer */
+    RPI_PROPERTY_ADD( TAG_WAIT_FOR_VSYNC, rpi_tag_u32_t );
+}
+
+
+/**
+    @brief Pick up the framebuffer from a processed property buffer that had
+    RPI_FramebufferAddTags() in it
+
+    @return 0 on success, -1 if the firmware did not give us a framebuffer
+*/
+int RPI_FramebufferParseTags( void )
+{
+    rpi_tag_buffer_t* buffer;
+    rpi_tag_size_t* size;
+    rpi_tag_u32_t* value;
+
+    if( ( size = RPI_PROPERTY_GET( TAG_GET_PHYSICAL_SIZE, rpi_tag_size_t ) ) )
+    {
+        framebuffer.width = size->width;
+        framebuffer.height = size->height;
+    }
+
+    if( ( size = RPI_PROPERTY_GET( TAG_GET_VIRTUAL_SIZE, rpi_tag_size_t ) ) )
+    {
+        if( size->height >= ( framebuffer.height * RPI_FRAMEBUFFER_PAGES ) )
+            framebuffer.pages = RPI_FRAMEBUFFER_PAGES;
+    }
+
+    if( ( value = RPI_PROPERTY_GET( TAG_GET_DEPTH, rpi_tag_u32_t ) ) )
+        framebuffer.bpp = value->value;
+
+    if( ( value = RPI_PROPERTY_GET( TAG_GET_PITCH, rpi_tag_u32_t ) ) )
+        framebuffer.pitch = value->value;
+
+    if( ( buffer = RPI_PROPERTY_GET( TAG_ALLOCATE_BUFFER, rpi_tag_buffer_t ) ) )
+    {
+        framebuffer.base = (uint8_t*)RPI_BUS_TO_PHYS( buffer->base );
+        framebuffer.size = buffer->size;
+    }
+
+    framebuffer.vsync = ( RPI_PropertyGet( TAG_WAIT_FOR_VSYNC ) != NULL );
+    framebuffer.flip_time = RPI_GetSystemTimer()->counter_lo;
+
+    if( framebuffer.base == NULL )
+        return -1;
+
+    /* The scan out reads memory directly, so don't cache the pages. Normal
+       uncached memory still merges the stores from the fill engine */
+    mmu_set_region( (uint32_t)framebuffer.base, framebuffer.size, MMU_NORMAL_UNCACHED );
+
+    return 0;
+}
+
+
+/**
+    @brief Allocate a double buffered framebuffer from the VideoCore in a
+    property buffer of its own
+
+    @return 0 on success, -1 if the firmware did not give us a framebuffer
+*/
+int RPI_FramebufferInit( int width, int height, int bpp )
+{
+    RPI_PropertyInit();
+    RPI_FramebufferAddTags( width, height, bpp );
+    RPI_PropertyProcess();
+
+    return RPI_FramebufferParseTags();
+}
+
+
+/**
+    @brief Get the page to draw the next frame into
+
+    The returned page is never the one being scanned out. If the last flip
+    is still waiting on vsync this waits for the firmware to answer. With the
+    timer fallback this waits, if required, until a full refresh period has
+    passed since the last flip so the previous front page is off the screen.
+*/
+uint8_t* RPI_FramebufferAcquire( void )
+{
+    int back = ( framebuffer.front + 1 ) % framebuffer.pages;
+
+    if( !RPI_PropertyBufferDone( &present_property ) )
+        RPI_PropertyBufferWait( &present_property );
+
+    if( framebuffer.flip_pending )
+    {
+        while( ( RPI_GetSystemTimer()->counter_lo - framebuffer.flip_time ) <
+               RPI_FRAMEBUFFER_FRAME_US )
+        {
+            /* BLANK */
+        }
+
+        framebuffer.flip_pending = 0;
+    }
+
+    return framebuffer.base + ( back * framebuffer.height * framebuffer.pitch );
+}
+
+
+/**
+    @brief Scan out the page returned by the last RPI_FramebufferAcquire()
+
+    When the firmware supports it the offset change and vsync wait go in the
+    same property buffer, so once the firmware answers the new page is on the
+    screen and the old one is free to draw into. This doesn't wait for the
+    answer, the caller gets on with other work until the next
+    RPI_FramebufferAcquire().
+*/
+void RPI_FramebufferPresent( void )
+{
+    rpi_tag_virtual_offset_t* offset;
+
+    if( framebuffer.pages < 2 )
+        return;
+
+    /* Anything queued for the DMA engine is part of this frame */
+    RPI_FramebufferDmaSubmit();
+    RPI_FramebufferDmaWait();
+
+    /* Only one flip can be in flight */
+    if( !RPI_PropertyBufferDone( &present_property ) )
+        RPI_PropertyBufferWait( &present_property );
+
+    framebuffer.front = ( framebuffer.front + 1 ) % framebuffer.pages;
+
+    RPI_PropertyBufferReset( &present_property );
+
+    offset = RPI_PROPERTY_BUFFER_ADD( &present_property, TAG_SET_VIRTUAL_OFFSET, rpi_tag_virtual_offset_t );
+    offset->x = 0;
+    offset->y = framebuffer.front * framebuffer.height;
+
+    if( framebuffer.vsync )
+        RPI_PROPERTY_BUFFER_ADD( &present_property, TAG_WAIT_FOR_VSYNC, rpi_tag_u32_t );
+
+    RPI_PropertyBufferSubmit( &present_property, NULL, NULL );
+
+    if( !framebuffer.vsync )
+    {
+        framebuffer.flip_time = RPI_GetSystemTimer()->counter_lo;
+        framebuffer.flip_pending = 1;
+    }
+}
+
+
+/**
+    @brief DMA completion, the chain is finished with
+*/
+static void dma_complete( int channel, int error, void* param )
+{
+    RPI_DmaCbFree( (rpi_dma_cb_t*)param );
+}
+
+
+/**
+    @brief Get a control block on the end of the pending chain. If the pool
+    has run dry the pending chain is sent and waited for to free some up
+
+    @return The block, NULL if there's no DMA channel for the framebuffer
+*/
+static rpi_dma_cb_t* dma_append( void )
+{
+    rpi_dma_cb_t* cb;
+
+    if( dma_channel < 0 )
+    {
+        if( ( dma_channel = RPI_DmaChannelAlloc( RPI_DMA_CHANNEL_FULL ) ) < 0 )
+            return NULL;
+    }
+
+    if( ( cb = RPI_DmaCbAlloc() ) == NULL )
+    {
+        RPI_FramebufferDmaSubmit();
+        RPI_FramebufferDmaWait();
+
+        if( ( cb = RPI_DmaCbAlloc() ) == NULL )
+            return NULL;
+    }
+
+    if( dma_tail )
+        RPI_DmaCbLink( dma_tail, cb );
+    else
+        dma_head = cb;
+
+    dma_tail = cb;
+
+    return cb;
+}
+
+
+/**
+    @brief Clip a rectangle to the framebuffer
+
+    @return 0 if anything is left of it
+*/
+static int clip_rect( int* x, int* y, int* w, int* h )
+{
+    if( *x < 0 )
+    {
+        *w += *x;
+        *x = 0;
+    }
+
+    if( *y < 0 )
+    {
+        *h += *y;
+        *y = 0;
+    }
+
+    if( ( *x + *w ) > framebuffer.width )
+        *w = framebuffer.width - *x;
+
+    if( ( *y + *h ) > framebuffer.height )
+        *h = framebuffer.height - *y;
+
+    return ( ( *w > 0 ) && ( *h > 0 ) ) ? 0 : -1;
+}
+
+
+/**
+    @brief Queue a DMA fill of a rectangle of a page with a colour in the
+    framebuffer's pixel format
+
+    Nothing happens until RPI_FramebufferDmaSubmit(). Only 16 and 32 bit
+    pixels can be filled as the engine repeats a whole word.
+
+    @return 0 if the fill was queued or clipped away, -1 if it has to be
+            done by the CPU
+*/
+int RPI_FramebufferFillRect( uint8_t* page, int x, int y, int w, int h, uint32_t colour )
+{
+    int bytes = framebuffer.bpp >> 3;
+    rpi_dma_cb_t* cb;
+
+    if( ( framebuffer.bpp != 16 ) && ( framebuffer.bpp != 32 ) )
+        return -1;
+
+    if( clip_rect( &x, &y, &w, &h ) != 0 )
+        return 0;
+
+    if( ( cb = dma_append() ) == NULL )
+        return -1;
+
+    /* The fill word lives in the control block's spare word, so it goes to
+       memory along with the block */
+    if( framebuffer.bpp == 16 )
+        colour = ( colour & 0xFFFF ) | ( colour << 16 );
+
+    cb->reserved = colour;
+
+    return RPI_DmaCb2D( cb, RPI_DMA_TI_DEST_INC | RPI_DMA_TI_BURST( 8 ) | RPI_DMA_TI_WAIT_RESP,
+                        page + ( y * framebuffer.pitch ) + ( x * bytes ), framebuffer.pitch,
+                        &cb->reserved, 0,
+                        w * bytes, h );
+}
+
+
+/**
+    @brief Queue a DMA copy of a rectangle from one page to another, or
+    within a page
+
+    Nothing happens until RPI_FramebufferDmaSubmit(). Overlapping copies
+    work up or down the screen, but a copy to the right along the same rows
+    would overwrite itself and is left to the CPU.
+
+    @return 0 if the copy was queued or clipped away, -1 if it has to be
+            done by the CPU
+*/
+int RPI_FramebufferBlit( uint8_t* dest_page, int dx, int dy,
+                         const uint8_t* source_page, int sx, int sy, int w, int h )
+{
+    int bytes = framebuffer.bpp >> 3;
+    int pitch = framebuffer.pitch;
+    uint8_t* dest;
+    const uint8_t* source;
+    rpi_dma_cb_t* cb;
+
+    /* Clip against both rectangles, moving the other one along with
+       whichever is clipped at the top or left */
+    if( sx < 0 )
+    {
+        dx -= sx;
+        w += sx;
+        sx = 0;
+    }
+
+    if( sy < 0 )
+    {
+        dy -= sy;
+        h += sy;
+        sy = 0;
+    }
+
+    if( dx < 0 )
+    {
+        sx -= dx;
+        w += dx;
+        dx = 0;
+    }
+
+    if( dy < 0 )
+    {
+        sy -= dy;
+        h += dy;
+        dy = 0;
+    }
+
+    if( ( clip_rect( &sx, &sy, &w, &h ) != 0 ) || ( clip_rect( &dx, &dy, &w, &h ) != 0 ) )
+        return 0;
+
+    dest = dest_page + ( dy * pitch ) + ( dx * bytes );
+    source = source_page + ( sy * pitch ) + ( sx * bytes );
+
+    if( ( dest_page == source_page ) && ( dy == sy ) && ( dx > sx ) && ( dx < sx + w ) )
+        return -1;
+
+    if( ( cb = dma_append() ) == NULL )
+        return -1;
+
+    /* Moving down over itself, start at the bottom row and work up */
+    if( ( dest_page == source_page ) && ( dy > sy ) )
+    {
+        dest += ( h - 1 ) * pitch;
+        source += ( h - 1 ) * pitch;
+        pitch = -pitch;
+    }
+
+    return RPI_DmaCb2D( cb, RPI_DMA_TI_DEST_INC | RPI_DMA_TI_SRC_INC | RPI_DMA_TI_BURST( 8 ) |
+                            RPI_DMA_TI_WAIT_RESP,
+                        dest, pitch, source, pitch, w * bytes, h );
+}
+
+
+/**
+    @brief Start the queued fills and blits, they run while the CPU gets on
+    with something else
+
+    @return 0 if they were started, or there was nothing queued
+*/
+int RPI_FramebufferDmaSubmit( void )
+{
+    rpi_dma_cb_t* chain = dma_head;
+
+    if( chain == NULL )
+        return 0;
+
+    /* Only one chain at a time */
+    RPI_FramebufferDmaWait();
+
+    dma_head = NULL;
+    dma_tail = NULL;
+
+    return RPI_DmaStart( dma_channel, chain, dma_complete, chain );
+}
+
+
+/**
+    @brief Wait for the fills and blits that have been submitted
+
+    @return 0 on success, -1 if the DMA engine reported an error
+*/
+int RPI_FramebufferDmaWait( void )
+{
+    if( dma_channel < 0 )
+        return 0;
+
+    return RPI_DmaWait( dma_channel );
+}
@@ -0,0 +1,63 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef RPI_FRAMEBUFFER_H
+#define RPI_FRAMEBUFFER_H
+
+#include <stdint.h>
+
+#include "base.h"
+
+/** @brief Number of pages in the virtual framebuffer, one is scanned out
+    while the other is drawn into */
+#define RPI_FRAMEBUFFER_PAGES       2
+
+/** @brief Assumed display refresh period when the firmware cannot tell us
+    when vsync happens */
+#define RPI_FRAMEBUFFER_FRAME_US    16667
+
+/** @brief A double buffered framebuffer allocated by the VideoCore */
+typedef struct {
+    int width;
+    int height;
+    int pitch;
+    int bpp;
+
+    /** Number of pages the firmware gave us, 1 if it refused the doubled
+        virtual height */
+    int pages;
+
+    /** Base address of page 0, page n is at base + ( n * height * pitch ) */
+    uint8_t* base;
+    uint32_t size;
+
+    /** The page currently being scanned out */
+    int front;
+
+    /** Non-zero if the firmware supports TAG_WAIT_FOR_VSYNC */
+    int vsync;
+
+    /** System timer value at the last flip, used by the timer fallback to
+        know when the previous front page is no longer being scanned out */
+    uint32_t flip_time;
+    int flip_pending;
+    } rpi_framebuffer_t;
+
+extern int RPI_FramebufferInit( int width, int height, int bpp );
+extern void RPI_FramebufferAddTags( int width, int height, int bpp );
+extern int RPI_FramebufferParseTags( void );
+extern rpi_framebuffer_t* RPI_GetFramebuffer( void );
+extern uint8_t* RPI_FramebufferAcquire( void );
+extern void RPI_FramebufferPresent( void );
+
+extern int RPI_FramebufferFillRect( uint8_t* page, int x, int y, int w, int h, uint32_t colour );
+extern int RPI_FramebufferBlit( uint8_t* dest_page, int dx, int dy,
+                                const uint8_t* source_page, int sx, int sy, int w, int h );
+extern int RPI_FramebufferDmaSubmit( void );
+extern int RPI_FramebufferDmaWait( void );
+
+#endif
@@ -1,6 +1,7 @@
 
 #include <stdint.h>
 #include "gpio.h"
+#include "systimer.h"
 
 static rpi_gpio_t* rpiGpio = (rpi_gpio_t*)RPI_GPIO_BASE;
 
@@ -113,3 +114,25 @@ void RPI_SetGpioValue( rpi_gpio_pin_t gpio, rpi_gpio_value_t value )
     else if( ( value == RPI_IO_HI ) || ( value == RPI_IO_ON ) )
         RPI_SetGpioHi( gpio );
 }
+
+
+/**
+    @brief Set the pull on some of GPIO 0-31, pins being a mask of them
+
+    The control signal has to be held for 150 cycles either side of clocking
+    it into the pins, see section 6.1 of the ARM peripherals manual. That's
+    far too short to be worth yielding for, so it's timed on the system timer
+    rather than by a counted loop whose speed depends on the ARM clock and
+    the caches. The timer only counts whole microseconds, so each hold waits
+    for two ticks to be sure of at least one, and the whole call takes 2 to
+    4us.
+*/
+void RPI_SetGpioPull( uint32_t pins, rpi_gpio_pull_t pull )
+{
+    rpiGpio->GPPUD = pull;
+    RPI_WaitMicroSeconds( 2 );
+    rpiGpio->GPPUDCLK0 = pins;
+    RPI_WaitMicroSeconds( 2 );
+    rpiGpio->GPPUD = RPI_GPIO_PULL_OFF;
+    rpiGpio->GPPUDCLK0 = 0;
+}
@@ -198,6 +198,14 @@ typedef enum {
     } rpi_gpio_value_t;
 
 
+/** @brief Pull-up/down control, the values written to GPPUD */
+typedef enum {
+    RPI_GPIO_PULL_OFF = 0,
+    RPI_GPIO_PULL_DOWN,
+    RPI_GPIO_PULL_UP,
+    } rpi_gpio_pull_t;
+
+
 extern rpi_gpio_t* RPI_GetGpio(void);
 extern void RPI_SetGpioPinFunction( rpi_gpio_pin_t gpio, rpi_gpio_alt_function_t func );
 extern void RPI_SetGpioOutput( rpi_gpio_pin_t gpio );
@@ -207,5 +215,6 @@ extern void RPI_SetGpioHi( rpi_gpio_pin_t gpio );
 extern void RPI_SetGpioLo( rpi_gpio_pin_t gpio );
 extern void RPI_SetGpioValue( rpi_gpio_pin_t gpio, rpi_gpio_value_t value );
 extern void RPI_ToggleGpio( rpi_gpio_pin_t gpio );
+extern void RPI_SetGpioPull( uint32_t pins, rpi_gpio_pull_t pull );
 
 #endif
@@ -1,8 +1,11 @@
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
-#include "armtimer.h"
+#include "arch/pmu.h"
+#include "kernel/trace.h"
+
 #include "base.h"
 #include "gpio.h"
 #include "interrupts.h"
@@ -11,7 +14,29 @@
 static rpi_irq_controller_t* rpiIRQController =
         (rpi_irq_controller_t*)RPI_INTERRUPT_CONTROLLER_BASE;
 
-volatile int calculate_frame_count = 0;
+/** @brief A registered interrupt handler and its statistics */
+typedef struct {
+    rpi_irq_handler_t handler;
+    void* param;
+    rpi_irq_stats_t stats;
+    } rpi_irq_vector_t;
+
+static rpi_irq_vector_t vectors[RPI_IRQ_COUNT];
+
+/** @brief Shadow of the enabled interrupts in each of the pending registers,
+    so that sources we haven't enabled are never dispatched */
+static uint32_t enabled_basic;
+static uint32_t enabled_1;
+static uint32_t enabled_2;
+
+static uint32_t spurious;
+
+/** @brief Address of the instruction the current IRQ interrupted */
+static uint32_t interrupted_pc;
+
+/* Set while interrupt_vector() is running the handlers */
+static volatile int irq_active = 0;
+
 
 /**
     @brief Return the IRQ Controller register set
@@ -22,6 +47,178 @@ rpi_irq_controller_t* RPI_GetIrqController( void )
 }
 
 
+/**
+    @brief Disable every interrupt source and clear the vector table
+
+    Handler times come from the PMU cycle counter, so pmu_init() must have
+    been called for the statistics to mean anything
+*/
+void RPI_IrqInit( void )
+{
+    int irq;
+
+    rpiIRQController->Disable_IRQs_1 = 0xFFFFFFFF;
+    rpiIRQController->Disable_IRQs_2 = 0xFFFFFFFF;
+    rpiIRQController->Disable_Basic_IRQs = 0xFFFFFFFF;
+
+    enabled_basic = 0;
+    enabled_1 = 0;
+    enabled_2 = 0;
+    spurious = 0;
+
+    for( irq = 0; irq < RPI_IRQ_COUNT; irq++ )
+    {
+        vectors[irq].handler = NULL;
+        vectors[irq].param = NULL;
+        vectors[irq].stats.count = 0;
+        vectors[irq].stats.cycles_max = 0;
+        vectors[irq].stats.cycles_total = 0;
+    }
+}
+
+
+/**
+    @brief Install the handler for an interrupt source. The source still has
+    to be enabled with RPI_IrqEnable()
+*/
+void RPI_IrqRegister( rpi_irq_t irq, rpi_irq_handler_t handler, void* param )
+{
+    if( irq >= RPI_IRQ_COUNT )
+        return;
+
+    vectors[irq].param = param;
+    vectors[irq].handler = handler;
+}
+
+
+void RPI_IrqEnable( rpi_irq_t irq )
+{
+    if( irq < 32 )
+    {
+        enabled_1 |= ( 1u << irq );
+        rpiIRQController->Enable_IRQs_1 = ( 1u << irq );
+    }
+    else if( irq < 64 )
+    {
+        enabled_2 |= ( 1u << ( irq - 32 ) );
+        rpiIRQController->Enable_IRQs_2 = ( 1u << ( irq - 32 ) );
+    }
+    else if( irq < RPI_IRQ_COUNT )
+    {
+        enabled_basic |= ( 1u << ( irq - 64 ) );
+        rpiIRQController->Enable_Basic_IRQs = ( 1u << ( irq - 64 ) );
+    }
+}
+
+
+void RPI_IrqDisable( rpi_irq_t irq )
+{
+    if( irq < 32 )
+    {
+        rpiIRQController->Disable_IRQs_1 = ( 1u << irq );
+        enabled_1 &= ~( 1u << irq );
+    }
+    else if( irq < 64 )
+    {
+        rpiIRQController->Disable_IRQs_2 = ( 1u << ( irq - 32 ) );
+        enabled_2 &= ~( 1u << ( irq - 32 ) );
+    }
+    else if( irq < RPI_IRQ_COUNT )
+    {
+        rpiIRQController->Disable_Basic_IRQs = ( 1u << ( irq - 64 ) );
+        enabled_basic &= ~( 1u << ( irq - 64 ) );
+    }
+}
+
+
+const rpi_irq_stats_t* RPI_IrqGetStats( rpi_irq_t irq )
+{
+    if( irq >= RPI_IRQ_COUNT )
+        return NULL;
+
+    return &vectors[irq].stats;
+}
+
+
+/**
+    @brief Number of times an enabled source was pending with no handler. The
+    source is disabled when this happens so it can't lock the CPU up
+*/
+uint32_t RPI_IrqGetSpuriousCount( void )
+{
+    return spurious;
+}
+
+
+/**
+    @brief Address of the instruction the IRQ being serviced interrupted,
+    only meaningful when called from an IRQ handler
+*/
+uint32_t RPI_IrqGetInterruptedPc( void )
+{
+    return interrupted_pc;
+}
+
+
+/**
+    @brief Non-zero when called from an IRQ handler. Handlers run on the
+    interrupted code's stack in SVC mode, so the CPSR mode can't tell
+*/
+int RPI_IrqActive( void )
+{
+    return irq_active;
+}
+
+
+/**
+    @brief Run the handler for one pending interrupt source and account for
+    the time it took
+*/
+static inline void dispatch( int irq )
+{
+    rpi_irq_vector_t* vector = &vectors[irq];
+    uint32_t start, cycles;
+
+    if( vector->handler == NULL )
+    {
+        RPI_IrqDisable( irq );
+        spurious++;
+        return;
+    }
+
+    TRACE( TRACE_IRQ_HANDLER_BEGIN, irq, 0 );
+
+    start = pmu_cycles();
+    vector->handler( vector->param );
+    cycles = pmu_cycles() - start;
+
+    TRACE( TRACE_IRQ_HANDLER_END, irq, 0 );
+
+    vector->stats.count++;
+    vector->stats.cycles_total += cycles;
+    if( cycles > vector->stats.cycles_max )
+        vector->stats.cycles_max = cycles;
+}
+
+
+/**
+    @brief Dispatch every set bit in a pending register, highest first. Each
+    iteration finds the next source with a single CLZ so the cost only
+    depends on the number of pending sources
+*/
+static inline void dispatch_pending( uint32_t pending, int base )
+{
+    int bit;
+
+    while( pending )
+    {
+        bit = 31 - __builtin_clz( pending );
+        pending &= ~( 1u << bit );
+        dispatch( base + bit );
+    }
+}
+
+
 /**
     @brief The Reset vector interrupt handler
 
@@ -102,47 +299,32 @@ void __attribute__((interrupt("ABORT"))) data_abort_vector(void)
 /**
     @brief The IRQ Interrupt handler
 
-    This handler is run every time an interrupt source is triggered. It's
-    up to the handler to determine the source of the interrupt and most
-    importantly clear the interrupt flag so that the interrupt won't
-    immediately put us back into the start of the handler again.
+    This handler is run every time an interrupt source is triggered. The
+    pending registers are scanned and the registered handler for every
+    pending source is called. It's up to each handler to clear its interrupt
+    flag so that the interrupt won't immediately put us back into the start
+    of the handler again.
+
+    The registers are saved by _irq_entry in start.S, which passes in the
+    address of the instruction that was interrupted and calls
+    thread_preempt() once this returns.
 */
-void __attribute__((interrupt("IRQ"))) interrupt_vector(void)
+void interrupt_vector( uint32_t pc )
 {
-    static int lit = 0;
-    static int ticks = 0;
-    static int seconds = 0;
+    uint32_t basic = rpiIRQController->IRQ_basic_pending;
 
-    /* Clear the ARM Timer interrupt - it's the only interrupt we have
-       enabled, so we want don't have to work out which interrupt source
-       caused us to interrupt */
-    RPI_GetArmTimer()->IRQClear = 1;
+    interrupted_pc = pc;
+    irq_active = 1;
 
-    ticks++;
-    if( ticks > 1 )
-    {
-        ticks = 0;
-
-        /* Calculate the FPS once a minute */
-        seconds++;
-        if( seconds > 59 )
-        {
-            seconds = 0;
-            calculate_frame_count = 1;
-        }
-    }
+    dispatch_pending( basic & enabled_basic, RPI_IRQ_ARM_TIMER );
 
-    /* Flip the LED */
-    if( lit )
-    {
-        LED_OFF();
-        lit = 0;
-    }
-    else
-    {
-        LED_ON();
-        lit = 1;
-    }
+    if( basic & ( RPI_BASIC_PENDING_1 | RPI_BASIC_SHORTCUTS_1 ) )
+        dispatch_pending( rpiIRQController->IRQ_pending_1 & enabled_1, 0 );
+
+    if( basic & ( RPI_BASIC_PENDING_2 | RPI_BASIC_SHORTCUTS_2 ) )
+        dispatch_pending( rpiIRQController->IRQ_pending_2 & enabled_2, 32 );
+
+    irq_active = 0;
 }
 
 
@@ -52,6 +52,64 @@
 #define RPI_BASIC_ACCESS_ERROR_1_IRQ    (1 << 6)
 #define RPI_BASIC_ACCESS_ERROR_0_IRQ    (1 << 7)
 
+/** @brief Bits in the IRQ_basic_pending register that say there is more to
+    look at in IRQ_pending_1 and IRQ_pending_2 */
+#define RPI_BASIC_PENDING_1             (1 << 8)
+#define RPI_BASIC_PENDING_2             (1 << 9)
+
+/** @brief A handful of GPU interrupts are also routed directly into
+    IRQ_basic_pending bits 10-20, and when they are they do NOT set the
+    RPI_BASIC_PENDING_x summary bits. IRQs 7, 9, 10, 18 and 19 are in bank 1
+    and 53-57 and 62 in bank 2 */
+#define RPI_BASIC_SHORTCUTS_1           (0x1F << 10)
+#define RPI_BASIC_SHORTCUTS_2           (0x3F << 15)
+
+/** @brief Interrupt numbers used by the dispatcher. 0-63 are the GPU
+    interrupts in IRQ_pending_1/2 and 64-71 are the ARM interrupts in
+    IRQ_basic_pending. See the BCM2835 ARM Peripherals manual, section 7.5 */
+typedef enum {
+    RPI_IRQ_SYSTIMER_0 = 0,
+    RPI_IRQ_SYSTIMER_1 = 1,
+    RPI_IRQ_SYSTIMER_2 = 2,
+    RPI_IRQ_SYSTIMER_3 = 3,
+    RPI_IRQ_USB = 9,
+    RPI_IRQ_DMA_0 = 16,
+    RPI_IRQ_AUX = 29,
+    RPI_IRQ_I2C_SPI_SLAVE = 43,
+    RPI_IRQ_PWA0 = 45,
+    RPI_IRQ_PWA1 = 46,
+    RPI_IRQ_SMI = 48,
+    RPI_IRQ_GPIO_0 = 49,
+    RPI_IRQ_GPIO_1 = 50,
+    RPI_IRQ_GPIO_2 = 51,
+    RPI_IRQ_GPIO_3 = 52,
+    RPI_IRQ_I2C = 53,
+    RPI_IRQ_SPI = 54,
+    RPI_IRQ_PCM = 55,
+    RPI_IRQ_UART = 57,
+
+    RPI_IRQ_ARM_TIMER = 64,
+    RPI_IRQ_ARM_MAILBOX = 65,
+    RPI_IRQ_ARM_DOORBELL_0 = 66,
+    RPI_IRQ_ARM_DOORBELL_1 = 67,
+    RPI_IRQ_GPU_0_HALTED = 68,
+    RPI_IRQ_GPU_1_HALTED = 69,
+    RPI_IRQ_ACCESS_ERROR_1 = 70,
+    RPI_IRQ_ACCESS_ERROR_0 = 71,
+
+    RPI_IRQ_COUNT = 72,
+    } rpi_irq_t;
+
+/** @brief An interrupt handler, param is whatever was registered with it */
+typedef void (*rpi_irq_handler_t)( void* param );
+
+/** @brief Per interrupt statistics kept by the dispatcher */
+typedef struct {
+    uint32_t count;             /**< Times the handler has run */
+    uint32_t cycles_max;        /**< Longest time spent in the handler */
+    uint64_t cycles_total;      /**< Total time spent in the handler */
+    } rpi_irq_stats_t;
+
 
 /** @brief The interrupt controller memory mapped register set */
 typedef struct {
@@ -67,10 +125,39 @@ typedef struct {
     volatile uint32_t Disable_Basic_IRQs;
     } rpi_irq_controller_t;
 
-extern volatile int calculate_frame_count;
-
 /* Found in the *start.S file, implemented in assembler */
 extern void _enable_interrupts( void );
 extern rpi_irq_controller_t* RPI_GetIrqController( void );
 
+extern void RPI_IrqInit( void );
+extern void RPI_IrqRegister( rpi_irq_t irq, rpi_irq_handler_t handler, void* param );
+extern void RPI_IrqEnable( rpi_irq_t irq );
+extern void RPI_IrqDisable( rpi_irq_t irq );
+extern const rpi_irq_stats_t* RPI_IrqGetStats( rpi_irq_t irq );
+extern uint32_t RPI_IrqGetSpuriousCount( void );
+extern uint32_t RPI_IrqGetInterruptedPc( void );
+extern int RPI_IrqActive( void );
+
+/** @brief Non-zero if IRQs are currently masked on this core */
+static inline int RPI_InterruptsMasked( void )
+{
+    uint32_t cpsr;
+    __asm__ __volatile__( "mrs %0, cpsr" : "=r" (cpsr) );
+    return ( cpsr & 0x80 ) != 0;
+}
+
+/** @brief Mask IRQs on this core, returning the previous state for
+    RPI_InterruptsRestore() */
+static inline uint32_t RPI_InterruptsSave( void )
+{
+    uint32_t cpsr;
+    __asm__ __volatile__( "mrs %0, cpsr\n\tcpsid i" : "=r" (cpsr) :: "memory" );
+    return cpsr;
+}
+
+static inline void RPI_InterruptsRestore( uint32_t cpsr )
+{
+    __asm__ __volatile__( "msr cpsr_c, %0" :: "r" (cpsr) : "memory" );
+}
+
 #endif
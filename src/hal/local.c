@@ -0,0 +1,16 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include "local.h"
+
+static rpi_local_t* rpiLocal = (rpi_local_t*)RPI_LOCAL_BASE;
+
+
+rpi_local_t* RPI_GetLocal( void )
+{
+    return rpiLocal;
+}
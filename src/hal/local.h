@@ -0,0 +1,58 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef RPI_LOCAL_H
+#define RPI_LOCAL_H
+
+#include <stdint.h>
+
+#include "base.h"
+
+/** @brief The BCM2836 per-core peripherals (core timers, mailboxes and
+    interrupt routing). See the BCM2836 ARM-local peripherals document, these
+    sit just above the BCM2835 peripherals in the ARM address space */
+#define RPI_LOCAL_BASE              0x40000000UL
+
+#define RPI_LOCAL_CORES             4
+#define RPI_LOCAL_MAILBOXES         4
+
+/** @brief The firmware parks the secondary cores waiting for an entry
+    address in this mailbox */
+#define RPI_LOCAL_MAILBOX_WAKE      3
+
+typedef struct {
+    rpi_reg_rw_t control;
+    rpi_reg_ro_t reserved0;
+    rpi_reg_rw_t core_timer_prescaler;
+    rpi_reg_rw_t gpu_irq_routing;
+    rpi_reg_wo_t pmu_irq_routing_set;
+    rpi_reg_wo_t pmu_irq_routing_clear;
+    rpi_reg_ro_t reserved1;
+    rpi_reg_rw_t core_timer_lo;
+    rpi_reg_rw_t core_timer_hi;
+    rpi_reg_rw_t local_irq_routing;
+    rpi_reg_ro_t reserved2;
+    rpi_reg_rw_t axi_counters;
+    rpi_reg_rw_t axi_irq;
+    rpi_reg_rw_t local_timer_control;
+    rpi_reg_wo_t local_timer_clear;
+    rpi_reg_ro_t reserved3;
+    rpi_reg_rw_t timer_irq_control[RPI_LOCAL_CORES];
+    rpi_reg_rw_t mailbox_irq_control[RPI_LOCAL_CORES];
+    rpi_reg_ro_t irq_source[RPI_LOCAL_CORES];
+    rpi_reg_ro_t fiq_source[RPI_LOCAL_CORES];
+
+    /** Writing sets bits in a core's mailbox */
+    rpi_reg_wo_t mailbox_set[RPI_LOCAL_CORES][RPI_LOCAL_MAILBOXES];
+
+    /** Reading returns a core's mailbox, writing clears bits in it */
+    rpi_reg_rw_t mailbox_clear[RPI_LOCAL_CORES][RPI_LOCAL_MAILBOXES];
+    } rpi_local_t;
+
+extern rpi_local_t* RPI_GetLocal( void );
+
+#endif
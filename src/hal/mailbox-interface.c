@@ -28,22 +28,74 @@
 
 */
 
-#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "arch/cache.h"
+#include "kernel/profile.h"
+
+#include "base.h"
 #include "mailbox.h"
 #include "mailbox-interface.h"
+#include "systimer.h"
+
+PROFILE_MARKER( property_process_marker, "RPI_PropertyProcess" );
 
 /* Make sure the property tag buffer is aligned to a 16-byte boundary because
    we only have 28-bits available in the property interface protocol to pass
-   the address of the buffer to the VC. */
-static int pt[8192] __attribute__((aligned(16)));
-static int pt_index = 0;
+   the address of the buffer to the VC. It is actually aligned to a cache line
+   so the buffer can be invalidated without touching its neighbours. */
+static uint32_t pt[8192] __attribute__((aligned(CACHE_LINE_SIZE)));
 
+/* The buffer behind RPI_PropertyInit() and friends */
+static rpi_property_t default_property;
+static int default_ready = 0;
 
-void RPI_PropertyInit( void )
+/* Handed out when a tag doesn't fit, whatever is written here is thrown
+   away */
+static uint32_t pt_scratch[( sizeof( rpi_tag_block_t ) + 3 ) / 4];
+
+static rpi_property_stats_t stats;
+
+/* A small buffer of its own for the clock helpers, so drivers can ask about
+   their clocks without disturbing whatever is in the default buffer */
+static uint32_t clock_pt[32] __attribute__((aligned(CACHE_LINE_SIZE)));
+static rpi_property_t clock_property;
+static int clock_ready = 0;
+
+
+/**
+    @brief First index slot to try for a tag. The tag ids are sparse so
+    spread them with a multiplicative hash
+*/
+static inline uint32_t index_hash( uint32_t tag )
+{
+    return ( tag * 0x9E3779B1 ) >> 27;
+}
+
+
+/**
+    @brief Set up a property buffer over storage of words 32-bit words, which
+    must be aligned to CACHE_LINE_SIZE and a multiple of it in size
+*/
+void RPI_PropertyBufferInit( rpi_property_t* property, uint32_t* buffer, uint32_t words )
 {
+    memset( property, 0, sizeof( *property ) );
+    property->buffer = buffer;
+    property->words = words;
+
+    RPI_PropertyBufferReset( property );
+}
+
+
+/**
+    @brief Start a new, empty tag list. The buffer must not be in flight
+*/
+void RPI_PropertyBufferReset( rpi_property_t* property )
+{
+    uint32_t* pt = property->buffer;
+
     /* Fill in the size on-the-fly */
     pt[PT_OSIZE] = 12;
 
@@ -51,202 +103,339 @@ void RPI_PropertyInit( void )
     pt[PT_OREQUEST_OR_RESPONSE] = 0;
 
     /* First available data slot */
-    pt_index = 2;
+    property->index = 2;
 
     /* NULL tag to terminate tag list */
-    pt[pt_index] = 0;
+    pt[property->index] = 0;
+
+    /* Forget every tag in the index. On the rare wrap of the generation
+       the stale slots really do have to be cleared */
+    if( ++property->generation == 0 )
+    {
+        memset( property->tags, 0, sizeof( property->tags ) );
+        property->generation = 1;
+    }
+
+    property->tag_count = 0;
+    property->overflow = 0;
 }
 
+
 /**
-    @brief Add a property tag to the current tag list. Data can be included. All data is uint32_t
-    @param tag
-*/
-void RPI_PropertyAddTag( rpi_mailbox_tag_t tag, ... )
-{
-    va_list vl;
-    va_start( vl, tag );
+    @brief Add a property tag to a buffer's tag list
 
-    pt[pt_index++] = tag;
+    Space for a value of value_size bytes is reserved and zeroed, the caller
+    fills in any request data through the returned pointer. It's easier to
+    use RPI_PROPERTY_BUFFER_ADD() which takes care of the size and the type.
 
-    switch( tag )
+    @return The tag in the buffer. If the buffer is full this is scratch
+            space instead and submitting the buffer will fail, so the return
+            value never needs checking
+*/
+void* RPI_PropertyBufferAdd( rpi_property_t* property, rpi_mailbox_tag_t tag, uint32_t value_size )
+{
+    uint32_t words = ( value_size + 3 ) >> 2;
+    uint32_t slot = index_hash( tag );
+    rpi_property_index_t* tags = property->tags;
+    uint32_t* tag_buffer;
+    uint32_t i;
+
+    /* Room for the header, the value and the terminating NULL tag */
+    if( ( property->tag_count >= RPI_PROPERTY_MAX_TAGS ) ||
+        ( ( property->index + T_OVALUE + words + 1 ) > property->words ) ||
+        ( words > ( sizeof( rpi_tag_block_t ) - sizeof( rpi_tag_header_t ) ) / 4 ) )
     {
-        case TAG_GET_FIRMWARE_VERSION:
-        case TAG_GET_BOARD_MODEL:
-        case TAG_GET_BOARD_REVISION:
-        case TAG_GET_BOARD_MAC_ADDRESS:
-        case TAG_GET_BOARD_SERIAL:
-        case TAG_GET_ARM_MEMORY:
-        case TAG_GET_VC_MEMORY:
-        case TAG_GET_DMA_CHANNELS:
-            /* Provide an 8-byte buffer for the response */
-            pt[pt_index++] = 8;
-            pt[pt_index++] = 0; /* Request */
-            pt_index += 2;
-            break;
-
-        case TAG_GET_CLOCKS:
-        case TAG_GET_COMMAND_LINE:
-            /* Provide a 256-byte buffer */
-            pt[pt_index++] = 256;
-            pt[pt_index++] = 0; /* Request */
-            pt_index += 256 >> 2;
-            break;
-
-        case TAG_ALLOCATE_BUFFER:
-        case TAG_GET_MAX_CLOCK_RATE:
-        case TAG_GET_MIN_CLOCK_RATE:
-        case TAG_GET_CLOCK_RATE:
-            pt[pt_index++] = 8;
-            pt[pt_index++] = 0; /* Request */
-            pt[pt_index++] = va_arg( vl, int );
-            pt[pt_index++] = 0;
-            break;
-
-        case TAG_SET_CLOCK_RATE:
-            pt[pt_index++] = 12;
-            pt[pt_index++] = 0; /* Request */
-            pt[pt_index++] = va_arg( vl, int ); /* Clock ID */
-            pt[pt_index++] = va_arg( vl, int ); /* Rate (in Hz) */
-            pt[pt_index++] = va_arg( vl, int ); /* Skip turbo setting if == 1 */
-            break;
-
-        case TAG_GET_PHYSICAL_SIZE:
-        case TAG_SET_PHYSICAL_SIZE:
-        case TAG_TEST_PHYSICAL_SIZE:
-        case TAG_GET_VIRTUAL_SIZE:
-        case TAG_SET_VIRTUAL_SIZE:
-        case TAG_TEST_VIRTUAL_SIZE:
-        case TAG_GET_VIRTUAL_OFFSET:
-        case TAG_SET_VIRTUAL_OFFSET:
-            pt[pt_index++] = 8;
-            pt[pt_index++] = 0; /* Request */
-
-            if( ( tag == TAG_SET_PHYSICAL_SIZE ) ||
-                ( tag == TAG_SET_VIRTUAL_SIZE ) ||
-                ( tag == TAG_SET_VIRTUAL_OFFSET ) ||
-                ( tag == TAG_TEST_PHYSICAL_SIZE ) ||
-                ( tag == TAG_TEST_VIRTUAL_SIZE ) )
-            {
-                pt[pt_index++] = va_arg( vl, int ); /* Width */
-                pt[pt_index++] = va_arg( vl, int ); /* Height */
-            }
-            else
-            {
-                pt_index += 2;
-            }
-            break;
-
-        case TAG_GET_ALPHA_MODE:
-        case TAG_SET_ALPHA_MODE:
-        case TAG_GET_DEPTH:
-        case TAG_SET_DEPTH:
-        case TAG_GET_PIXEL_ORDER:
-        case TAG_SET_PIXEL_ORDER:
-        case TAG_GET_PITCH:
-            pt[pt_index++] = 4;
-            pt[pt_index++] = 0; /* Request */
-
-            if( ( tag == TAG_SET_DEPTH ) ||
-                ( tag == TAG_SET_PIXEL_ORDER ) ||
-                ( tag == TAG_SET_ALPHA_MODE ) )
-            {
-                /* Colour Depth, bits-per-pixel \ Pixel Order State */
-                pt[pt_index++] = va_arg( vl, int );
-            }
-            else
-            {
-                pt_index += 1;
-            }
-            break;
-
-        case TAG_GET_OVERSCAN:
-        case TAG_SET_OVERSCAN:
-            pt[pt_index++] = 16;
-            pt[pt_index++] = 0; /* Request */
-
-            if( ( tag == TAG_SET_OVERSCAN ) )
-            {
-                pt[pt_index++] = va_arg( vl, int ); /* Top pixels */
-                pt[pt_index++] = va_arg( vl, int ); /* Bottom pixels */
-                pt[pt_index++] = va_arg( vl, int ); /* Left pixels */
-                pt[pt_index++] = va_arg( vl, int ); /* Right pixels */
-            }
-            else
-            {
-                pt_index += 4;
-            }
-            break;
-
-        default:
-            /* Unsupported tags, just remove the tag from the list */
-            pt_index--;
-            break;
+        property->overflow = 1;
+        memset( pt_scratch, 0, sizeof( pt_scratch ) );
+        return pt_scratch;
     }
 
-    /* Make sure the tags are 0 terminated to end the list and update the buffer size */
-    pt[pt_index] = 0;
+    tag_buffer = &property->buffer[property->index];
+    tag_buffer[T_OIDENT] = tag;
+    tag_buffer[T_OVALUE_SIZE] = words << 2;
+    tag_buffer[T_ORESPONSE] = 0; /* Request */
+
+    for( i = 0; i < words; i++ )
+        tag_buffer[T_OVALUE + i] = 0;
+
+    /* Find the tag's slot, or the first free one. Adding a tag twice
+       leaves the index pointing at the later copy */
+    while( ( tags[slot].generation == property->generation ) && ( tags[slot].tag != tag ) )
+        slot = ( slot + 1 ) & ( RPI_PROPERTY_INDEX_SIZE - 1 );
+
+    tags[slot].tag = tag;
+    tags[slot].offset = property->index;
+    tags[slot].generation = property->generation;
+    property->tag_count++;
 
-    va_end( vl );
+    property->index += T_OVALUE + words;
+
+    /* Make sure the tags are 0 terminated to end the list */
+    property->buffer[property->index] = 0;
+
+    return tag_buffer;
 }
 
 
-int RPI_PropertyProcess( void )
+/**
+    @brief Mailbox completion, runs in the mailbox interrupt
+*/
+static void property_complete( rpi_mailbox_request_t* request )
 {
-    int result;
+    rpi_property_t* property = request->param;
+    uint32_t elapsed = RPI_GetSystemTimer()->counter_lo - property->start;
+#if( PRINT_PROP_DEBUG == 1 )
+    int i;
+#endif
+
+    /* Drop the stale cached copy now the response is in memory */
+    cache_invalidate_range( property->buffer, property->buffer[PT_OSIZE] );
+
+    stats.round_trips++;
+    stats.total_us += elapsed;
+    if( elapsed > stats.max_us )
+        stats.max_us = elapsed;
+
+#if( PRINT_PROP_DEBUG == 1 )
+    for( i = 0; i < (property->buffer[PT_OSIZE] >> 2); i++ )
+        printf( "Response: %3d %8.8X\r\n", i, property->buffer[i] );
+#endif
+
+    property->busy = 0;
+
+    if( property->callback )
+        property->callback( property );
+}
+
+
+/**
+    @brief Send a buffer to the firmware and return without waiting
+
+    callback, if not NULL, is called from the mailbox interrupt once the
+    firmware has answered. The buffer must not be touched until then, use
+    RPI_PropertyBufferDone() or RPI_PropertyBufferWait() to find out when.
+
+    @return 0 if the buffer was sent, -1 if a tag didn't fit
+*/
+int RPI_PropertyBufferSubmit( rpi_property_t* property, rpi_property_callback_t callback, void* param )
+{
+    uint32_t* pt = property->buffer;
+    int size;
+#if( PRINT_PROP_DEBUG == 1 )
+    int i;
+#endif
+
+    /* A tag didn't fit, the firmware would only see part of the request */
+    if( property->overflow )
+        return -1;
 
 #if( PRINT_PROP_DEBUG == 1 )
     printf( "%s Length: %d\r\n", __func__, pt[PT_OSIZE] );
 #endif
     /* Fill in the size of the buffer */
-    pt[PT_OSIZE] = ( pt_index + 1 ) << 2;
+    size = ( property->index + 1 ) << 2;
+    pt[PT_OSIZE] = size;
     pt[PT_OREQUEST_OR_RESPONSE] = 0;
 
 #if( PRINT_PROP_DEBUG == 1 )
     for( i = 0; i < (pt[PT_OSIZE] >> 2); i++ )
         printf( "Request: %3d %8.8X\r\n", i, pt[i] );
 #endif
-    RPI_Mailbox0Write( MB0_TAGS_ARM_TO_VC, (unsigned int)pt );
+    /* The VideoCore reads the buffer from memory and writes the response
+       back there, so push the request out of the data cache. The completion
+       drops the stale copy once the response is in */
+    cache_clean_invalidate_range( pt, size );
 
-    result = RPI_Mailbox0Read( MB0_TAGS_ARM_TO_VC );
+    property->callback = callback;
+    property->param = param;
+    property->busy = 1;
 
-#if( PRINT_PROP_DEBUG == 1 )
-    for( i = 0; i < (pt[PT_OSIZE] >> 2); i++ )
-        printf( "Response: %3d %8.8X\r\n", i, pt[i] );
-#endif
-    return result;
+    property->request.channel = MB0_TAGS_ARM_TO_VC;
+    property->request.value = RPI_PHYS_TO_BUS( pt );
+    property->request.callback = property_complete;
+    property->request.param = property;
+
+    property->start = RPI_GetSystemTimer()->counter_lo;
+    RPI_MailboxSubmit( &property->request );
+
+    return 0;
 }
 
 
-rpi_mailbox_property_t* RPI_PropertyGet( rpi_mailbox_tag_t tag )
+/**
+    @brief Wait for a submitted buffer to be answered
+
+    @return The mailbox response, as RPI_PropertyBufferProcess()
+*/
+int RPI_PropertyBufferWait( rpi_property_t* property )
 {
-    static rpi_mailbox_property_t property;
-    int* tag_buffer = NULL;
+    RPI_MailboxWait( &property->request );
+
+    return property->request.response;
+}
 
-    property.tag = tag;
 
-    /* Get the tag from the buffer. Start at the first tag position  */
-    int index = 2;
+/**
+    @brief Send a buffer to the firmware and wait for the answer
+
+    @return The mailbox response, -1 if a tag didn't fit
+*/
+int RPI_PropertyBufferProcess( rpi_property_t* property )
+{
+    int result;
+
+    PROFILE_BEGIN( property_process_marker );
 
-    while( index < ( pt[PT_OSIZE] >> 2 ) )
+    result = RPI_PropertyBufferSubmit( property, NULL, NULL );
+    if( result == 0 )
+        result = RPI_PropertyBufferWait( property );
+
+    PROFILE_END( property_process_marker );
+
+    return result;
+}
+
+
+/**
+    @brief Find the response to a tag in a buffer
+
+    It's easier to use RPI_PROPERTY_BUFFER_GET() which casts to the tag's
+    type.
+
+    @return The tag in the buffer, NULL if it was never added, if the
+            firmware did not recognise it or if the buffer is still in flight
+*/
+void* RPI_PropertyBufferGet( rpi_property_t* property, rpi_mailbox_tag_t tag )
+{
+    uint32_t slot = index_hash( tag );
+    rpi_property_index_t* tags = property->tags;
+    uint32_t* tag_buffer;
+
+    if( property->busy )
+        return NULL;
+
+    while( tags[slot].generation == property->generation )
     {
-        /* printf( "Test Tag: [%d] %8.8X\r\n", index, pt[index] ); */
-        if( pt[index] == tag )
+        if( tags[slot].tag == tag )
         {
-            tag_buffer = &pt[index];
-            break;
+            tag_buffer = &property->buffer[tags[slot].offset];
+
+            if( ( tag_buffer[T_ORESPONSE] & TAG_RESPONSE_BIT ) == 0 )
+                return NULL;
+
+            return tag_buffer;
         }
 
-        /* Progress to the next tag if we haven't yet discovered the tag */
-        index += ( pt[index + 1] >> 2 ) + 3;
+        slot = ( slot + 1 ) & ( RPI_PROPERTY_INDEX_SIZE - 1 );
     }
 
-    /* Return NULL of the property tag cannot be found in the buffer */
-    if( tag_buffer == NULL )
-        return NULL;
+    return NULL;
+}
 
-    /* Return the required data */
-    property.byte_length = tag_buffer[T_ORESPONSE] & 0xFFFF;
-    memcpy( property.data.buffer_8, &tag_buffer[T_OVALUE], property.byte_length );
 
-    return &property;
+void RPI_PropertyInit( void )
+{
+    if( !default_ready )
+    {
+        RPI_PropertyBufferInit( &default_property, pt, sizeof( pt ) / sizeof( pt[0] ) );
+        default_ready = 1;
+        return;
+    }
+
+    RPI_PropertyBufferReset( &default_property );
+}
+
+
+/**
+    @brief Add a property tag to the current tag list, see
+    RPI_PropertyBufferAdd()
+*/
+void* RPI_PropertyAdd( rpi_mailbox_tag_t tag, uint32_t value_size )
+{
+    return RPI_PropertyBufferAdd( &default_property, tag, value_size );
+}
+
+
+int RPI_PropertyProcess( void )
+{
+    return RPI_PropertyBufferProcess( &default_property );
+}
+
+
+/**
+    @brief Find the response to a tag in the buffer
+
+    It's easier to use RPI_PROPERTY_GET() which casts to the tag's type.
+
+    @return The tag in the buffer, NULL if it was never added or if the
+            firmware did not recognise it
+*/
+void* RPI_PropertyGet( rpi_mailbox_tag_t tag )
+{
+    return RPI_PropertyBufferGet( &default_property, tag );
+}
+
+
+const rpi_property_stats_t* RPI_PropertyGetStats( void )
+{
+    return &stats;
+}
+
+
+/**
+    @brief Ask the firmware for a clock's rate, or set it first if rate is
+    not 0
+*/
+static uint32_t clock_rate( rpi_tag_clock_id_t clock_id, uint32_t rate )
+{
+    rpi_tag_clock_t* clock;
+    rpi_tag_set_clock_t* set;
+
+    if( !clock_ready )
+    {
+        RPI_PropertyBufferInit( &clock_property, clock_pt, sizeof( clock_pt ) / sizeof( clock_pt[0] ) );
+        clock_ready = 1;
+    }
+    else
+    {
+        RPI_PropertyBufferReset( &clock_property );
+    }
+
+    if( rate )
+    {
+        set = RPI_PROPERTY_BUFFER_ADD( &clock_property, TAG_SET_CLOCK_RATE, rpi_tag_set_clock_t );
+        set->clock_id = clock_id;
+        set->rate = rate;
+        set->skip_turbo = 0;
+    }
+
+    clock = RPI_PROPERTY_BUFFER_ADD( &clock_property, TAG_GET_CLOCK_RATE, rpi_tag_clock_t );
+    clock->clock_id = clock_id;
+
+    RPI_PropertyBufferProcess( &clock_property );
+
+    if( ( clock = RPI_PROPERTY_BUFFER_GET( &clock_property, TAG_GET_CLOCK_RATE, rpi_tag_clock_t ) ) == NULL )
+        return 0;
+
+    return clock->rate;
+}
+
+
+/**
+    @brief The current rate of a clock in Hz, 0 if the firmware won't say
+*/
+uint32_t RPI_PropertyGetClockRate( rpi_tag_clock_id_t clock_id )
+{
+    return clock_rate( clock_id, 0 );
+}
+
+
+/**
+    @brief Ask for a clock to be run at a rate
+
+    @return The rate the firmware actually chose, 0 if it won't say
+*/
+uint32_t RPI_PropertySetClockRate( rpi_tag_clock_id_t clock_id, uint32_t rate )
+{
+    return clock_rate( clock_id, rate );
 }
@@ -31,6 +31,10 @@
 #ifndef RPI_MAILBOX_INTERFACE_H
 #define RPI_MAILBOX_INTERFACE_H
 
+#include <stdint.h>
+
+#include "mailbox.h"
+
 /**
     @brief An enum of the RPI->Videocore firmware mailbox property interface
     properties. Further details are available from
@@ -114,6 +118,7 @@ typedef enum {
     TAG_GET_PALETTE = 0x4000B,
     TAG_TEST_PALETTE = 0x4400B,
     TAG_SET_PALETTE = 0x4800B,
+    TAG_WAIT_FOR_VSYNC = 0x4000E,
     TAG_SET_CURSOR_INFO = 0x8011,
     TAG_SET_CURSOR_STATE = 0x8010
 
@@ -126,6 +131,10 @@ typedef enum {
     } rpi_tag_state_t;
 
 
+/** @brief Set by the firmware in the T_ORESPONSE word of every tag it has
+    processed. Tags the firmware does not understand are left untouched */
+#define TAG_RESPONSE_BIT    0x80000000
+
 typedef enum {
     PT_OSIZE = 0,
     PT_OREQUEST_OR_RESPONSE = 1,
@@ -138,16 +147,6 @@ typedef enum {
     T_OVALUE = 3,
     } rpi_tag_offset_t;
 
-typedef struct {
-    int tag;
-    int byte_length;
-    union {
-        int value_32;
-        unsigned char buffer_8[256];
-        int buffer_32[64];
-    } data;
-    } rpi_mailbox_property_t;
-
 typedef enum {
     TAG_CLOCK_RESERVED = 0,
     TAG_CLOCK_EMMC,
@@ -162,9 +161,197 @@ typedef enum {
     TAG_CLOCK_PWM,
     } rpi_tag_clock_id_t;
 
+/** @brief The most tags a single property buffer can hold */
+#define RPI_PROPERTY_MAX_TAGS       24
+
+/** @brief Size of the tag index, a power of two comfortably bigger than
+    RPI_PROPERTY_MAX_TAGS to keep the probe sequences short */
+#define RPI_PROPERTY_INDEX_SIZE     32
+
+/** @brief The three words at the start of every tag. value_size is the
+    space reserved for the value in bytes, response has TAG_RESPONSE_BIT set
+    by the firmware along with the length of the value it wrote */
+typedef struct {
+    uint32_t tag;
+    uint32_t value_size;
+    uint32_t response;
+    } rpi_tag_header_t;
+
+/* Typed views of a tag, used both to fill in the request and to read the
+   response in place. Request and response share the value buffer, so it is
+   sized for the larger of the two */
+
+/** @brief Any tag with a single word, in or out */
+typedef struct {
+    rpi_tag_header_t header;
+    uint32_t value;
+    } rpi_tag_u32_t;
+
+typedef struct {
+    rpi_tag_header_t header;
+    uint8_t mac[6];
+    uint8_t padding[2];
+    } rpi_tag_mac_t;
+
+typedef struct {
+    rpi_tag_header_t header;
+    uint32_t serial[2];
+    } rpi_tag_serial_t;
+
+/** @brief TAG_GET_ARM_MEMORY and TAG_GET_VC_MEMORY */
+typedef struct {
+    rpi_tag_header_t header;
+    uint32_t base;
+    uint32_t size;
+    } rpi_tag_memory_t;
+
+/** @brief Clock rate tags, other than TAG_SET_CLOCK_RATE */
+typedef struct {
+    rpi_tag_header_t header;
+    uint32_t clock_id;
+    uint32_t rate;
+    } rpi_tag_clock_t;
+
+typedef struct {
+    rpi_tag_header_t header;
+    uint32_t clock_id;
+    uint32_t rate;
+    uint32_t skip_turbo;
+    } rpi_tag_set_clock_t;
+
+/** @brief TAG_GET_TEMPERATURE and TAG_GET_MAX_TEMPERATURE, the value is in
+    thousandths of a degree C */
+typedef struct {
+    rpi_tag_header_t header;
+    uint32_t id;
+    uint32_t value;
+    } rpi_tag_temperature_t;
+
+/** @brief TAG_ALLOCATE_BUFFER, the alignment goes in base in the request */
+typedef struct {
+    rpi_tag_header_t header;
+    uint32_t base;
+    uint32_t size;
+    } rpi_tag_buffer_t;
+
+/** @brief Physical and virtual size tags */
+typedef struct {
+    rpi_tag_header_t header;
+    uint32_t width;
+    uint32_t height;
+    } rpi_tag_size_t;
+
+typedef struct {
+    rpi_tag_header_t header;
+    uint32_t x;
+    uint32_t y;
+    } rpi_tag_virtual_offset_t;
+
+typedef struct {
+    rpi_tag_header_t header;
+    uint32_t top;
+    uint32_t bottom;
+    uint32_t left;
+    uint32_t right;
+    } rpi_tag_overscan_t;
+
+/** @brief TAG_GET_CLOCKS and TAG_GET_COMMAND_LINE */
+typedef struct {
+    rpi_tag_header_t header;
+    uint8_t data[256];
+    } rpi_tag_block_t;
+
+/** @brief Round trips to the firmware and the time spent waiting on them,
+    measured with the system timer */
+typedef struct {
+    uint32_t round_trips;
+    uint32_t total_us;
+    uint32_t max_us;
+    } rpi_property_stats_t;
+
+/* Where each tag in a buffer starts, so a response can be found without
+   walking the buffer. Slots from an earlier tag list are recognised by their
+   generation, which saves clearing the index on every reset */
+typedef struct {
+    uint32_t tag;
+    uint16_t offset;
+    uint16_t generation;
+    } rpi_property_index_t;
+
+struct rpi_property;
+
+/** @brief Called from the mailbox interrupt once the firmware has answered,
+    the responses can be read in place */
+typedef void (*rpi_property_callback_t)( struct rpi_property* property );
+
+/** @brief A property tag buffer and the mailbox request that carries it.
+    Each buffer can be in flight independently of the others */
+typedef struct rpi_property {
+    /** Cache line aligned storage shared with the VideoCore */
+    uint32_t* buffer;
+    uint32_t words;
+
+    /** Next free word in the buffer */
+    uint32_t index;
+
+    rpi_property_index_t tags[RPI_PROPERTY_INDEX_SIZE];
+    uint16_t generation;
+    int tag_count;
+
+    /** Set when a tag didn't fit. The tag was given scratch space instead so
+        the caller can still fill it in, and the buffer is never sent */
+    int overflow;
+
+    /** Set between being submitted and the firmware answering */
+    volatile int busy;
+
+    uint32_t start;
+    rpi_mailbox_request_t request;
+    rpi_property_callback_t callback;
+    void* param;
+    } rpi_property_t;
+
+extern void RPI_PropertyBufferInit( rpi_property_t* property, uint32_t* buffer, uint32_t words );
+extern void RPI_PropertyBufferReset( rpi_property_t* property );
+extern void* RPI_PropertyBufferAdd( rpi_property_t* property, rpi_mailbox_tag_t tag, uint32_t value_size );
+extern int RPI_PropertyBufferSubmit( rpi_property_t* property, rpi_property_callback_t callback, void* param );
+extern int RPI_PropertyBufferWait( rpi_property_t* property );
+extern int RPI_PropertyBufferProcess( rpi_property_t* property );
+extern void* RPI_PropertyBufferGet( rpi_property_t* property, rpi_mailbox_tag_t tag );
+
+/** @brief Non-zero if the buffer is not waiting on the firmware */
+static inline int RPI_PropertyBufferDone( const rpi_property_t* property )
+{
+    return !property->busy;
+}
+
+/* The original interface, working on a single default buffer */
 extern void RPI_PropertyInit( void );
-extern void RPI_PropertyAddTag( rpi_mailbox_tag_t tag, ... );
+extern void* RPI_PropertyAdd( rpi_mailbox_tag_t tag, uint32_t value_size );
 extern int RPI_PropertyProcess( void );
-extern rpi_mailbox_property_t* RPI_PropertyGet( rpi_mailbox_tag_t tag );
+extern void* RPI_PropertyGet( rpi_mailbox_tag_t tag );
+extern const rpi_property_stats_t* RPI_PropertyGetStats( void );
+
+extern uint32_t RPI_PropertyGetClockRate( rpi_tag_clock_id_t clock_id );
+extern uint32_t RPI_PropertySetClockRate( rpi_tag_clock_id_t clock_id, uint32_t rate );
+
+/** @brief Add a tag to the buffer and return a typed view of it to fill in
+    the request. Never NULL, see RPI_PropertyAdd() */
+#define RPI_PROPERTY_ADD( tag, type ) \
+    ( (type*)RPI_PropertyAdd( tag, sizeof( type ) - sizeof( rpi_tag_header_t ) ) )
+
+/** @brief Find the response to a tag, NULL if the firmware didn't answer it.
+    The view points straight into the property buffer so stays valid until
+    the next RPI_PropertyInit() */
+#define RPI_PROPERTY_GET( tag, type ) \
+    ( (type*)RPI_PropertyGet( tag ) )
+
+/** @brief RPI_PROPERTY_ADD() for a buffer of your own */
+#define RPI_PROPERTY_BUFFER_ADD( property, tag, type ) \
+    ( (type*)RPI_PropertyBufferAdd( property, tag, sizeof( type ) - sizeof( rpi_tag_header_t ) ) )
+
+/** @brief RPI_PROPERTY_GET() for a buffer of your own */
+#define RPI_PROPERTY_BUFFER_GET( property, tag, type ) \
+    ( (type*)RPI_PropertyBufferGet( property, tag ) )
 
 #endif
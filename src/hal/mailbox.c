@@ -28,13 +28,35 @@
 
 */
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "kernel/profile.h"
+#include "kernel/trace.h"
+
 #include "gpio.h"
+#include "interrupts.h"
 #include "mailbox.h"
 
+PROFILE_MARKER( mailbox_write_wait_marker, "Mailbox0 write wait" );
+PROFILE_MARKER( mailbox_read_wait_marker, "Mailbox0 read wait" );
+
 /* Mailbox 0 mapped to it's base address */
 static mailbox_t* rpiMailbox0 = (mailbox_t*)RPI_MAILBOX0_BASE;
+static mailbox_t* rpiMailbox1 = (mailbox_t*)RPI_MAILBOX1_BASE;
+
+/* Asynchronous requests that have been written to the VideoCore, oldest
+   first for each channel */
+static rpi_mailbox_request_t* inflight_head[RPI_MAILBOX_CHANNELS];
+static rpi_mailbox_request_t* inflight_tail[RPI_MAILBOX_CHANNELS];
+
+/* Requests waiting for room in the VideoCore's mailbox */
+static rpi_mailbox_request_t* pending_head;
+static rpi_mailbox_request_t* pending_tail;
+
+/* Set once the mailbox interrupt completes requests, until then waiting
+   polls the mailbox instead */
+static int irq_driven = 0;
 
 void RPI_Mailbox0Write( mailbox0_channel_t channel, int value )
 {
@@ -47,7 +69,9 @@ void RPI_Mailbox0Write( mailbox0_channel_t channel, int value )
 
     /* Wait until the mailbox becomes available and then write to the mailbox
        channel */
+    PROFILE_BEGIN( mailbox_write_wait_marker );
     while( ( rpiMailbox0->Status & ARM_MS_FULL ) != 0 ) { }
+    PROFILE_END( mailbox_write_wait_marker );
 
     /* Write the modified value + channel number into the write register */
     rpiMailbox0->Write = value;
@@ -60,6 +84,8 @@ int RPI_Mailbox0Read( mailbox0_channel_t channel )
        https://github.com/raspberrypi/firmware/wiki/Accessing-mailboxes */
     int value = -1;
 
+    PROFILE_BEGIN( mailbox_read_wait_marker );
+
     /* Keep reading the register until the desired channel gives us a value */
     while( ( value & 0xF ) != channel )
     {
@@ -72,6 +98,169 @@ int RPI_Mailbox0Read( mailbox0_channel_t channel )
         value = rpiMailbox0->Read;
     }
 
+    PROFILE_END( mailbox_read_wait_marker );
+
     /* Return just the value (the upper 28-bits) */
     return value >> 4;
 }
+
+
+/**
+    @brief Write as many pending requests to the VideoCore as it has room
+    for. Called with interrupts masked
+*/
+static void mailbox_flush( void )
+{
+    rpi_mailbox_request_t* request;
+
+    while( ( pending_head != NULL ) && ( ( rpiMailbox1->Status & ARM_MS_FULL ) == 0 ) )
+    {
+        request = pending_head;
+        pending_head = request->next;
+        request->next = NULL;
+
+        /* In flight before it is written, so the reply always has a
+           request to match */
+        if( inflight_tail[request->channel] )
+            inflight_tail[request->channel]->next = request;
+        else
+            inflight_head[request->channel] = request;
+
+        inflight_tail[request->channel] = request;
+
+        TRACE( TRACE_MAILBOX_SUBMIT, request->channel, request->value );
+        rpiMailbox0->Write = ( request->value & ~0xF ) | request->channel;
+    }
+}
+
+
+/**
+    @brief Complete a request for every reply waiting in the ARM's mailbox,
+    then use the room that has been made to write pending requests. Called
+    with interrupts masked
+*/
+static void mailbox_drain( void )
+{
+    rpi_mailbox_request_t* request;
+    uint32_t value;
+    int channel;
+
+    while( ( rpiMailbox0->Status & ARM_MS_EMPTY ) == 0 )
+    {
+        value = rpiMailbox0->Read;
+        channel = value & 0xF;
+
+        /* Nobody asked, probably a reply to a synchronous write */
+        request = inflight_head[channel];
+        if( request == NULL )
+            continue;
+
+        inflight_head[channel] = request->next;
+        if( inflight_head[channel] == NULL )
+            inflight_tail[channel] = NULL;
+
+        request->next = NULL;
+        request->response = value & ~0xF;
+
+        TRACE( TRACE_MAILBOX_COMPLETE, channel, request->value );
+
+        if( request->callback )
+            request->callback( request );
+
+        __asm__ __volatile__( "dmb" ::: "memory" );
+        request->done = 1;
+    }
+
+    mailbox_flush();
+}
+
+
+/**
+    @brief Complete asynchronous requests from the ARM mailbox interrupt
+
+    Until this is called requests still work, RPI_MailboxWait() polls the
+    mailbox instead. Once it has been called the synchronous
+    RPI_Mailbox0Read() must not be used as the interrupt takes the replies.
+*/
+void RPI_MailboxAsyncInit( void )
+{
+    RPI_IrqRegister( RPI_IRQ_ARM_MAILBOX, RPI_MailboxIrqHandler, NULL );
+    rpiMailbox0->Configuration = ARM_MC_IHAVEDATAIRQEN;
+    RPI_IrqEnable( RPI_IRQ_ARM_MAILBOX );
+
+    irq_driven = 1;
+}
+
+
+/**
+    @brief Queue a message for the VideoCore and return straight away
+
+    Completion is signalled through request->done and the callback. Any
+    number of requests can be in flight, on any mix of channels. Mailbox
+    requests must all be made from the same core.
+*/
+void RPI_MailboxSubmit( rpi_mailbox_request_t* request )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+
+    request->done = 0;
+    request->next = NULL;
+
+    if( pending_tail )
+        pending_tail->next = request;
+    else
+        pending_head = request;
+
+    pending_tail = request;
+
+    /* The tail is only used whilst there are requests pending */
+    mailbox_flush();
+    if( pending_head == NULL )
+        pending_tail = NULL;
+
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+/**
+    @brief Wait for a request to complete
+
+    The core sleeps until the next interrupt whilst it waits, unless the
+    mailbox interrupt is not in use or interrupts are masked, in which case
+    the mailbox is polled.
+*/
+void RPI_MailboxWait( rpi_mailbox_request_t* request )
+{
+    uint32_t cpsr;
+
+    while( !request->done )
+    {
+        cpsr = RPI_InterruptsSave();
+
+        if( !irq_driven || ( cpsr & 0x80 ) )
+        {
+            mailbox_drain();
+            if( pending_head == NULL )
+                pending_tail = NULL;
+        }
+        else if( !request->done )
+        {
+            /* WFI wakes up for a pending interrupt even though they're
+               masked, it is then taken as soon as they're restored. Masking
+               first closes the race with the reply arriving just before
+               going to sleep */
+            __asm__ __volatile__( "dsb\n\twfi" ::: "memory" );
+        }
+
+        RPI_InterruptsRestore( cpsr );
+    }
+}
+
+
+void RPI_MailboxIrqHandler( void* param )
+{
+    mailbox_drain();
+
+    if( pending_head == NULL )
+        pending_tail = NULL;
+}
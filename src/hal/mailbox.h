@@ -35,6 +35,13 @@
 
 #define RPI_MAILBOX0_BASE    ( PERIPHERAL_BASE + 0xB880 )
 
+/* Mailbox 1 is the VideoCore's inbox, its status says whether there is room
+   for another ARM to VC message */
+#define RPI_MAILBOX1_BASE    ( PERIPHERAL_BASE + 0xB8A0 )
+
+/** @brief Number of channel numbers, the low four bits of a message */
+#define RPI_MAILBOX_CHANNELS    16
+
 /* The available mailbox channels in the BCM2835 Mailbox interface.
    See https://github.com/raspberrypi/firmware/wiki/Mailboxes for
    information */
@@ -59,6 +66,12 @@ enum mailbox_status_reg_bits {
     ARM_MS_LEVEL = 0x400000FF,
 };
 
+/* Mailbox configuration register bits */
+enum mailbox_config_reg_bits {
+    ARM_MC_IHAVEDATAIRQEN = 0x00000001,
+    ARM_MC_IHAVESPACEIRQEN = 0x00000002,
+};
+
 /* Define a structure which defines the register access to a mailbox.
    Not all mailboxes support the full register set! */
 typedef struct {
@@ -71,7 +84,39 @@ typedef struct {
     volatile unsigned int Write;
     } mailbox_t;
 
+struct rpi_mailbox_request;
+
+/** @brief Called from the mailbox interrupt when a request completes. It
+    must not resubmit the request it is given */
+typedef void (*rpi_mailbox_callback_t)( struct rpi_mailbox_request* request );
+
+/** @brief An asynchronous mailbox message and, once done is set, the reply
+    to it. The VideoCore answers each channel in order so replies are
+    matched to the oldest request in flight on their channel */
+typedef struct rpi_mailbox_request {
+    mailbox0_channel_t channel;
+
+    /** The message, the low four bits must be zero */
+    uint32_t value;
+
+    /** The reply with the channel number stripped off */
+    uint32_t response;
+
+    /** Set once the reply is in and the callback has returned */
+    volatile int done;
+
+    rpi_mailbox_callback_t callback;
+    void* param;
+
+    struct rpi_mailbox_request* next;
+    } rpi_mailbox_request_t;
+
 extern void RPI_Mailbox0Write( mailbox0_channel_t channel, int value );
 extern int RPI_Mailbox0Read( mailbox0_channel_t channel );
 
+extern void RPI_MailboxAsyncInit( void );
+extern void RPI_MailboxSubmit( rpi_mailbox_request_t* request );
+extern void RPI_MailboxWait( rpi_mailbox_request_t* request );
+extern void RPI_MailboxIrqHandler( void* param );
+
 #endif
@@ -0,0 +1,215 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arch/cache.h"
+
+#include "mailbox-interface.h"
+#include "property-cache.h"
+
+/* The tags whose answer can never change while we're running, and the size
+   of their value. Anything not listed here is always live: clock rates,
+   voltages and temperatures move with the firmware's turbo and thermal
+   management, power and clock states with whoever last set them, and the
+   framebuffer tags with the last allocation */
+static const struct {
+    rpi_mailbox_tag_t tag;
+    uint32_t value_size;
+    } cacheable[] = {
+    { TAG_GET_FIRMWARE_VERSION,     4 },
+    { TAG_GET_BOARD_MODEL,          4 },
+    { TAG_GET_BOARD_REVISION,       4 },
+    { TAG_GET_BOARD_MAC_ADDRESS,    6 },
+    { TAG_GET_BOARD_SERIAL,         8 },
+    { TAG_GET_ARM_MEMORY,           8 },
+    { TAG_GET_VC_MEMORY,            8 },
+    { TAG_GET_DMA_CHANNELS,         4 },
+};
+
+#define CACHEABLE_COUNT     (int)( sizeof( cacheable ) / sizeof( cacheable[0] ) )
+
+static rpi_property_cache_entry_t entries[CACHEABLE_COUNT];
+
+/* Set for each entry once the firmware has been asked, whether or not it
+   answered. Unanswered tags are not asked again */
+static uint8_t filled[CACHEABLE_COUNT];
+
+static rpi_property_cache_stats_t stats;
+
+/* A buffer of its own for filling the cache, big enough to ask for every
+   cacheable tag at once, so a miss doesn't wipe answers the caller still
+   has waiting in the default buffer */
+static uint32_t cache_pt[64] __attribute__((aligned(CACHE_LINE_SIZE)));
+static rpi_property_t cache_property;
+static int cache_ready = 0;
+
+
+/**
+    @brief Find a tag in the cacheable list
+
+    @return Its index, -1 if the tag is always live
+*/
+static int cache_slot( rpi_mailbox_tag_t tag )
+{
+    int i;
+
+    for( i = 0; i < CACHEABLE_COUNT; i++ )
+    {
+        if( cacheable[i].tag == tag )
+            return i;
+    }
+
+    return -1;
+}
+
+
+/**
+    @brief Keep a tag's answer, tag is where it is in a processed property
+    buffer or NULL if it wasn't answered
+*/
+static void cache_fill( int slot, const rpi_tag_header_t* tag )
+{
+    /* The value copied is the size we asked for, not what the firmware
+       claims to have written, so a long answer can't overrun the entry */
+    if( tag )
+        memcpy( &entries[slot], tag, sizeof( rpi_tag_header_t ) + cacheable[slot].value_size );
+
+    filled[slot] = 1;
+}
+
+
+/**
+    @brief Non-zero if the firmware's answer to a tag never changes, so it
+    can be served from the cache
+*/
+int RPI_PropertyCacheable( rpi_mailbox_tag_t tag )
+{
+    return cache_slot( tag ) >= 0;
+}
+
+
+/**
+    @brief Add every cacheable tag that hasn't been filled yet to the current
+    property buffer, so the cache can be filled along with other requests
+*/
+void RPI_PropertyCacheAddTags( void )
+{
+    int i;
+
+    for( i = 0; i < CACHEABLE_COUNT; i++ )
+    {
+        if( !filled[i] )
+            RPI_PropertyAdd( cacheable[i].tag, cacheable[i].value_size );
+    }
+}
+
+
+/**
+    @brief Copy the answers out of a processed property buffer that had
+    RPI_PropertyCacheAddTags() in it
+*/
+void RPI_PropertyCacheParseTags( void )
+{
+    int i;
+
+    for( i = 0; i < CACHEABLE_COUNT; i++ )
+    {
+        if( !filled[i] )
+            cache_fill( i, RPI_PropertyGet( cacheable[i].tag ) );
+    }
+}
+
+
+/**
+    @brief Ask the firmware for every unfilled tag from first to last in the
+    cache's own buffer
+*/
+static void cache_query( int first, int last )
+{
+    int i;
+
+    if( !cache_ready )
+    {
+        RPI_PropertyBufferInit( &cache_property, cache_pt, sizeof( cache_pt ) / sizeof( cache_pt[0] ) );
+        cache_ready = 1;
+    }
+    else
+    {
+        RPI_PropertyBufferReset( &cache_property );
+    }
+
+    for( i = first; i <= last; i++ )
+    {
+        if( !filled[i] )
+            RPI_PropertyBufferAdd( &cache_property, cacheable[i].tag, cacheable[i].value_size );
+    }
+
+    RPI_PropertyBufferProcess( &cache_property );
+
+    for( i = first; i <= last; i++ )
+    {
+        if( !filled[i] )
+            cache_fill( i, RPI_PropertyBufferGet( &cache_property, cacheable[i].tag ) );
+    }
+}
+
+
+/**
+    @brief Fill the cache in a round trip of its own. The default property
+    buffer is left alone
+*/
+void RPI_PropertyCacheInit( void )
+{
+    cache_query( 0, CACHEABLE_COUNT - 1 );
+}
+
+
+/**
+    @brief Read a cacheable tag. A tag that hasn't been filled yet costs a
+    round trip the first time, in the cache's own buffer so whatever is in
+    the default property buffer is left alone
+
+    It's easier to use RPI_PROPERTY_CACHE_GET() which casts to the tag's
+    type.
+
+    @return The cached tag, NULL if the tag is always live or the firmware
+            did not answer it
+*/
+const void* RPI_PropertyCacheGet( rpi_mailbox_tag_t tag )
+{
+    int slot = cache_slot( tag );
+
+    if( slot < 0 )
+    {
+        stats.live++;
+        return NULL;
+    }
+
+    if( filled[slot] )
+    {
+        stats.hits++;
+    }
+    else
+    {
+        stats.misses++;
+        cache_query( slot, slot );
+    }
+
+    if( ( entries[slot].header.response & TAG_RESPONSE_BIT ) == 0 )
+        return NULL;
+
+    return &entries[slot];
+}
+
+
+const rpi_property_cache_stats_t* RPI_PropertyCacheGetStats( void )
+{
+    return &stats;
+}
@@ -0,0 +1,48 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef RPI_PROPERTY_CACHE_H
+#define RPI_PROPERTY_CACHE_H
+
+#include <stdint.h>
+
+#include "mailbox-interface.h"
+
+/** @brief Largest value the cache holds, in bytes */
+#define RPI_PROPERTY_CACHE_VALUE_SIZE   8
+
+/** @brief A cached tag, laid out like the tag in a property buffer so the
+    usual typed views (rpi_tag_u32_t and so on) can be used to read it */
+typedef struct {
+    rpi_tag_header_t header;
+    uint32_t value[RPI_PROPERTY_CACHE_VALUE_SIZE / 4];
+    } rpi_property_cache_entry_t;
+
+typedef struct {
+    /** Answered from RAM */
+    uint32_t hits;
+
+    /** Cacheable, but not cached yet so it cost a round trip */
+    uint32_t misses;
+
+    /** Asked for a tag that is always live, see RPI_PropertyCacheable() */
+    uint32_t live;
+    } rpi_property_cache_stats_t;
+
+extern int RPI_PropertyCacheable( rpi_mailbox_tag_t tag );
+extern void RPI_PropertyCacheAddTags( void );
+extern void RPI_PropertyCacheParseTags( void );
+extern void RPI_PropertyCacheInit( void );
+extern const void* RPI_PropertyCacheGet( rpi_mailbox_tag_t tag );
+extern const rpi_property_cache_stats_t* RPI_PropertyCacheGetStats( void );
+
+/** @brief Look a tag up in the cache and return a typed view of it, NULL if
+    the tag is not cacheable or the firmware didn't answer it */
+#define RPI_PROPERTY_CACHE_GET( tag, type ) \
+    ( (const type*)RPI_PropertyCacheGet( tag ) )
+
+#endif
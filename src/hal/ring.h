@@ -0,0 +1,118 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef RPI_RING_H
+#define RPI_RING_H
+
+#include <stdint.h>
+
+/** @brief Single-producer/single-consumer byte ring
+
+    The head is only written by the producer and the tail only by the
+    consumer, so neither side needs a lock. Both indices run freely and are
+    masked on access, which means the size must be a power of two and the
+    fill level is simply head - tail.
+
+    The one exception is RPI_RingPutOverwrite(), where the producer discards
+    the oldest byte by advancing the tail. Both sides then update the tail
+    with a compare-and-swap so a byte is never consumed and overwritten at
+    the same time. */
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t mask;
+    uint8_t* buffer;
+    } rpi_ring_t;
+
+/** @brief Make stores to the buffer visible before the index that publishes
+    them (and vice-versa) */
+#define RPI_RING_BARRIER()      __asm__ __volatile__( "dmb" ::: "memory" )
+
+
+static inline void RPI_RingInit( rpi_ring_t* ring, uint8_t* buffer, uint32_t size )
+{
+    ring->head = 0;
+    ring->tail = 0;
+    ring->mask = size - 1;
+    ring->buffer = buffer;
+}
+
+static inline uint32_t RPI_RingCount( const rpi_ring_t* ring )
+{
+    return ring->head - ring->tail;
+}
+
+static inline int RPI_RingEmpty( const rpi_ring_t* ring )
+{
+    return ring->head == ring->tail;
+}
+
+static inline int RPI_RingFull( const rpi_ring_t* ring )
+{
+    return RPI_RingCount( ring ) > ring->mask;
+}
+
+/** @brief Producer side, returns 0 if the ring is full */
+static inline int RPI_RingPut( rpi_ring_t* ring, uint8_t c )
+{
+    uint32_t head = ring->head;
+
+    if( ( head - ring->tail ) > ring->mask )
+        return 0;
+
+    ring->buffer[head & ring->mask] = c;
+    RPI_RING_BARRIER();
+    ring->head = head + 1;
+
+    return 1;
+}
+
+/** @brief Producer side, discards the oldest byte to make room if the ring
+    is full. Returns 0 if a byte was discarded */
+static inline int RPI_RingPutOverwrite( rpi_ring_t* ring, uint8_t c )
+{
+    uint32_t head = ring->head;
+    uint32_t tail = ring->tail;
+    int kept = 1;
+
+    while( ( head - tail ) > ring->mask )
+    {
+        if( __atomic_compare_exchange_n( &ring->tail, &tail, tail + 1, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) )
+        {
+            kept = 0;
+            break;
+        }
+    }
+
+    ring->buffer[head & ring->mask] = c;
+    RPI_RING_BARRIER();
+    ring->head = head + 1;
+
+    return kept;
+}
+
+/** @brief Consumer side, returns 0 if the ring is empty */
+static inline int RPI_RingGet( rpi_ring_t* ring, uint8_t* c )
+{
+    uint32_t tail = ring->tail;
+
+    do
+    {
+        if( tail == ring->head )
+            return 0;
+
+        RPI_RING_BARRIER();
+        *c = ring->buffer[tail & ring->mask];
+
+    } while( !__atomic_compare_exchange_n( &ring->tail, &tail, tail + 1, 0,
+                                           __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) );
+
+    return 1;
+}
+
+#endif
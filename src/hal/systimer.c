@@ -9,11 +9,31 @@ rpi_sys_timer_t* RPI_GetSystemTimer(void)
     return rpiSystemTimer;
 }
 
+/**
+    @brief Read the whole 64 bit microsecond counter, which never wraps
+
+    The two halves can't be read at once, so read the high word either side
+    of the low one and go round again if the low word wrapped in between
+*/
+uint64_t RPI_GetSystemTime( void )
+{
+    uint32_t hi;
+    uint32_t lo;
+
+    do
+    {
+        hi = rpiSystemTimer->counter_hi;
+        lo = rpiSystemTimer->counter_lo;
+    } while( hi != rpiSystemTimer->counter_hi );
+
+    return ( (uint64_t)hi << 32 ) | lo;
+}
+
 void RPI_WaitMicroSeconds( uint32_t us )
 {
-    volatile uint32_t ts = rpiSystemTimer->counter_lo;
+    uint64_t end = RPI_GetSystemTime() + us;
 
-    while( ( rpiSystemTimer->counter_lo - ts ) < us )
+    while( RPI_GetSystemTime() < end )
     {
         /* BLANK */
     }
@@ -49,6 +49,7 @@ typedef struct {
 
 
 extern rpi_sys_timer_t* RPI_GetSystemTimer(void);
+extern uint64_t RPI_GetSystemTime( void );
 extern void RPI_WaitMicroSeconds( uint32_t us );
 
 #endif
@@ -0,0 +1,336 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arch/spinlock.h"
+
+#include "interrupts.h"
+#include "systimer.h"
+#include "timer.h"
+
+/* Scheduled timers as a binary min-heap on their deadlines, so the next one
+   due is always heap[0] */
+static rpi_timer_t* heap[RPI_TIMER_MAX];
+static int heap_count = 0;
+static spinlock_t timer_lock = SPINLOCK_UNLOCKED;
+
+static rpi_timer_stats_t stats = { 0, 0xFFFFFFFF, 0, 0, 0, 0 };
+
+
+/**
+    @brief Deadlines are compared by their difference so the wrap of
+    counter_lo every 71 minutes doesn't matter
+*/
+static inline int before( uint32_t a, uint32_t b )
+{
+    return (int32_t)( a - b ) < 0;
+}
+
+
+static inline void heap_set( int index, rpi_timer_t* timer )
+{
+    heap[index] = timer;
+    timer->index = index;
+}
+
+
+static void sift_up( int index )
+{
+    rpi_timer_t* timer = heap[index];
+    int parent;
+
+    while( index > 0 )
+    {
+        parent = ( index - 1 ) / 2;
+
+        if( !before( timer->deadline, heap[parent]->deadline ) )
+            break;
+
+        heap_set( index, heap[parent] );
+        index = parent;
+    }
+
+    heap_set( index, timer );
+}
+
+
+static void sift_down( int index )
+{
+    rpi_timer_t* timer = heap[index];
+    int child;
+
+    while( ( child = ( index * 2 ) + 1 ) < heap_count )
+    {
+        if( ( ( child + 1 ) < heap_count ) &&
+            before( heap[child + 1]->deadline, heap[child]->deadline ) )
+            child++;
+
+        if( !before( heap[child]->deadline, timer->deadline ) )
+            break;
+
+        heap_set( index, heap[child] );
+        index = child;
+    }
+
+    heap_set( index, timer );
+}
+
+
+static void heap_remove( rpi_timer_t* timer )
+{
+    int index = timer->index;
+    rpi_timer_t* last = heap[--heap_count];
+
+    timer->index = -1;
+
+    if( last == timer )
+        return;
+
+    heap_set( index, last );
+
+    if( ( index > 0 ) && before( last->deadline, heap[( index - 1 ) / 2]->deadline ) )
+        sift_up( index );
+    else
+        sift_down( index );
+}
+
+
+/**
+    @brief Point the compare register at the next deadline, or as near to
+    it as is safe. There are no periodic ticks, with nothing scheduled the
+    next interrupt is the counter wrapping round to the old compare value
+*/
+static void timer_arm( void )
+{
+    rpi_sys_timer_t* systimer = RPI_GetSystemTimer();
+    volatile uint32_t* compare = &systimer->compare0 + RPI_TIMER_CHANNEL;
+    uint32_t earliest;
+    uint32_t deadline;
+
+    if( heap_count == 0 )
+        return;
+
+    earliest = systimer->counter_lo + RPI_TIMER_MIN_US;
+    deadline = heap[0]->deadline;
+
+    if( before( deadline, earliest ) )
+        deadline = earliest;
+
+    *compare = deadline;
+    stats.reprograms++;
+}
+
+
+/**
+    @brief Route the compare channel's interrupt to the service
+*/
+void RPI_TimerInit( void )
+{
+    RPI_GetSystemTimer()->control_status = ( 1 << RPI_TIMER_CHANNEL );
+
+    RPI_IrqRegister( RPI_IRQ_SYSTIMER_0 + RPI_TIMER_CHANNEL, RPI_TimerIrqHandler, NULL );
+    RPI_IrqEnable( RPI_IRQ_SYSTIMER_0 + RPI_TIMER_CHANNEL );
+}
+
+
+/**
+    @brief Set up a timer before it is first started
+*/
+void RPI_TimerSetup( rpi_timer_t* timer, rpi_timer_callback_t callback, void* param )
+{
+    timer->deadline = 0;
+    timer->period = 0;
+    timer->callback = callback;
+    timer->param = param;
+    timer->index = -1;
+}
+
+
+/**
+    @brief Schedule a timer for when counter_lo reaches deadline, restarting
+    it if it is already scheduled
+
+    A periodic timer is rescheduled period microseconds after each deadline,
+    not after its callback ran, so it doesn't drift.
+
+    @return 0 on success, -1 if too many timers are scheduled
+*/
+int RPI_TimerStartAt( rpi_timer_t* timer, uint32_t deadline, uint32_t period )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+    int result = 0;
+
+    spin_lock( &timer_lock );
+
+    if( timer->index >= 0 )
+        heap_remove( timer );
+
+    timer->deadline = deadline;
+    timer->period = period;
+
+    if( heap_count < RPI_TIMER_MAX )
+    {
+        heap_set( heap_count, timer );
+        sift_up( heap_count++ );
+
+        if( timer->index == 0 )
+            timer_arm();
+    }
+    else
+    {
+        result = -1;
+    }
+
+    spin_unlock( &timer_lock );
+    RPI_InterruptsRestore( cpsr );
+
+    return result;
+}
+
+
+/**
+    @brief Schedule a timer us microseconds from now, see RPI_TimerStartAt()
+*/
+int RPI_TimerStart( rpi_timer_t* timer, uint32_t us, uint32_t period )
+{
+    return RPI_TimerStartAt( timer, RPI_GetSystemTimer()->counter_lo + us, period );
+}
+
+
+/**
+    @brief Stop a timer. The callback may still be running on its way out of
+    the interrupt
+
+    @return 0 if the timer was scheduled, -1 if it wasn't
+*/
+int RPI_TimerCancel( rpi_timer_t* timer )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+    int result = -1;
+
+    spin_lock( &timer_lock );
+
+    if( timer->index >= 0 )
+    {
+        heap_remove( timer );
+        result = 0;
+    }
+
+    spin_unlock( &timer_lock );
+    RPI_InterruptsRestore( cpsr );
+
+    return result;
+}
+
+
+static void sleep_done( rpi_timer_t* timer, void* param )
+{
+    *(volatile int*)param = 1;
+
+    /* The sleeper may be on a core that doesn't take the interrupt */
+    __asm__ __volatile__( "dsb\n\tsev" ::: "memory" );
+}
+
+
+/**
+    @brief Sleep for at least us microseconds. The core waits for an event
+    rather than spinning on the counter, unless interrupts are off when it
+    has no choice
+*/
+void RPI_TimerSleep( uint32_t us )
+{
+    volatile int done = 0;
+    rpi_timer_t timer;
+
+    if( RPI_InterruptsMasked() )
+    {
+        RPI_WaitMicroSeconds( us );
+        return;
+    }
+
+    RPI_TimerSetup( &timer, sleep_done, (void*)&done );
+
+    if( RPI_TimerStart( &timer, us, 0 ) != 0 )
+    {
+        RPI_WaitMicroSeconds( us );
+        return;
+    }
+
+    while( !done )
+        __asm__ __volatile__( "wfe" );
+}
+
+
+const rpi_timer_stats_t* RPI_TimerGetStats( void )
+{
+    return &stats;
+}
+
+
+/**
+    @brief Service the compare channel's interrupt, registered with the IRQ
+    dispatcher. Runs every timer that is due, then sets up the match for the
+    next one
+*/
+void RPI_TimerIrqHandler( void* param )
+{
+    rpi_sys_timer_t* systimer = RPI_GetSystemTimer();
+    rpi_timer_t* timer;
+    uint32_t now;
+    uint32_t late;
+
+    systimer->control_status = ( 1 << RPI_TIMER_CHANNEL );
+
+    spin_lock( &timer_lock );
+
+    while( heap_count > 0 )
+    {
+        timer = heap[0];
+        now = systimer->counter_lo;
+
+        if( before( now, timer->deadline ) )
+            break;
+
+        late = now - timer->deadline;
+
+        stats.fired++;
+        stats.late_total += late;
+        if( late < stats.late_min )
+            stats.late_min = late;
+        if( late > stats.late_max )
+            stats.late_max = late;
+
+        if( timer->period )
+        {
+            timer->deadline += timer->period;
+
+            /* Don't try to catch up on the repeats that were missed */
+            if( late >= timer->period )
+            {
+                timer->deadline = now + timer->period;
+                stats.overruns++;
+            }
+
+            sift_down( 0 );
+        }
+        else
+        {
+            heap_remove( timer );
+        }
+
+        /* Let the callback start and cancel timers */
+        spin_unlock( &timer_lock );
+        timer->callback( timer, timer->param );
+        spin_lock( &timer_lock );
+    }
+
+    timer_arm();
+
+    spin_unlock( &timer_lock );
+}
@@ -0,0 +1,79 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef RPI_TIMER_H
+#define RPI_TIMER_H
+
+#include <stdint.h>
+
+/** @brief System timer compare channel the timer service runs on. The GPU
+    uses channels 0 and 2, 1 and 3 are free for the ARM */
+#ifndef RPI_TIMER_CHANNEL
+    #define RPI_TIMER_CHANNEL       1
+#endif
+
+/** @brief Most timers that can be scheduled at once */
+#define RPI_TIMER_MAX               64
+
+/** @brief The compare register is never set closer than this to the
+    counter, so the match can't be missed by the counter going past while
+    it is being written */
+#define RPI_TIMER_MIN_US            2
+
+struct rpi_timer;
+
+/** @brief Called from the timer interrupt once the deadline has passed. The
+    timer can be started again from here */
+typedef void (*rpi_timer_callback_t)( struct rpi_timer* timer, void* param );
+
+/** @brief A timer, owned by the caller and left alone by the service
+    except while it is scheduled */
+typedef struct rpi_timer {
+    /** System timer counter_lo value it is due at */
+    uint32_t deadline;
+
+    /** Microseconds between repeats, 0 for a one-shot */
+    uint32_t period;
+
+    rpi_timer_callback_t callback;
+    void* param;
+
+    /** Where it is in the heap, -1 when not scheduled */
+    int index;
+    } rpi_timer_t;
+
+/** @brief How late callbacks are run, in microseconds past the deadline as
+    seen by counter_lo */
+typedef struct {
+    uint32_t fired;
+    uint32_t late_min;
+    uint32_t late_max;
+    uint64_t late_total;
+
+    /** Periodic timers that fell a whole period or more behind */
+    uint32_t overruns;
+
+    /** Times the compare register was written */
+    uint32_t reprograms;
+    } rpi_timer_stats_t;
+
+extern void RPI_TimerInit( void );
+extern void RPI_TimerSetup( rpi_timer_t* timer, rpi_timer_callback_t callback, void* param );
+extern int RPI_TimerStartAt( rpi_timer_t* timer, uint32_t deadline, uint32_t period );
+extern int RPI_TimerStart( rpi_timer_t* timer, uint32_t us, uint32_t period );
+extern int RPI_TimerCancel( rpi_timer_t* timer );
+extern void RPI_TimerSleep( uint32_t us );
+extern const rpi_timer_stats_t* RPI_TimerGetStats( void );
+extern void RPI_TimerIrqHandler( void* param );
+
+/** @brief Non-zero while the timer is waiting to fire */
+static inline int RPI_TimerPending( const rpi_timer_t* timer )
+{
+    return timer->index >= 0;
+}
+
+#endif
@@ -0,0 +1,500 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arch/cache.h"
+
+#include "base.h"
+#include "dma.h"
+#include "gpio.h"
+#include "interrupts.h"
+#include "mailbox-interface.h"
+#include "ring.h"
+#include "uart.h"
+
+static rpi_uart_t* uart = (rpi_uart_t*)RPI_UART0_BASE;
+
+/* Transmit ring, filled by RPI_UartWrite() and drained into the FIFO by the
+   transmit interrupt or the DMA engine */
+static uint8_t tx_buffer[RPI_UART_TX_BUFFER_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+static rpi_ring_t tx_ring;
+static rpi_uart_tx_mode_t tx_mode = RPI_UART_TX_BLOCK;
+
+/* Set while the transmit interrupt or a DMA transfer is draining the ring,
+   cleared once they find it empty */
+static volatile int tx_active = 0;
+
+/* Receive ring, filled by the receive interrupt and drained by
+   RPI_UartRead() */
+static uint8_t rx_buffer[RPI_UART_RX_BUFFER_SIZE];
+static rpi_ring_t rx_ring;
+static rpi_uart_rx_mode_t rx_mode = RPI_UART_RX_BLOCK;
+
+/* DMA transmit, the channel is -1 while the FIFO interrupt is used */
+static int tx_dma_channel = -1;
+static rpi_dma_cb_t* tx_dma_cb = NULL;
+static uint32_t tx_dma_length = 0;
+
+/* What the PL011 is clocked at, in Hz */
+static uint32_t uart_clock = 0;
+
+static rpi_uart_notify_t notify = NULL;
+static void* notify_param;
+
+static rpi_uart_stats_t stats;
+
+static void tx_dma_complete( int channel, int error, void* param );
+
+
+/**
+    @brief Set up the PL011 on GPIO 14 and 15, 8N1 with both FIFOs on
+
+    @return The baud rate actually set, -1 if it can't be reached
+*/
+int RPI_UartInit( int baud )
+{
+    int result;
+
+    RPI_RingInit( &tx_ring, tx_buffer, RPI_UART_TX_BUFFER_SIZE );
+    RPI_RingInit( &rx_ring, rx_buffer, RPI_UART_RX_BUFFER_SIZE );
+
+    uart->CR = 0;
+    uart->IMSC = 0;
+    uart->ICR = RPI_UART_INT_ALL;
+    uart->DMACR = 0;
+
+    /* GPIO 14 and 15 as alternative function 0 which is UART 0 TXD/RXD,
+       with the pulls off */
+    RPI_SetGpioPinFunction( RPI_GPIO14, FS_ALT0 );
+    RPI_SetGpioPinFunction( RPI_GPIO15, FS_ALT0 );
+
+    RPI_SetGpioPull( ( 1 << 14 ) | ( 1 << 15 ), RPI_GPIO_PULL_OFF );
+
+    /* Current firmware sets the UART clock to 48MHz, if it won't say then
+       assume that's what it is */
+    if( ( uart_clock = RPI_PropertyGetClockRate( TAG_CLOCK_UART ) ) == 0 )
+        uart_clock = RPI_UART_CLOCK_MAX;
+
+    result = RPI_UartSetBaud( baud );
+
+    /* Receive when the FIFO is half full, or when it has gone quiet with
+       less in it. Transmit is refilled as it falls to 2 bytes, which at
+       3Mbaud still leaves 6us to get to the interrupt */
+    uart->IFLS = RPI_UART_IFLS_TX( RPI_UART_IFLS_1_8 ) | RPI_UART_IFLS_RX( RPI_UART_IFLS_1_2 );
+    uart->IMSC = RPI_UART_INT_RX | RPI_UART_INT_RT;
+
+    uart->CR = RPI_UART_CR_UARTEN | RPI_UART_CR_TXE | RPI_UART_CR_RXE;
+
+    RPI_IrqRegister( RPI_IRQ_UART, RPI_UartIrqHandler, NULL );
+    RPI_IrqEnable( RPI_IRQ_UART );
+
+    return result;
+}
+
+
+/**
+    @brief Change the baud rate. Anything still in the transmit FIFO is sent
+    at the old rate first
+
+    The UART clock is raised to RPI_UART_CLOCK_MAX if it's too slow for the
+    rate asked for.
+
+    @return The baud rate actually set, -1 if it can't be reached
+*/
+int RPI_UartSetBaud( int baud )
+{
+    uint32_t divisor;
+    uint32_t cpsr;
+    uint32_t cr;
+
+    if( baud <= 0 )
+        return -1;
+
+    /* Each bit is sampled 16 times */
+    if( uart_clock < ( 16 * (uint32_t)baud ) )
+        uart_clock = RPI_PropertySetClockRate( TAG_CLOCK_UART, RPI_UART_CLOCK_MAX );
+
+    if( uart_clock < ( 16 * (uint32_t)baud ) )
+        return -1;
+
+    /* The divisor is clock / ( 16 * baud ) with a 6 bit fraction, so work
+       in 64ths and round to the nearest */
+    divisor = (uint32_t)( ( ( (uint64_t)uart_clock * 4 ) + ( baud / 2 ) ) / baud );
+
+    if( ( divisor >> 6 ) > 0xFFFF )
+        return -1;
+
+    cpsr = RPI_InterruptsSave();
+
+    /* The divisors are only picked up by a write to LCRH, which mustn't
+       happen part way through a byte */
+    while( ( uart->FR & RPI_UART_FR_TXFE ) == 0 ) { }
+    while( uart->FR & RPI_UART_FR_BUSY ) { }
+
+    cr = uart->CR;
+    uart->CR = 0;
+
+    uart->IBRD = divisor >> 6;
+    uart->FBRD = divisor & 0x3F;
+    uart->LCRH = RPI_UART_LCRH_WLEN8 | RPI_UART_LCRH_FEN;
+
+    uart->CR = cr;
+
+    RPI_InterruptsRestore( cpsr );
+
+    return (int)( ( (uint64_t)uart_clock * 4 ) / divisor );
+}
+
+
+/**
+    @brief Move as much of the transmit ring into the FIFO as it will accept
+
+    @return non-zero if the ring still has data waiting
+*/
+static int tx_drain( void )
+{
+    uint8_t c;
+
+    while( ( uart->FR & RPI_UART_FR_TXFF ) == 0 )
+    {
+        if( !RPI_RingGet( &tx_ring, &c ) )
+            return 0;
+
+        uart->DR = c;
+        stats.tx_bytes++;
+    }
+
+    return 1;
+}
+
+
+/**
+    @brief Hand the oldest part of the ring to the DMA engine, paced by the
+    UART's transmit DREQ. The bytes stay in the ring until the transfer is
+    done so the producer can't reuse them
+
+    @return non-zero if a transfer was started
+*/
+static int tx_dma_start( void )
+{
+    uint32_t tail = tx_ring.tail;
+    uint32_t offset = tail & tx_ring.mask;
+    uint32_t length = tx_ring.head - tail;
+
+    if( length == 0 )
+        return 0;
+
+    /* The engine can't wrap around the ring, the rest goes next time */
+    if( length > ( RPI_UART_TX_BUFFER_SIZE - offset ) )
+        length = RPI_UART_TX_BUFFER_SIZE - offset;
+
+    RPI_RING_BARRIER();
+    cache_clean_range( &tx_buffer[offset], length );
+
+    tx_dma_cb->ti = RPI_DMA_TI_SRC_INC | RPI_DMA_TI_DEST_DREQ |
+                    RPI_DMA_TI_PERMAP( RPI_DMA_DREQ_UART_TX ) | RPI_DMA_TI_WAIT_RESP;
+    tx_dma_cb->source_ad = RPI_PHYS_TO_BUS( &tx_buffer[offset] );
+    tx_dma_cb->dest_ad = RPI_PERIPHERAL_TO_BUS( &uart->DR );
+    tx_dma_cb->txfr_len = length;
+    tx_dma_cb->stride = 0;
+
+    tx_dma_length = length;
+    stats.tx_dma++;
+
+    return RPI_DmaStart( tx_dma_channel, tx_dma_cb, tx_dma_complete, NULL ) == 0;
+}
+
+
+/**
+    @brief Called from the DMA interrupt, release the bytes that were sent
+    and start on whatever has been queued since
+*/
+static void tx_dma_complete( int channel, int error, void* param )
+{
+    __atomic_store_n( &tx_ring.tail, tx_ring.tail + tx_dma_length, __ATOMIC_RELEASE );
+
+    if( error )
+        stats.tx_dropped += tx_dma_length;
+    else
+        stats.tx_bytes += tx_dma_length;
+
+    if( !tx_dma_start() )
+        tx_active = 0;
+
+    if( notify )
+        notify( notify_param );
+}
+
+
+/**
+    @brief Get the ring draining if nothing is already, called with
+    interrupts off
+*/
+static void tx_kick( void )
+{
+    if( tx_active )
+        return;
+
+    if( tx_dma_channel >= 0 )
+    {
+        tx_active = tx_dma_start();
+        return;
+    }
+
+    /* The transmit interrupt only fires as the FIFO level falls through
+       the watermark, so it has to be filled by hand to get it going */
+    if( tx_drain() )
+    {
+        tx_active = 1;
+        uart->IMSC |= RPI_UART_INT_TX;
+    }
+}
+
+
+/**
+    @brief Do the interrupt's job when interrupts are off
+*/
+static void tx_poll( void )
+{
+    if( tx_dma_channel >= 0 )
+        RPI_DmaWait( tx_dma_channel );
+    else
+        tx_drain();
+}
+
+
+/**
+    @brief Send from the transmit ring with the DMA engine rather than the
+    FIFO interrupt. Needs RPI_DmaInit() to have been called
+
+    @return 0 on success, -1 if there is no channel or control block free
+*/
+int RPI_UartEnableDma( void )
+{
+    uint32_t cpsr;
+    int channel;
+
+    if( tx_dma_channel >= 0 )
+        return 0;
+
+    /* A plain copy, so a lite channel will do */
+    if( ( channel = RPI_DmaChannelAlloc( 0 ) ) < 0 )
+        return -1;
+
+    if( ( tx_dma_cb = RPI_DmaCbAlloc() ) == NULL )
+    {
+        RPI_DmaChannelFree( channel );
+        return -1;
+    }
+
+    cpsr = RPI_InterruptsSave();
+
+    /* Finish off what the interrupt had queued so only one of them ever
+       owns the ring */
+    while( tx_drain() ) { }
+
+    uart->IMSC &= ~RPI_UART_INT_TX;
+    uart->ICR = RPI_UART_INT_TX;
+    tx_active = 0;
+
+    tx_dma_channel = channel;
+    uart->DMACR = RPI_UART_DMACR_TXDMAE;
+
+    RPI_InterruptsRestore( cpsr );
+
+    return 0;
+}
+
+
+/**
+    @brief Select what happens when the transmit ring is full
+*/
+void RPI_UartSetTxMode( rpi_uart_tx_mode_t mode )
+{
+    tx_mode = mode;
+}
+
+
+/**
+    @brief Select whether reads wait for data
+*/
+void RPI_UartSetRxMode( rpi_uart_rx_mode_t mode )
+{
+    rx_mode = mode;
+}
+
+
+void RPI_UartWrite( char c )
+{
+    uint32_t level;
+    uint32_t cpsr;
+
+    if( tx_mode == RPI_UART_TX_BLOCK )
+    {
+        while( !RPI_RingPut( &tx_ring, c ) )
+        {
+            /* Nobody else is going to drain the ring if interrupts are
+               off */
+            if( RPI_InterruptsMasked() )
+                tx_poll();
+        }
+    }
+    else if( !RPI_RingPut( &tx_ring, c ) )
+    {
+        stats.tx_dropped++;
+    }
+
+    level = RPI_RingCount( &tx_ring );
+    if( level > stats.tx_high_water )
+        stats.tx_high_water = level;
+
+    cpsr = RPI_InterruptsSave();
+    tx_kick();
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+/**
+    @brief Empty the receive FIFO into the receive ring
+*/
+static void rx_fill( void )
+{
+    uint32_t data;
+
+    while( ( uart->FR & RPI_UART_FR_RXFE ) == 0 )
+    {
+        data = uart->DR;
+
+        /* The overrun is flagged on the first byte after the ones lost */
+        if( data & RPI_UART_DR_OE )
+            stats.rx_overruns++;
+
+        if( RPI_RingPut( &rx_ring, data & 0xFF ) )
+            stats.rx_bytes++;
+        else
+            stats.rx_dropped++;
+    }
+}
+
+
+/**
+    @brief Read up to length bytes that have been received
+
+    In RPI_UART_RX_BLOCK mode this sleeps until at least one byte is
+    available, otherwise it returns straight away.
+
+    @return The number of bytes copied into buffer
+*/
+int RPI_UartRead( char* buffer, int length )
+{
+    int count = 0;
+    uint8_t c;
+    uint32_t cpsr;
+
+    while( count < length )
+    {
+        if( RPI_RingGet( &rx_ring, &c ) )
+        {
+            buffer[count++] = c;
+            continue;
+        }
+
+        if( ( count > 0 ) || ( rx_mode == RPI_UART_RX_NONBLOCK ) )
+            break;
+
+        /* Nothing yet. The receive interrupt wakes us up, unless interrupts
+           are off in which case go and get the data ourselves. Masking
+           before checking the ring again closes the race with a byte
+           arriving just before going to sleep, WFI still wakes for the
+           pending interrupt and it is taken once they're restored */
+        cpsr = RPI_InterruptsSave();
+
+        if( cpsr & 0x80 )
+            rx_fill();
+        else if( RPI_RingEmpty( &rx_ring ) )
+            __asm__ __volatile__( "dsb\n\twfi" ::: "memory" );
+
+        RPI_InterruptsRestore( cpsr );
+    }
+
+    return count;
+}
+
+
+/**
+    @brief Wait until everything queued has been handed to the hardware
+*/
+void RPI_UartFlush( void )
+{
+    while( !RPI_RingEmpty( &tx_ring ) )
+    {
+        if( RPI_InterruptsMasked() )
+            tx_poll();
+    }
+}
+
+
+/**
+    @brief Bytes that can be written without the ring filling up
+*/
+int RPI_UartTxSpace( void )
+{
+    return ( tx_ring.mask + 1 ) - RPI_RingCount( &tx_ring );
+}
+
+
+/**
+    @brief Have a function called from the interrupt whenever there is new
+    data to read or more room to write, NULL to stop
+*/
+void RPI_UartSetNotify( rpi_uart_notify_t func, void* param )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+
+    notify = func;
+    notify_param = param;
+
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+const rpi_uart_stats_t* RPI_UartGetStats( void )
+{
+    return &stats;
+}
+
+
+/**
+    @brief Service the UART interrupt, registered with the IRQ dispatcher
+*/
+void RPI_UartIrqHandler( void* param )
+{
+    uint32_t mis = uart->MIS;
+
+    if( mis & ( RPI_UART_INT_RX | RPI_UART_INT_RT ) )
+    {
+        uart->ICR = RPI_UART_INT_RX | RPI_UART_INT_RT;
+        rx_fill();
+    }
+
+    if( mis & RPI_UART_INT_TX )
+    {
+        /* Refilling the FIFO past the watermark clears the interrupt, stop
+           it once there is nothing left to send */
+        if( !tx_drain() )
+        {
+            uart->IMSC &= ~RPI_UART_INT_TX;
+            uart->ICR = RPI_UART_INT_TX;
+            tx_active = 0;
+        }
+    }
+
+    if( notify && ( mis & ( RPI_UART_INT_RX | RPI_UART_INT_RT | RPI_UART_INT_TX ) ) )
+        notify( notify_param );
+}
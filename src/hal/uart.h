@@ -0,0 +1,140 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef RPI_UART_H
+#define RPI_UART_H
+
+#include <stdint.h>
+
+#include "base.h"
+
+/** @brief The PL011, UART0. Unlike the mini UART it has its own clock, so
+    its baud rate doesn't move with the core clock */
+#define RPI_UART0_BASE          ( PERIPHERAL_BASE + 0x201000 )
+
+/** @brief Depth of each of the hardware FIFOs */
+#define RPI_UART_FIFO_SIZE      16
+
+/** @brief The UART clock is raised to this if the one the firmware set up
+    is too slow for the baud rate asked for. 16x oversampling makes this
+    good for 3Mbaud */
+#define RPI_UART_CLOCK_MAX      48000000
+
+/* Data register, the receive error flags come with each byte */
+#define RPI_UART_DR_OE          ( 1 << 11 )
+#define RPI_UART_DR_BE          ( 1 << 10 )
+#define RPI_UART_DR_PE          ( 1 << 9 )
+#define RPI_UART_DR_FE          ( 1 << 8 )
+
+/* Flag register */
+#define RPI_UART_FR_BUSY        ( 1 << 3 )
+#define RPI_UART_FR_RXFE        ( 1 << 4 )
+#define RPI_UART_FR_TXFF        ( 1 << 5 )
+#define RPI_UART_FR_RXFF        ( 1 << 6 )
+#define RPI_UART_FR_TXFE        ( 1 << 7 )
+
+/* Line control register */
+#define RPI_UART_LCRH_FEN       ( 1 << 4 )
+#define RPI_UART_LCRH_WLEN8     ( 3 << 5 )
+
+/* Control register */
+#define RPI_UART_CR_UARTEN      ( 1 << 0 )
+#define RPI_UART_CR_TXE         ( 1 << 8 )
+#define RPI_UART_CR_RXE         ( 1 << 9 )
+
+/* FIFO interrupt levels, in eighths of the FIFO */
+#define RPI_UART_IFLS_1_8       0
+#define RPI_UART_IFLS_1_4       1
+#define RPI_UART_IFLS_1_2       2
+#define RPI_UART_IFLS_3_4       3
+#define RPI_UART_IFLS_7_8       4
+#define RPI_UART_IFLS_TX( x )   ( ( x ) << 0 )
+#define RPI_UART_IFLS_RX( x )   ( ( x ) << 3 )
+
+/* Interrupt mask, status and clear registers */
+#define RPI_UART_INT_RX         ( 1 << 4 )
+#define RPI_UART_INT_TX         ( 1 << 5 )
+#define RPI_UART_INT_RT         ( 1 << 6 )
+#define RPI_UART_INT_OE         ( 1 << 10 )
+#define RPI_UART_INT_ALL        0x7FF
+
+/* DMA control register */
+#define RPI_UART_DMACR_RXDMAE   ( 1 << 0 )
+#define RPI_UART_DMACR_TXDMAE   ( 1 << 1 )
+
+typedef struct {
+    rpi_reg_rw_t DR;
+    rpi_reg_rw_t RSRECR;
+    rpi_reg_ro_t reserved0[4];
+    rpi_reg_ro_t FR;
+    rpi_reg_ro_t reserved1;
+    rpi_reg_rw_t ILPR;
+    rpi_reg_rw_t IBRD;
+    rpi_reg_rw_t FBRD;
+    rpi_reg_rw_t LCRH;
+    rpi_reg_rw_t CR;
+    rpi_reg_rw_t IFLS;
+    rpi_reg_rw_t IMSC;
+    rpi_reg_ro_t RIS;
+    rpi_reg_ro_t MIS;
+    rpi_reg_wo_t ICR;
+    rpi_reg_rw_t DMACR;
+    } rpi_uart_t;
+
+/** @brief Size of the transmit ring, must be a power of two */
+#ifndef RPI_UART_TX_BUFFER_SIZE
+    #define RPI_UART_TX_BUFFER_SIZE     4096
+#endif
+
+/** @brief Size of the receive ring, must be a power of two */
+#ifndef RPI_UART_RX_BUFFER_SIZE
+    #define RPI_UART_RX_BUFFER_SIZE     1024
+#endif
+
+/** @brief What RPI_UartWrite() does when the transmit ring is full */
+typedef enum {
+    RPI_UART_TX_DROP = 0,       /**< Discard the new byte */
+    RPI_UART_TX_BLOCK,          /**< Wait for the IRQ to make space */
+    } rpi_uart_tx_mode_t;
+
+/** @brief What RPI_UartRead() does when nothing has been received */
+typedef enum {
+    RPI_UART_RX_NONBLOCK = 0,   /**< Return straight away with nothing */
+    RPI_UART_RX_BLOCK,          /**< Sleep until at least one byte arrives */
+    } rpi_uart_rx_mode_t;
+
+/** @brief PL011 transfer statistics, the same as the mini UART's with the
+    DMA transfers on the end */
+typedef struct {
+    uint32_t tx_bytes;          /**< Bytes handed to the FIFO */
+    uint32_t tx_dropped;        /**< Bytes lost to a full ring */
+    uint32_t tx_high_water;     /**< Most bytes ever queued in the ring */
+    uint32_t rx_bytes;          /**< Bytes taken from the FIFO */
+    uint32_t rx_dropped;        /**< Bytes lost to a full receive ring */
+    uint32_t rx_overruns;       /**< Times the hardware FIFO overflowed */
+    uint32_t tx_dma;            /**< DMA transfers started */
+    } rpi_uart_stats_t;
+
+/** @brief Called from the interrupt when bytes have been received or room
+    has been made in the transmit ring, so a task waiting on either can be
+    woken rather than spin */
+typedef void (*rpi_uart_notify_t)( void* param );
+
+extern int RPI_UartInit( int baud );
+extern int RPI_UartSetBaud( int baud );
+extern int RPI_UartEnableDma( void );
+extern void RPI_UartSetTxMode( rpi_uart_tx_mode_t mode );
+extern void RPI_UartSetRxMode( rpi_uart_rx_mode_t mode );
+extern void RPI_UartWrite( char c );
+extern int RPI_UartRead( char* buffer, int length );
+extern void RPI_UartFlush( void );
+extern int RPI_UartTxSpace( void );
+extern void RPI_UartSetNotify( rpi_uart_notify_t notify, void* param );
+extern const rpi_uart_stats_t* RPI_UartGetStats( void );
+extern void RPI_UartIrqHandler( void* param );
+
+#endif
@@ -0,0 +1,177 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arch/pmu.h"
+#include "arch/wcmem.h"
+
+#include "hal/systimer.h"
+
+#include "benchmark.h"
+
+static uint8_t source[BENCHMARK_BUFFER_SIZE] __attribute__((aligned(64)));
+/* With some slack on the end for the overlapping memmove */
+static uint8_t destination[BENCHMARK_BUFFER_SIZE + 64] __attribute__((aligned(64)));
+
+
+/**
+    @brief Time memcpy, memset and a plain read loop over the benchmark
+    buffers
+
+    Each test runs once to warm up whatever caches are on and is then timed
+    on a second pass, so the figures are the best case for the current
+    memory configuration. Needs pmu_init() to have been called.
+*/
+void benchmark_memory( benchmark_memory_t* result )
+{
+    volatile uint32_t sink;
+    const uint32_t* word;
+    uint32_t start, sum;
+    int pass, i;
+
+    for( pass = 0; pass < 2; pass++ )
+    {
+        start = pmu_cycles();
+        memset( destination, pass, BENCHMARK_BUFFER_SIZE );
+        result->memset_cycles = pmu_cycles() - start;
+
+        start = pmu_cycles();
+        memcpy( destination, source, BENCHMARK_BUFFER_SIZE );
+        result->memcpy_cycles = pmu_cycles() - start;
+
+        word = (const uint32_t*)source;
+        sum = 0;
+
+        start = pmu_cycles();
+        for( i = 0; i < BENCHMARK_BUFFER_SIZE / 4; i++ )
+            sum += word[i];
+        result->read_cycles = pmu_cycles() - start;
+
+        sink = sum;
+    }
+
+    (void)sink;
+}
+
+
+void benchmark_memory_print( const char* label, const benchmark_memory_t* result )
+{
+    printf( "%s: %dKB memcpy %u, memset %u, read %u cycles\r\n", label,
+            BENCHMARK_BUFFER_SIZE / 1024,
+            (unsigned int)result->memcpy_cycles,
+            (unsigned int)result->memset_cycles,
+            (unsigned int)result->read_cycles );
+}
+
+
+/* Size classes the string routines are timed at */
+static const uint32_t string_sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+
+#define STRING_SIZES    (int)( sizeof( string_sizes ) / sizeof( string_sizes[0] ) )
+
+typedef enum {
+    STRING_MEMCPY,
+    STRING_MEMMOVE,
+    STRING_MEMSET,
+    STRING_MEMCPY_WC,
+    STRING_MEMSET_WC,
+    } string_test_t;
+
+
+/**
+    @brief Time one routine at one size, repeated until BENCHMARK_STRING_BYTES
+    have been moved
+
+    @return Throughput in MB/s, as bytes per microsecond
+*/
+static uint32_t string_rate( string_test_t test, uint8_t* dst, uint32_t size )
+{
+    uint32_t count = BENCHMARK_STRING_BYTES / size;
+    uint32_t start, elapsed, i;
+
+    start = RPI_GetSystemTimer()->counter_lo;
+
+    for( i = 0; i < count; i++ )
+    {
+        switch( test )
+        {
+            case STRING_MEMCPY:
+                memcpy( dst, source, size );
+                break;
+
+            /* Overlapping by a few bytes so the copy has to go backwards */
+            case STRING_MEMMOVE:
+                memmove( dst + 8, dst, size );
+                break;
+
+            case STRING_MEMSET:
+                memset( dst, i, size );
+                break;
+
+            case STRING_MEMCPY_WC:
+                memcpy_wc( dst, source, size );
+                break;
+
+            case STRING_MEMSET_WC:
+                memset_wc( dst, i, size );
+                break;
+        }
+    }
+
+    elapsed = RPI_GetSystemTimer()->counter_lo - start;
+
+    return ( count * size ) / ( elapsed ? elapsed : 1 );
+}
+
+
+static void string_row( const char* label, string_test_t test, uint8_t* dst )
+{
+    int i;
+
+    printf( "%-14s", label );
+
+    for( i = 0; i < STRING_SIZES; i++ )
+        printf( " %6u", (unsigned int)string_rate( test, dst, string_sizes[i] ) );
+
+    printf( "\r\n" );
+}
+
+
+/**
+    @brief Report the throughput of the string routines in MB/s for each size
+    class, in cached memory and into a write-combined buffer such as a
+    framebuffer page
+
+    The write-combined buffer is scribbled over, it must be at least
+    BENCHMARK_BUFFER_SIZE bytes or it is skipped.
+*/
+void benchmark_string( uint8_t* wc, uint32_t wc_size )
+{
+    int i;
+
+    printf( "String MB/s    " );
+
+    for( i = 0; i < STRING_SIZES; i++ )
+        printf( " %6u", (unsigned int)string_sizes[i] );
+
+    printf( "\r\n" );
+
+    string_row( "memcpy", STRING_MEMCPY, destination );
+    string_row( "memmove", STRING_MEMMOVE, destination );
+    string_row( "memset", STRING_MEMSET, destination );
+
+    if( ( wc == NULL ) || ( wc_size < BENCHMARK_BUFFER_SIZE ) )
+        return;
+
+    string_row( "memcpy fb", STRING_MEMCPY, wc );
+    string_row( "memcpy_wc fb", STRING_MEMCPY_WC, wc );
+    string_row( "memset fb", STRING_MEMSET, wc );
+    string_row( "memset_wc fb", STRING_MEMSET_WC, wc );
+}
@@ -0,0 +1,32 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_BENCHMARK_H
+#define KERNEL_BENCHMARK_H
+
+#include <stdint.h>
+
+/** @brief Size of each of the two benchmark buffers, bigger than the L1
+    data cache but small enough to fit in the L2 */
+#define BENCHMARK_BUFFER_SIZE   ( 64 * 1024 )
+
+/** @brief Cycles taken for one pass over a benchmark buffer */
+typedef struct {
+    uint32_t memcpy_cycles;
+    uint32_t memset_cycles;
+    uint32_t read_cycles;
+    } benchmark_memory_t;
+
+/** @brief Bytes moved by each string routine for every size class, enough
+    to take a few milliseconds at the fastest */
+#define BENCHMARK_STRING_BYTES  ( 4 * 1024 * 1024 )
+
+extern void benchmark_memory( benchmark_memory_t* result );
+extern void benchmark_memory_print( const char* label, const benchmark_memory_t* result );
+extern void benchmark_string( uint8_t* wc, uint32_t wc_size );
+
+#endif
@@ -0,0 +1,80 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stdint.h>
+
+#include "hal/interrupts.h"
+#include "hal/systimer.h"
+
+#include "kernel/clock.h"
+
+clock_calibration_t clock_calibration;
+
+
+/**
+    @brief Wait for the system timer to tick over and read the generic timer
+    straight after, so the pair were read as near together as possible
+
+    @return The system time at the edge
+*/
+static uint64_t clock_edge( uint64_t* ticks )
+{
+    uint64_t start = RPI_GetSystemTime();
+    uint64_t now;
+
+    while( ( now = RPI_GetSystemTime() ) == start )
+    {
+        /* BLANK */
+    }
+
+    *ticks = gtimer_count();
+
+    return now;
+}
+
+
+/**
+    @brief Measure the generic timer's rate against the system timer
+
+    CNTFRQ is only what the boot code claims the counter runs at, so it is
+    kept for comparison but the measured rate is what's used. Takes
+    CLOCK_CALIBRATE_US with interrupts off.
+*/
+void clock_init( void )
+{
+    uint64_t start_ticks;
+    uint64_t end_ticks;
+    uint64_t start_us;
+    uint64_t end_us;
+    uint32_t frequency;
+    uint32_t cpsr = RPI_InterruptsSave();
+
+    clock_calibration.reported = gtimer_frequency();
+
+    start_us = clock_edge( &start_ticks );
+
+    while( RPI_GetSystemTime() < ( start_us + CLOCK_CALIBRATE_US ) )
+    {
+        /* BLANK */
+    }
+
+    end_us = clock_edge( &end_ticks );
+
+    RPI_InterruptsRestore( cpsr );
+
+    frequency = (uint32_t)( ( ( end_ticks - start_ticks ) * 1000000 ) / ( end_us - start_us ) );
+
+    /* A counter that isn't running, or is too slow to be any use */
+    if( frequency <= 1000000 )
+        frequency = clock_calibration.reported;
+
+    clock_calibration.frequency = frequency;
+    clock_calibration.us_mult = ( frequency > 1000000 ) ?
+        (uint32_t)( ( 1000000ULL << 32 ) / frequency ) : 0;
+    clock_calibration.base_ticks = end_ticks;
+    clock_calibration.base_us = end_us;
+}
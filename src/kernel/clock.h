@@ -0,0 +1,80 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_CLOCK_H
+#define KERNEL_CLOCK_H
+
+#include <stdint.h>
+
+#include "arch/gtimer.h"
+#include "hal/systimer.h"
+
+/* Two clocks for timestamps:
+
+   - clock_time_us() is the 64 bit system timer, microseconds since boot
+     that never wrap, but every read is an uncached peripheral access.
+
+   - clock_ticks() is the generic timer count, a CP15 read costing a few
+     cycles on any core, for the timestamps instrumentation takes all the
+     time. clock_ticks_to_us() and clock_ticks_to_time_us() turn them into
+     microseconds using the rate measured by clock_init() */
+
+/** @brief How long clock_init() spends measuring the generic timer against
+    the system timer */
+#define CLOCK_CALIBRATE_US      10000
+
+typedef struct {
+    /** CNTFRQ as the boot code left it */
+    uint32_t reported;
+
+    /** The rate actually measured against the system timer, in Hz. Must be
+        over 1MHz so a tick is less than a microsecond */
+    uint32_t frequency;
+
+    /** Microseconds per tick in 0.32 fixed point */
+    uint32_t us_mult;
+
+    /** A tick count and the system time it was read at, so ticks can be
+        placed on the system timer's timeline */
+    uint64_t base_ticks;
+    uint64_t base_us;
+    } clock_calibration_t;
+
+extern clock_calibration_t clock_calibration;
+
+extern void clock_init( void );
+
+
+/** @brief Microseconds since boot from the system timer */
+static inline uint64_t clock_time_us( void )
+{
+    return RPI_GetSystemTime();
+}
+
+/** @brief A cheap timestamp in generic timer ticks, comparable across cores */
+static inline uint64_t clock_ticks( void )
+{
+    return gtimer_count();
+}
+
+/** @brief Length of a number of ticks in microseconds. The multiply is
+    split in two so it can't overflow */
+static inline uint64_t clock_ticks_to_us( uint64_t ticks )
+{
+    uint64_t mult = clock_calibration.us_mult;
+
+    return ( ( ticks >> 32 ) * mult ) + ( ( ( ticks & 0xFFFFFFFF ) * mult ) >> 32 );
+}
+
+/** @brief The system time a tick count was taken at, in microseconds since
+    boot */
+static inline uint64_t clock_ticks_to_time_us( uint64_t ticks )
+{
+    return clock_calibration.base_us + clock_ticks_to_us( ticks - clock_calibration.base_ticks );
+}
+
+#endif
@@ -0,0 +1,274 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <arm_neon.h>
+#include <stdint.h>
+
+#include "gradient.h"
+
+/* The blue component only depends on x, and alpha mirrors blue, so every row
+   of the gradient is the same ramp OR'd with a red/green value that is
+   constant across that row. Pre-compute the ramp once per mode in each of the
+   supported pixel formats and the per-frame work collapses to a wide OR and
+   store for every row. */
+static uint16_t ramp16[GRADIENT_MAX_WIDTH] __attribute__((aligned(16)));
+static uint8_t ramp24[GRADIENT_MAX_WIDTH] __attribute__((aligned(16)));
+static uint32_t ramp32[GRADIENT_MAX_WIDTH] __attribute__((aligned(16)));
+
+/* Red increments by this much on every row */
+static fixed_t red_step;
+
+
+/**
+    @brief Pre-compute the per-column ramps for a render target
+
+    @return 0 on success, -1 if the target cannot be rendered by the fill
+            engine (empty, too wide or an unsupported depth)
+*/
+int gradient_init( const gradient_target_t* target )
+{
+    fixed_t b_fx = 0;
+    fixed_t b_step;
+    int x, b;
+
+    if( ( target->width <= 0 ) || ( target->width > GRADIENT_MAX_WIDTH ) )
+        return -1;
+
+    if( target->height <= 0 )
+        return -1;
+
+    if( ( target->bpp != 16 ) && ( target->bpp != 24 ) && ( target->bpp != 32 ) )
+        return -1;
+
+    b_step = FX_ONE / target->width;
+    red_step = FX_ONE / target->height;
+
+    for( x = 0; x < target->width; x++ )
+    {
+        b = FX_TO_U8( b_fx );
+
+        /* RGB565 */
+        ramp16[x] = b >> 3;
+
+        /* Bytes R, G, B */
+        ramp24[x] = b;
+
+        /* Bytes R, G, B, A (little-endian word) with alpha following blue */
+        ramp32[x] = ( b << 16 ) | ( b << 24 );
+
+        b_fx += b_step;
+    }
+
+    return 0;
+}
+
+
+static void render16( const gradient_target_t* target, int g, int first, int last )
+{
+    fixed_t r_fx = first * red_step;
+    uint16x8_t rg8, p0, p1;
+    uint16_t* row;
+    uint16_t rg;
+    int x, y, r;
+
+    for( y = first; y < last; y++ )
+    {
+        r_fx += red_step;
+        r = FX_TO_U8( r_fx );
+
+        rg = ( ( r >> 3 ) << 11 ) | ( ( g >> 2 ) << 5 );
+        rg8 = vdupq_n_u16( rg );
+        row = (uint16_t*)( target->fb + ( y * target->pitch ) );
+
+        /* 16 pixels (32 bytes) per iteration */
+        for( x = 0; x <= target->width - 16; x += 16 )
+        {
+            p0 = vorrq_u16( vld1q_u16( &ramp16[x] ), rg8 );
+            p1 = vorrq_u16( vld1q_u16( &ramp16[x + 8] ), rg8 );
+            vst1q_u16( &row[x], p0 );
+            vst1q_u16( &row[x + 8], p1 );
+        }
+
+        for( ; x < target->width; x++ )
+            row[x] = rg | ramp16[x];
+    }
+}
+
+
+static void render24( const gradient_target_t* target, int g, int first, int last )
+{
+    fixed_t r_fx = first * red_step;
+    uint8x16x3_t rgb;
+    uint8_t* row;
+    int x, y, r;
+
+    rgb.val[1] = vdupq_n_u8( g );
+
+    for( y = first; y < last; y++ )
+    {
+        r_fx += red_step;
+        r = FX_TO_U8( r_fx );
+
+        rgb.val[0] = vdupq_n_u8( r );
+        row = target->fb + ( y * target->pitch );
+
+        /* 16 pixels (48 bytes) per iteration, interleaved by the store */
+        for( x = 0; x <= target->width - 16; x += 16 )
+        {
+            rgb.val[2] = vld1q_u8( &ramp24[x] );
+            vst3q_u8( &row[x * 3], rgb );
+        }
+
+        for( ; x < target->width; x++ )
+        {
+            row[( x * 3 ) + 0] = r;
+            row[( x * 3 ) + 1] = g;
+            row[( x * 3 ) + 2] = ramp24[x];
+        }
+    }
+}
+
+
+static void render32( const gradient_target_t* target, int g, int first, int last )
+{
+    fixed_t r_fx = first * red_step;
+    uint32x4_t rg4, p0, p1;
+    uint32_t* row;
+    uint32_t rg;
+    int x, y, r;
+
+    for( y = first; y < last; y++ )
+    {
+        r_fx += red_step;
+        r = FX_TO_U8( r_fx );
+
+        rg = r | ( g << 8 );
+        rg4 = vdupq_n_u32( rg );
+        row = (uint32_t*)( target->fb + ( y * target->pitch ) );
+
+        /* 8 pixels (32 bytes) per iteration */
+        for( x = 0; x <= target->width - 8; x += 8 )
+        {
+            p0 = vorrq_u32( vld1q_u32( &ramp32[x] ), rg4 );
+            p1 = vorrq_u32( vld1q_u32( &ramp32[x + 4] ), rg4 );
+            vst1q_u32( &row[x], p0 );
+            vst1q_u32( &row[x + 4], p1 );
+        }
+
+        for( ; x < target->width; x++ )
+            row[x] = rg | ramp32[x];
+    }
+}
+
+
+/**
+    @brief Render rows first to last - 1 of a frame with the fill engine
+
+    The target must have been passed to gradient_init() first. Every row only
+    depends on its own number, so separate row ranges can be rendered
+    concurrently.
+*/
+void gradient_render_rows( const gradient_target_t* target, fixed_t green, int first, int last )
+{
+    int g = FX_TO_U8( green );
+
+    if( first < 0 )
+        first = 0;
+
+    if( last > target->height )
+        last = target->height;
+
+    switch( target->bpp )
+    {
+        case 16:
+            render16( target, g, first, last );
+            break;
+
+        case 24:
+            render24( target, g, first, last );
+            break;
+
+        case 32:
+            render32( target, g, first, last );
+            break;
+
+        default:
+            /* Palette mode is not supported by the fill engine */
+            break;
+    }
+}
+
+
+/**
+    @brief Render a frame of the gradient with the fill engine
+
+    The target must have been passed to gradient_init() first. Red ramps
+    from top to bottom, blue (and alpha) from left to right and green is
+    constant across the frame.
+*/
+void gradient_render( const gradient_target_t* target, fixed_t green )
+{
+    gradient_render_rows( target, green, 0, target->height );
+}
+
+
+/**
+    @brief The original per-pixel floating point renderer
+
+    Kept so the fill engine can be compared against it, build with
+    RENDER_REFERENCE=1 to have kernel_main use it instead.
+*/
+void gradient_render_reference( const gradient_target_t* target, fixed_t green )
+{
+    volatile unsigned char* fb = target->fb;
+    int width = target->width, height = target->height;
+    int bpp = target->bpp, pitch = target->pitch;
+    float cr = 0, cg = (float)green / FX_ONE, cb;
+    int x, y, pixel_offset;
+    int r, g, b, a;
+
+    /* Produce a colour spread across the screen */
+    for( y = 0; y < height; y++ )
+    {
+        cr += ( 1.0 / height );
+        cb = 0;
+
+        for( x = 0; x < width; x++ )
+        {
+            pixel_offset = ( x * ( bpp >> 3 ) ) + ( y * pitch );
+
+            r = (int)( cr * 0xFF ) & 0xFF;
+            g = (int)( cg * 0xFF ) & 0xFF;
+            b = (int)( cb * 0xFF ) & 0xFF;
+            a = (int)( cb * 0xFF ) & 0xFF;
+
+            if( bpp == 32 )
+            {
+                /* Four bytes to write */
+                fb[ pixel_offset++ ] = r;
+                fb[ pixel_offset++ ] = g;
+                fb[ pixel_offset++ ] = b;
+                fb[ pixel_offset++ ] = a;
+            }
+            else if( bpp == 24 )
+            {
+                /* Three bytes to write */
+                fb[ pixel_offset++ ] = r;
+                fb[ pixel_offset++ ] = g;
+                fb[ pixel_offset++ ] = b;
+            }
+            else if( bpp == 16 )
+            {
+                /* Two bytes to write */
+                /* Bit pack RGB565 into the 16-bit pixel offset */
+                *(unsigned short*)&fb[pixel_offset] = ( (r >> 3) << 11 ) | ( ( g >> 2 ) << 5 ) | ( b >> 3 );
+            }
+
+            cb += ( 1.0 / width );
+        }
+    }
+}
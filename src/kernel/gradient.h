@@ -0,0 +1,40 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_GRADIENT_H
+#define KERNEL_GRADIENT_H
+
+#include <stdint.h>
+
+/** @brief The widest row the fill engine keeps a pre-computed ramp for */
+#define GRADIENT_MAX_WIDTH      1920
+
+/** @brief 16.16 fixed point colour channel value, 0 to FX_ONE inclusive */
+typedef int32_t fixed_t;
+
+#define FX_SHIFT                16
+#define FX_ONE                  ( 1 << FX_SHIFT )
+#define FX_FROM_FLOAT(f)        ( (fixed_t)( (f) * FX_ONE ) )
+
+/** @brief Convert a fixed point channel into an 8-bit colour component */
+#define FX_TO_U8(fx)            ( ( ( (fx) * 0xFF ) >> FX_SHIFT ) & 0xFF )
+
+/** @brief Description of the pixels the gradient is rendered into */
+typedef struct {
+    uint8_t* fb;
+    int width;
+    int height;
+    int pitch;
+    int bpp;
+    } gradient_target_t;
+
+extern int gradient_init( const gradient_target_t* target );
+extern void gradient_render( const gradient_target_t* target, fixed_t green );
+extern void gradient_render_rows( const gradient_target_t* target, fixed_t green, int first, int last );
+extern void gradient_render_reference( const gradient_target_t* target, fixed_t green );
+
+#endif
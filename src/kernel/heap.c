@@ -0,0 +1,678 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arch/spinlock.h"
+#include "hal/interrupts.h"
+
+#include "heap.h"
+
+/* A two-level segregated fit allocator. Free blocks are kept in lists by
+   size: the first level splits sizes by power of two, the second splits
+   each power of two into HEAP_SL_COUNT equal ranges. A bitmap at each level
+   says which lists have something in them, so finding a big enough block is
+   a couple of bit scans and malloc and free take the same time whatever the
+   state of the heap.
+
+   Every block starts with an 8 byte header, the payload follows. Blocks are
+   laid out back to back in each region, which ends with a zero sized block
+   that is never free so nothing merges past the end. */
+typedef struct heap_block {
+    /** The block before this one in memory, NULL for the first */
+    struct heap_block* prev_phys;
+
+    /** Payload size in bytes, always a multiple of HEAP_ALIGN, with
+        BLOCK_FREE in the bottom bit */
+    uint32_t size;
+
+    /** Only valid while the block is free, the links of its free list.
+        These are the first bytes of the payload */
+    struct heap_block* next_free;
+    struct heap_block* prev_free;
+    } heap_block_t;
+
+#define BLOCK_FREE          0x1
+#define BLOCK_HEADER        offsetof( heap_block_t, next_free )
+
+/* A free block has to hold its list links */
+#define BLOCK_SIZE_MIN      ( sizeof( heap_block_t ) - BLOCK_HEADER )
+
+/* Requests are rounded up to the next list boundary when searching, keep
+   that below the largest block the lists can describe */
+#define BLOCK_SIZE_MAX      ( 1u << ( HEAP_FL_MAX - 1 ) )
+
+static uint32_t fl_bitmap;
+static uint32_t sl_bitmap[HEAP_FL_COUNT];
+static heap_block_t* blocks[HEAP_FL_COUNT][HEAP_SL_COUNT];
+
+static heap_stats_t stats;
+
+/* The heap is shared between the cores, and masking interrupts as well
+   keeps an IRQ handler on this core from deadlocking against the lock */
+static spinlock_t heap_lock = SPINLOCK_UNLOCKED;
+
+
+/**
+    @brief Index of the most significant set bit, x must not be zero
+*/
+static inline int heap_fls( uint32_t x )
+{
+    return 31 - __builtin_clz( x );
+}
+
+
+static inline uint32_t block_size( const heap_block_t* block )
+{
+    return block->size & ~BLOCK_FREE;
+}
+
+
+static inline int block_is_free( const heap_block_t* block )
+{
+    return block->size & BLOCK_FREE;
+}
+
+
+static inline void* block_to_ptr( heap_block_t* block )
+{
+    return (uint8_t*)block + BLOCK_HEADER;
+}
+
+
+static inline heap_block_t* block_from_ptr( void* ptr )
+{
+    return (heap_block_t*)( (uint8_t*)ptr - BLOCK_HEADER );
+}
+
+
+static inline heap_block_t* block_next( heap_block_t* block )
+{
+    return (heap_block_t*)( (uint8_t*)block_to_ptr( block ) + block_size( block ) );
+}
+
+
+/**
+    @brief The list a free block of this size belongs in
+*/
+static inline void mapping_insert( uint32_t size, int* fl, int* sl )
+{
+    int f;
+
+    if( size < HEAP_SMALL_BLOCK )
+    {
+        *fl = 0;
+        *sl = size / ( HEAP_SMALL_BLOCK / HEAP_SL_COUNT );
+    }
+    else
+    {
+        f = heap_fls( size );
+        *sl = ( size >> ( f - HEAP_SL_LOG2 ) ) ^ HEAP_SL_COUNT;
+        *fl = f - ( HEAP_FL_SHIFT - 1 );
+    }
+}
+
+
+/**
+    @brief The first list where every block is at least size bytes. The size
+    is rounded up to the next list boundary so any block in the list will do
+*/
+static inline void mapping_search( uint32_t size, int* fl, int* sl )
+{
+    if( size >= HEAP_SMALL_BLOCK )
+        size += ( 1 << ( heap_fls( size ) - HEAP_SL_LOG2 ) ) - 1;
+
+    mapping_insert( size, fl, sl );
+}
+
+
+/**
+    @brief Find a non-empty list at or above fl, sl using the bitmaps
+
+    @return The first block in the list, NULL if nothing is big enough
+*/
+static heap_block_t* search_suitable_block( int* fl, int* sl )
+{
+    uint32_t sl_map = sl_bitmap[*fl] & ( ~0u << *sl );
+    uint32_t fl_map;
+
+    if( !sl_map )
+    {
+        /* Nothing left at this power of two, go up to the next one that has
+           a free block */
+        fl_map = fl_bitmap & ( ~0u << ( *fl + 1 ) );
+        if( !fl_map )
+            return NULL;
+
+        *fl = __builtin_ctz( fl_map );
+        sl_map = sl_bitmap[*fl];
+    }
+
+    *sl = __builtin_ctz( sl_map );
+
+    return blocks[*fl][*sl];
+}
+
+
+static void remove_free_block( heap_block_t* block, int fl, int sl )
+{
+    heap_block_t* prev = block->prev_free;
+    heap_block_t* next = block->next_free;
+
+    if( next )
+        next->prev_free = prev;
+
+    if( prev )
+    {
+        prev->next_free = next;
+    }
+    else
+    {
+        blocks[fl][sl] = next;
+
+        if( next == NULL )
+        {
+            sl_bitmap[fl] &= ~( 1u << sl );
+
+            if( sl_bitmap[fl] == 0 )
+                fl_bitmap &= ~( 1u << fl );
+        }
+    }
+}
+
+
+static void insert_free_block( heap_block_t* block, int fl, int sl )
+{
+    heap_block_t* head = blocks[fl][sl];
+
+    block->next_free = head;
+    block->prev_free = NULL;
+
+    if( head )
+        head->prev_free = block;
+
+    blocks[fl][sl] = block;
+    fl_bitmap |= ( 1u << fl );
+    sl_bitmap[fl] |= ( 1u << sl );
+}
+
+
+static void block_remove( heap_block_t* block )
+{
+    int fl, sl;
+
+    mapping_insert( block_size( block ), &fl, &sl );
+    remove_free_block( block, fl, sl );
+}
+
+
+static void block_insert( heap_block_t* block )
+{
+    int fl, sl;
+
+    mapping_insert( block_size( block ), &fl, &sl );
+    insert_free_block( block, fl, sl );
+}
+
+
+/**
+    @brief Cut a block down to size bytes if what is left over is big enough
+    to be a block of its own
+
+    @return The remainder, not yet on a free list, or NULL
+*/
+static heap_block_t* block_split( heap_block_t* block, uint32_t size )
+{
+    heap_block_t* remaining;
+    uint32_t flags = block->size & BLOCK_FREE;
+
+    if( block_size( block ) < ( size + BLOCK_HEADER + BLOCK_SIZE_MIN ) )
+        return NULL;
+
+    remaining = (heap_block_t*)( (uint8_t*)block_to_ptr( block ) + size );
+    remaining->prev_phys = block;
+    remaining->size = ( block_size( block ) - size - BLOCK_HEADER ) | BLOCK_FREE;
+    block_next( remaining )->prev_phys = remaining;
+
+    block->size = size | flags;
+
+    return remaining;
+}
+
+
+/**
+    @brief Join a block with the block after it, the second block is gone
+    afterwards
+*/
+static heap_block_t* block_absorb( heap_block_t* block, heap_block_t* next )
+{
+    block->size += block_size( next ) + BLOCK_HEADER;
+    block_next( block )->prev_phys = block;
+
+    return block;
+}
+
+
+/**
+    @brief Mark a block free, merging it with free neighbours, and put the
+    result on a free list
+*/
+static void block_release( heap_block_t* block )
+{
+    heap_block_t* prev = block->prev_phys;
+    heap_block_t* next = block_next( block );
+
+    block->size |= BLOCK_FREE;
+
+    if( prev && block_is_free( prev ) )
+    {
+        block_remove( prev );
+        block = block_absorb( prev, block );
+    }
+
+    if( block_is_free( next ) )
+    {
+        block_remove( next );
+        block = block_absorb( block, next );
+    }
+
+    block_insert( block );
+}
+
+
+/**
+    @brief Trim a block down to size, giving back the remainder
+*/
+static void block_trim( heap_block_t* block, uint32_t size )
+{
+    heap_block_t* remaining = block_split( block, size );
+
+    if( remaining )
+        block_release( remaining );
+}
+
+
+/**
+    @brief Round a request up to a block size
+
+    @return The size, 0 if the request is too big to ever be satisfied
+*/
+static inline uint32_t adjust_size( size_t size )
+{
+    if( size >= BLOCK_SIZE_MAX )
+        return 0;
+
+    if( size < BLOCK_SIZE_MIN )
+        size = BLOCK_SIZE_MIN;
+
+    return ( size + ( HEAP_ALIGN - 1 ) ) & ~( HEAP_ALIGN - 1 );
+}
+
+
+static inline void account_alloc( heap_block_t* block )
+{
+    stats.allocs++;
+    stats.used += block_size( block );
+
+    if( stats.used > stats.peak )
+        stats.peak = stats.used;
+}
+
+
+static inline void account_free( heap_block_t* block )
+{
+    stats.frees++;
+    stats.used -= block_size( block );
+}
+
+
+/**
+    @brief Take a free block of at least size bytes off its list and cut it
+    down to size. Called with the lock held
+*/
+static heap_block_t* block_locate( uint32_t size )
+{
+    heap_block_t* block;
+    int fl, sl;
+
+    if( size == 0 )
+        return NULL;
+
+    mapping_search( size, &fl, &sl );
+
+    if( fl >= HEAP_FL_COUNT )
+        return NULL;
+
+    if( ( block = search_suitable_block( &fl, &sl ) ) == NULL )
+        return NULL;
+
+    remove_free_block( block, fl, sl );
+    block->size &= ~BLOCK_FREE;
+    block_trim( block, size );
+
+    return block;
+}
+
+
+static inline uint32_t heap_lock_take( void )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+
+    spin_lock( &heap_lock );
+
+    return cpsr;
+}
+
+
+static inline void heap_lock_give( uint32_t cpsr )
+{
+    spin_unlock( &heap_lock );
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+/**
+    @brief Put one region of no more than BLOCK_SIZE_MAX bytes on the heap
+*/
+static int add_region( uintptr_t start, uintptr_t end )
+{
+    heap_block_t* block;
+    heap_block_t* sentinel;
+    uint32_t cpsr;
+
+    if( end <= start + ( 2 * BLOCK_HEADER ) + BLOCK_SIZE_MIN )
+        return -1;
+
+    /* One free block for everything but the two headers */
+    block = (heap_block_t*)start;
+    block->prev_phys = NULL;
+    block->size = ( end - start - ( 2 * BLOCK_HEADER ) ) | BLOCK_FREE;
+
+    sentinel = block_next( block );
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+
+    cpsr = heap_lock_take();
+    block_insert( block );
+    stats.total += end - start;
+    heap_lock_give( cpsr );
+
+    return 0;
+}
+
+
+/**
+    @brief Give a region of memory to the heap. Regions bigger than the
+    largest block are added in pieces
+
+    @return 0 on success, -1 if the region is too small to hold a block
+*/
+int heap_add_region( void* base, size_t size )
+{
+    uintptr_t start = ( (uintptr_t)base + ( HEAP_ALIGN - 1 ) ) & ~( HEAP_ALIGN - 1 );
+    uintptr_t end = ( (uintptr_t)base + size ) & ~( HEAP_ALIGN - 1 );
+    uintptr_t piece;
+    int result = -1;
+
+    while( start < end )
+    {
+        piece = end - start;
+        if( piece > ( BLOCK_SIZE_MAX - HEAP_ALIGN ) )
+            piece = BLOCK_SIZE_MAX - HEAP_ALIGN;
+
+        if( add_region( start, start + piece ) == 0 )
+            result = 0;
+
+        start += piece;
+    }
+
+    return result;
+}
+
+
+/**
+    @brief Start the heap off with a single region, forgetting anything it
+    had before
+
+    The lock relies on the exclusive monitors, so nothing can be allocated
+    until the MMU is on.
+*/
+void heap_init( void* base, size_t size )
+{
+    fl_bitmap = 0;
+    memset( sl_bitmap, 0, sizeof( sl_bitmap ) );
+    memset( blocks, 0, sizeof( blocks ) );
+    memset( &stats, 0, sizeof( stats ) );
+
+    heap_add_region( base, size );
+}
+
+
+void* heap_malloc( size_t size )
+{
+    heap_block_t* block;
+    uint32_t cpsr = heap_lock_take();
+
+    if( ( block = block_locate( adjust_size( size ) ) ) )
+        account_alloc( block );
+    else
+        stats.failures++;
+
+    heap_lock_give( cpsr );
+
+    return block ? block_to_ptr( block ) : NULL;
+}
+
+
+/**
+    @brief Allocate with an alignment bigger than HEAP_ALIGN, which must be a
+    power of two
+*/
+void* heap_memalign( size_t align, size_t size )
+{
+    uint32_t adjust = adjust_size( size );
+    heap_block_t* block;
+    heap_block_t* aligned;
+    uintptr_t ptr, gap;
+    uint32_t cpsr;
+
+    if( align <= HEAP_ALIGN )
+        return heap_malloc( size );
+
+    /* Enough for the request, the worst case padding in front and a free
+       block to hold the padding */
+    cpsr = heap_lock_take();
+
+    block = NULL;
+    if( adjust && ( align < BLOCK_SIZE_MAX ) )
+        block = block_locate( adjust_size( adjust + align + BLOCK_HEADER + BLOCK_SIZE_MIN ) );
+
+    if( block == NULL )
+    {
+        stats.failures++;
+        heap_lock_give( cpsr );
+        return NULL;
+    }
+
+    ptr = (uintptr_t)block_to_ptr( block );
+    gap = ( ( ptr + ( align - 1 ) ) & ~( align - 1 ) ) - ptr;
+
+    /* The padding has to be big enough to become a free block */
+    while( ( gap != 0 ) && ( gap < ( BLOCK_HEADER + BLOCK_SIZE_MIN ) ) )
+        gap += align;
+
+    if( gap )
+    {
+        aligned = (heap_block_t*)( ptr + gap - BLOCK_HEADER );
+        aligned->prev_phys = block;
+        aligned->size = block_size( block ) - gap;
+        block_next( aligned )->prev_phys = aligned;
+
+        block->size = gap - BLOCK_HEADER;
+        block_release( block );
+
+        block = aligned;
+    }
+
+    block_trim( block, adjust );
+    account_alloc( block );
+
+    heap_lock_give( cpsr );
+
+    return block_to_ptr( block );
+}
+
+
+void heap_free( void* ptr )
+{
+    heap_block_t* block;
+    uint32_t cpsr;
+
+    if( ptr == NULL )
+        return;
+
+    block = block_from_ptr( ptr );
+
+    cpsr = heap_lock_take();
+    account_free( block );
+    block_release( block );
+    heap_lock_give( cpsr );
+}
+
+
+/**
+    @brief Resize an allocation, in place if the block or the free block
+    after it is big enough
+*/
+void* heap_realloc( void* ptr, size_t size )
+{
+    uint32_t adjust = adjust_size( size );
+    heap_block_t* block;
+    heap_block_t* next;
+    void* moved;
+    uint32_t cpsr;
+
+    if( ptr == NULL )
+        return heap_malloc( size );
+
+    if( size == 0 )
+    {
+        heap_free( ptr );
+        return NULL;
+    }
+
+    if( adjust == 0 )
+        return NULL;
+
+    block = block_from_ptr( ptr );
+    next = block_next( block );
+
+    cpsr = heap_lock_take();
+
+    if( ( adjust > block_size( block ) ) && block_is_free( next ) &&
+        ( ( block_size( block ) + block_size( next ) + BLOCK_HEADER ) >= adjust ) )
+    {
+        block_remove( next );
+        stats.used -= block_size( block );
+        block_absorb( block, next );
+        stats.used += block_size( block );
+    }
+
+    if( adjust <= block_size( block ) )
+    {
+        stats.used -= block_size( block );
+        block_trim( block, adjust );
+        stats.used += block_size( block );
+
+        if( stats.used > stats.peak )
+            stats.peak = stats.used;
+
+        heap_lock_give( cpsr );
+        return ptr;
+    }
+
+    heap_lock_give( cpsr );
+
+    /* No room where it is, move it */
+    if( ( moved = heap_malloc( size ) ) == NULL )
+        return NULL;
+
+    memcpy( moved, ptr, block_size( block ) );
+    heap_free( ptr );
+
+    return moved;
+}
+
+
+size_t heap_usable_size( void* ptr )
+{
+    return ptr ? block_size( block_from_ptr( ptr ) ) : 0;
+}
+
+
+const heap_stats_t* heap_get_stats( void )
+{
+    return &stats;
+}
+
+
+/**
+    @brief Total free space and the largest single free block, the ratio of
+    the two shows how fragmented the heap is. This walks the free lists so
+    isn't constant time
+*/
+void heap_free_space( uint32_t* free_bytes, uint32_t* largest )
+{
+    heap_block_t* block;
+    uint32_t cpsr;
+    int fl, sl;
+
+    *free_bytes = 0;
+    *largest = 0;
+
+    cpsr = heap_lock_take();
+
+    for( fl = 0; fl < HEAP_FL_COUNT; fl++ )
+    {
+        for( sl = 0; sl < HEAP_SL_COUNT; sl++ )
+        {
+            for( block = blocks[fl][sl]; block; block = block->next_free )
+            {
+                *free_bytes += block_size( block );
+
+                if( block_size( block ) > *largest )
+                    *largest = block_size( block );
+            }
+        }
+    }
+
+    heap_lock_give( cpsr );
+}
+
+
+void heap_dump( void )
+{
+    uint32_t free, largest;
+
+    heap_free_space( &free, &largest );
+
+    printf( "Heap: %u bytes, %u used, %u peak\r\n",
+            (unsigned int)stats.total, (unsigned int)stats.used,
+            (unsigned int)stats.peak );
+    printf( "Heap: %u allocs, %u frees, %u failed\r\n",
+            (unsigned int)stats.allocs, (unsigned int)stats.frees,
+            (unsigned int)stats.failures );
+
+    /* Fragmentation is the share of the free space that can't be had in a
+       single allocation */
+    printf( "Heap: %u free, largest block %u, %u%% fragmented\r\n",
+            (unsigned int)free, (unsigned int)largest,
+            free ? (unsigned int)( 100 - (uint32_t)( ( (uint64_t)largest * 100 ) / free ) ) : 0 );
+}
@@ -0,0 +1,58 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_HEAP_H
+#define KERNEL_HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Alignment of every allocation, as the EABI requires of malloc */
+#define HEAP_ALIGN              8
+
+/** @brief Size of the region after _end the heap starts with, before the
+    firmware has told us how much memory the ARM has */
+#define HEAP_BOOT_SIZE          ( 1024 * 1024 )
+
+/** @brief Free blocks are sorted into 32 lists for each power of two */
+#define HEAP_SL_LOG2            5
+#define HEAP_SL_COUNT           ( 1 << HEAP_SL_LOG2 )
+
+/** @brief Blocks smaller than this all go in the first level's lists */
+#define HEAP_FL_SHIFT           ( HEAP_SL_LOG2 + 3 )
+#define HEAP_SMALL_BLOCK        ( 1 << HEAP_FL_SHIFT )
+
+/** @brief Largest block is just under 2^HEAP_FL_MAX bytes */
+#define HEAP_FL_MAX             30
+#define HEAP_FL_COUNT           ( HEAP_FL_MAX - HEAP_FL_SHIFT + 1 )
+
+typedef struct {
+    /** Bytes in every region given to the heap, headers included */
+    uint32_t total;
+
+    /** Bytes handed out, and the most that has ever been handed out */
+    uint32_t used;
+    uint32_t peak;
+
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures;
+    } heap_stats_t;
+
+extern void heap_init( void* base, size_t size );
+extern int heap_add_region( void* base, size_t size );
+extern void* heap_malloc( size_t size );
+extern void* heap_memalign( size_t align, size_t size );
+extern void* heap_realloc( void* ptr, size_t size );
+extern void heap_free( void* ptr );
+extern size_t heap_usable_size( void* ptr );
+
+extern const heap_stats_t* heap_get_stats( void );
+extern void heap_free_space( uint32_t* free_bytes, uint32_t* largest );
+extern void heap_dump( void );
+
+#endif
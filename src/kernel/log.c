@@ -0,0 +1,86 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stdint.h>
+
+#include "arch/spinlock.h"
+
+#include "hal/console.h"
+#include "hal/interrupts.h"
+
+#include "kernel/log.h"
+
+/* Keeps the frames from different cores from interleaving */
+static spinlock_t log_lock = SPINLOCK_UNLOCKED;
+
+static log_stats_t stats;
+
+
+/**
+    @brief Send one LOG() line as a frame
+
+    A frame is LOG_SYNC, the argument count, the offset of the format in
+    .logstr as 16 bits little endian, then each argument 7 bits a byte, low
+    bits first, with the top bit set on every byte but the last. Most
+    arguments are small counts so this is usually a byte or two each.
+
+    The console ring is the buffer. A frame that doesn't fit is dropped
+    whole rather than have part of it go out, which the decoder couldn't
+    make sense of.
+*/
+void log_write( const char* format, int count, const uint32_t* args )
+{
+    uint8_t frame[LOG_FRAME_MAX];
+    uint32_t offset = (uint32_t)(uintptr_t)format;
+    uint32_t value;
+    uint32_t cpsr;
+    int length = 0;
+    int i;
+
+    frame[length++] = LOG_SYNC;
+    frame[length++] = count;
+    frame[length++] = offset & 0xFF;
+    frame[length++] = ( offset >> 8 ) & 0xFF;
+
+    for( i = 0; i < count; i++ )
+    {
+        value = args[i];
+
+        while( value >= 0x80 )
+        {
+            frame[length++] = ( value & 0x7F ) | 0x80;
+            value >>= 7;
+        }
+
+        frame[length++] = value;
+    }
+
+    cpsr = RPI_InterruptsSave();
+    spin_lock( &log_lock );
+
+    if( RPI_ConsoleTxSpace() >= length )
+    {
+        for( i = 0; i < length; i++ )
+            RPI_ConsoleWrite( frame[i] );
+
+        stats.frames++;
+        stats.bytes += length;
+    }
+    else
+    {
+        stats.dropped++;
+    }
+
+    spin_unlock( &log_lock );
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+const log_stats_t* log_get_stats( void )
+{
+    return &stats;
+}
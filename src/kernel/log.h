@@ -0,0 +1,111 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_LOG_H
+#define KERNEL_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Deferred-format logging. LOG() takes a printf format and up to
+   LOG_MAX_ARGS arguments, but with LOG_DEFERRED=1 nothing is formatted on
+   the Pi: the format string is put in the .logstr section, which the linker
+   script places at address 0 and leaves out of kernel.img, and only its
+   offset and the raw 32-bit arguments are sent over the console.
+   tools/logdecode.py formats them again on the host from kernel.elf.
+
+   Without LOG_DEFERRED, LOG() is printf() and the compiler checks the
+   format against the arguments as usual, so build that way now and then.
+
+   - Every argument is sent as 32 bits, so no long long or double. Wrap a
+     float in LOG_FLOAT() to send its bits
+   - %s only works for strings that are in kernel.elf, string literals and
+     const tables, as the decoder reads them from there
+   - The format should be a whole line. Frames go straight to the console
+     and will overtake a printf() that hasn't reached its newline yet */
+
+#ifndef LOG_DEFERRED
+    #define LOG_DEFERRED            0
+#endif
+
+/** @brief Most arguments LOG() takes */
+#define LOG_MAX_ARGS                8
+
+/** @brief Starts every frame, a byte the console never sends as text */
+#define LOG_SYNC                    0x1E
+
+/** @brief Sync, count, 16-bit format offset, and up to five bytes an
+    argument */
+#define LOG_FRAME_MAX               ( 4 + ( 5 * LOG_MAX_ARGS ) )
+
+typedef struct {
+    uint32_t frames;        /**< Lines sent */
+    uint32_t bytes;         /**< Bytes they took */
+    uint32_t dropped;       /**< Lines that didn't fit in the console ring */
+    } log_stats_t;
+
+extern void log_write( const char* format, int count, const uint32_t* args );
+extern const log_stats_t* log_get_stats( void );
+
+
+#if( LOG_DEFERRED == 1 )
+
+    /* Count the arguments after the format, 0 to LOG_MAX_ARGS */
+    #define LOG_COUNT( ... ) \
+        LOG_COUNT_( 0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0 )
+    #define LOG_COUNT_( z, a, b, c, d, e, f, g, h, n, ... )     n
+
+    #define LOG_CAT( a, b )         LOG_CAT_( a, b )
+    #define LOG_CAT_( a, b )        a ## b
+
+    /* Each argument as a 32-bit word, with a comma before it */
+    #define LOG_ARG( a )            , (uint32_t)(uintptr_t)( a )
+    #define LOG_ARGS_0()
+    #define LOG_ARGS_1( a )         LOG_ARG( a )
+    #define LOG_ARGS_2( a, ... )    LOG_ARG( a ) LOG_ARGS_1( __VA_ARGS__ )
+    #define LOG_ARGS_3( a, ... )    LOG_ARG( a ) LOG_ARGS_2( __VA_ARGS__ )
+    #define LOG_ARGS_4( a, ... )    LOG_ARG( a ) LOG_ARGS_3( __VA_ARGS__ )
+    #define LOG_ARGS_5( a, ... )    LOG_ARG( a ) LOG_ARGS_4( __VA_ARGS__ )
+    #define LOG_ARGS_6( a, ... )    LOG_ARG( a ) LOG_ARGS_5( __VA_ARGS__ )
+    #define LOG_ARGS_7( a, ... )    LOG_ARG( a ) LOG_ARGS_6( __VA_ARGS__ )
+    #define LOG_ARGS_8( a, ... )    LOG_ARG( a ) LOG_ARGS_7( __VA_ARGS__ )
+
+    /** @brief Send a line to be formatted on the host. The leading 0 in the
+        array keeps it from being empty */
+    #define LOG( format, ... )                                              \
+        do                                                                  \
+        {                                                                   \
+            static const char log_format[]                                  \
+                __attribute__((section(".logstr"))) = format;               \
+            const uint32_t log_args[] = {                                   \
+                0 LOG_CAT( LOG_ARGS_, LOG_COUNT( __VA_ARGS__ ) )( __VA_ARGS__ ) }; \
+                                                                            \
+            log_write( log_format, LOG_COUNT( __VA_ARGS__ ), &log_args[1] ); \
+        } while( 0 )
+
+    /** @brief The bits of a float, for %f, %e and %g */
+    static inline uint32_t log_float( float value )
+    {
+        union {
+            float f;
+            uint32_t u;
+            } bits;
+
+        bits.f = value;
+        return bits.u;
+    }
+
+    #define LOG_FLOAT( value )      log_float( value )
+
+#else
+
+    #define LOG( format, ... )      printf( format, ##__VA_ARGS__ )
+    #define LOG_FLOAT( value )      ( (double)( value ) )
+
+#endif
+
+#endif
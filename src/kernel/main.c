@@ -32,253 +32,789 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "hal/aux.h"
-#include "hal/armtimer.h"
+#include "hal/console.h"
+#include "hal/dma.h"
+#include "hal/framebuffer.h"
 #include "hal/gpio.h"
 #include "hal/interrupts.h"
+#include "hal/mailbox.h"
 #include "hal/mailbox-interface.h"
+#include "hal/property-cache.h"
 #include "hal/systimer.h"
+#include "hal/timer.h"
+
+#include "arch/cache.h"
+#include "arch/mmu.h"
+#include "arch/pmu.h"
+#include "arch/smp.h"
+
+#include "kernel/benchmark.h"
+#include "kernel/clock.h"
+#include "kernel/gradient.h"
+#include "kernel/heap.h"
+#include "kernel/log.h"
+#include "kernel/pool.h"
+#include "kernel/profile.h"
+#include "kernel/sampler.h"
+#include "kernel/strips.h"
+#include "kernel/task.h"
+#include "kernel/thread.h"
+#include "kernel/trace.h"
+#include "kernel/workqueue.h"
 
 #define SCREEN_WIDTH    640
 #define SCREEN_HEIGHT   480
 #define SCREEN_DEPTH    16      /* 16 or 32-bit */
 
-#define COLOUR_DELTA    0.05    /* Float from 0 to 1 incremented by this amount */
+#define COLOUR_DELTA    FX_FROM_FLOAT( 0.05 )   /* Green step, 0 to 1 */
+
+/* Build with RENDER_REFERENCE=1 to render with the original per-pixel
+   floating point loop so the FPS can be compared against the fill engine */
+#ifndef RENDER_REFERENCE
+    #define RENDER_REFERENCE    0
+#endif
+
+PROFILE_MARKER( render_marker, "Render frame" );
+
+/* Build with SAMPLE_ENABLE=1 to sample the interrupted PC about a thousand
+   times a second, dump the histogram with 'h' */
+#ifndef SAMPLE_ENABLE
+    #define SAMPLE_ENABLE       0
+#endif
+
+/* End of the kernel image, from the linker script. The heap starts here */
+extern char _end;
+
+/* The renderer in use, and frames drawn since the FPS task last looked */
+static void (*render)( const gradient_target_t*, fixed_t ) = strips_render;
+static const char* render_name = "fill engine";
+static volatile unsigned int frame_count = 0;
+
+/* Frames drawn since boot, to tell them apart in the trace */
+static uint32_t frame_number = 0;
+
+static rpi_framebuffer_t* fbi = NULL;
+
+
+/* Half a second between kernel ticks */
+#define KERNEL_TICK_US  500000
+
+static rpi_timer_t kernel_tick_timer;
+
+/* Between PC samples. Just off a round number so the samples don't lock
+   step with anything else that runs every millisecond */
+#define SAMPLE_PERIOD_US    997
+
+static rpi_timer_t sample_timer;
+
+
+/**
+    @brief Take a PC sample, run from the timer service
+*/
+static void sample_tick( rpi_timer_t* timer, void* param )
+{
+    sampler_record( RPI_IrqGetInterruptedPc() );
+}
+
+
+/**
+    @brief Kernel tick, run from the timer service. Flashes the LED
+*/
+static void kernel_tick( rpi_timer_t* timer, void* param )
+{
+    static int lit = 0;
+
+    /* Flip the LED */
+    if( lit )
+    {
+        LED_OFF();
+        lit = 0;
+    }
+    else
+    {
+        LED_ON();
+        lit = 1;
+    }
+}
+
+
+static void print_irq_stats( void )
+{
+    const rpi_irq_stats_t* stats;
+    int irq;
+
+    for( irq = 0; irq < RPI_IRQ_COUNT; irq++ )
+    {
+        stats = RPI_IrqGetStats( irq );
+
+        if( stats->count == 0 )
+            continue;
+
+        LOG( "IRQ %2d: %u calls, %u avg, %u max cycles\r\n", irq,
+             (unsigned int)stats->count,
+             (unsigned int)( stats->cycles_total / stats->count ),
+             (unsigned int)stats->cycles_max );
+    }
+
+    LOG( "IRQ spurious: %u\r\n", (unsigned int)RPI_IrqGetSpuriousCount() );
+}
+
+
+static void print_uart_stats( void )
+{
+    const rpi_console_stats_t* stats = RPI_ConsoleGetStats();
+
+    LOG( "UART TX: %u bytes, %u dropped, high water %u\r\n",
+         (unsigned int)stats->tx_bytes,
+         (unsigned int)stats->tx_dropped,
+         (unsigned int)stats->tx_high_water );
+    LOG( "UART RX: %u bytes, %u dropped, %u overruns\r\n",
+         (unsigned int)stats->rx_bytes,
+         (unsigned int)stats->rx_dropped,
+         (unsigned int)stats->rx_overruns );
+
+#if( LOG_DEFERRED == 1 )
+    LOG( "Log: %u lines, %u bytes, %u dropped\r\n",
+         (unsigned int)log_get_stats()->frames,
+         (unsigned int)log_get_stats()->bytes,
+         (unsigned int)log_get_stats()->dropped );
+#endif
+}
+
+
+static void print_timer_stats( void )
+{
+    const rpi_timer_stats_t* stats = RPI_TimerGetStats();
+
+    if( stats->fired == 0 )
+        return;
+
+    LOG( "Timers: %u fired, late by %u min %u avg %u max us\r\n",
+         (unsigned int)stats->fired,
+         (unsigned int)stats->late_min,
+         (unsigned int)( stats->late_total / stats->fired ),
+         (unsigned int)stats->late_max );
+    LOG( "Timers: %u overruns, %u reprograms\r\n",
+         (unsigned int)stats->overruns,
+         (unsigned int)stats->reprograms );
+}
+
+
+static void print_property_stats( void )
+{
+    const rpi_property_stats_t* stats = RPI_PropertyGetStats();
+    const rpi_property_cache_stats_t* cache = RPI_PropertyCacheGetStats();
+
+    LOG( "Property: %u round trips, %u max us\r\n",
+         (unsigned int)stats->round_trips,
+         (unsigned int)stats->max_us );
+    LOG( "Property cache: %u hits, %u misses, %u live\r\n",
+         (unsigned int)cache->hits,
+         (unsigned int)cache->misses,
+         (unsigned int)cache->live );
+}
+
+
+/**
+    Fill and copy a rectangle of the back page with the DMA engine and check
+    the result with the CPU, along with the row just below each rectangle
+    which an engine running one row too many would overwrite. Works under
+    QEMU's raspi2b machine too, which emulates the DMA controller
+*/
+static void dma_test( void )
+{
+    rpi_framebuffer_t* fbi = RPI_GetFramebuffer();
+    uint8_t* page = RPI_FramebufferAcquire();
+    uint32_t colour = ( fbi->bpp == 16 ) ? 0xF81F : 0xFF00FF00;
+    uint32_t guard = ~colour;
+    uint32_t start, elapsed;
+    int bytes = fbi->bpp >> 3;
+    int w, h;
+    int errors = 0;
+    int x, y;
+    uint8_t* fill_row;
+    uint8_t* blit_row;
+
+    if( ( page == NULL ) || ( fbi->width < 128 ) || ( fbi->height < 128 ) )
+        return;
+
+    /* A quarter of the width and height, with a guard row below each of
+       the two rectangles */
+    w = fbi->width / 2;
+    h = fbi->height / 4;
+
+    for( x = 0; x < w; x++ )
+    {
+        memcpy( page + ( h * fbi->pitch ) + ( x * bytes ), &guard, bytes );
+        memcpy( page + ( ( 3 * h ) * fbi->pitch ) + ( ( x + w ) * bytes ), &guard, bytes );
+    }
+
+    start = RPI_GetSystemTimer()->counter_lo;
+
+    /* Fill the top left, then copy it down and to the right */
+    if( ( RPI_FramebufferFillRect( page, 0, 0, w, h, colour ) != 0 ) ||
+        ( RPI_FramebufferBlit( page, w, 2 * h, page, 0, 0, w, h ) != 0 ) )
+    {
+        printf( "DMA test: no channel, or the format can't be filled\r\n" );
+        return;
+    }
+
+    RPI_FramebufferDmaSubmit();
+
+    if( RPI_FramebufferDmaWait() != 0 )
+        errors++;
+
+    elapsed = RPI_GetSystemTimer()->counter_lo - start;
+
+    for( y = 0; y < h; y++ )
+    {
+        fill_row = page + ( y * fbi->pitch );
+        blit_row = page + ( ( y + ( 2 * h ) ) * fbi->pitch ) + ( w * bytes );
+
+        for( x = 0; x < w; x++ )
+        {
+            if( memcmp( fill_row + ( x * bytes ), &colour, bytes ) ||
+                memcmp( blit_row + ( x * bytes ), &colour, bytes ) )
+                errors++;
+        }
+    }
+
+    fill_row = page + ( h * fbi->pitch );
+    blit_row = page + ( ( 3 * h ) * fbi->pitch ) + ( w * bytes );
+
+    for( x = 0; x < w; x++ )
+    {
+        if( memcmp( fill_row + ( x * bytes ), &guard, bytes ) ||
+            memcmp( blit_row + ( x * bytes ), &guard, bytes ) )
+            errors++;
+    }
+
+    printf( "DMA test: %s, %d bad pixels, %uus\r\n", errors ? "FAIL" : "pass",
+            errors, (unsigned int)elapsed );
+}
+
+
+/* Wakes the latency test thread takes from a sleep */
+#define LATENCY_TEST_WAKES  100
+
+/* Set by the latency test thread when it has finished */
+static volatile int latency_done = 0;
+
+static task_t latency_task;
+
+/**
+    Sleep and wake a top priority thread over and over. Every wake comes
+    from the timer interrupt and preempts the render loop, so the wake to
+    run latency in the report is the cost of an interrupt and a switch
+*/
+static void latency_thread( void* arg )
+{
+    int i;
+
+    for( i = 0; i < LATENCY_TEST_WAKES; i++ )
+        thread_sleep( 1000 );
+
+    /* This thread can have preempted kernel_main part way through a
+       printf(), and newlib's stdio has no locks, so leave the report to a
+       task that runs between frames */
+    latency_done = 1;
+    task_wake( &latency_task );
+}
+
+
+static int latency_task_run( task_t* task )
+{
+    TASK_BEGIN( task );
+
+    TASK_WAIT_UNTIL( task, latency_done );
+    thread_dump();
+
+    TASK_END( task );
+}
+
+
+/* SoC temperature in thousandths of a degree C, 0 until the first reading */
+static uint32_t soc_temperature = 0;
+
+/** Handle a command that has arrived over the UART */
+static void handle_command( char command )
+{
+    if( command == 's' )
+    {
+        print_uart_stats();
+        print_irq_stats();
+        print_timer_stats();
+        print_property_stats();
+
+        if( soc_temperature )
+            LOG( "SoC temperature: %u.%03u C\r\n",
+                 (unsigned int)( soc_temperature / 1000 ),
+                 (unsigned int)( soc_temperature % 1000 ) );
+    }
+    else if( command == 'p' )
+    {
+        profile_dump();
+        profile_reset();
+    }
+    else if( command == 'c' )
+    {
+        strips_dump();
+        strips_reset();
+    }
+    else if( ( command >= '1' ) && ( command <= '4' ) )
+    {
+        printf( "Rendering on %d core(s)\r\n", strips_set_cores( command - '0' ) );
+        strips_reset();
+    }
+    else if( command == 'h' )
+    {
+        sampler_dump();
+        sampler_reset();
+    }
+    else if( command == 'b' )
+    {
+        benchmark_string( RPI_FramebufferAcquire(),
+                          fbi ? (uint32_t)( fbi->height * fbi->pitch ) : 0 );
+    }
+    else if( command == 'd' )
+    {
+        dma_test();
+    }
+    else if( command == 'm' )
+    {
+        heap_dump();
+        pool_dump();
+    }
+    else if( command == 't' )
+    {
+        thread_dump();
+        task_dump();
+    }
+    else if( command == 'x' )
+    {
+        trace_dump();
+        trace_reset();
+    }
+    else if( command == 'l' )
+    {
+        if( latency_task.running )
+        {
+            printf( "Latency test: already running\r\n" );
+        }
+        else
+        {
+            latency_done = 0;
+
+            if( thread_create( "latency", latency_thread, NULL, THREAD_PRIORITY_MAX, 0 ) == NULL )
+                printf( "Latency test: couldn't create the thread\r\n" );
+            else
+                task_start( &latency_task, "latency", latency_task_run, NULL );
+        }
+    }
+}
+
+
+/* Space to wait for in the transmit ring before printing, so the output of
+   most commands goes straight into the ring rather than waiting on the UART */
+#define CONSOLE_ROOM    1024
+
+static task_t console_task;
+
+/**
+    Run commands as they arrive. The UART interrupt wakes the task when bytes
+    come in or the transmit ring drains, so it is only polled when there is
+    something to do
+*/
+static int console_task_run( task_t* task )
+{
+    static char command;
+
+    TASK_BEGIN( task );
+
+    while( 1 )
+    {
+        TASK_WAIT_UNTIL( task, RPI_ConsoleRead( &command, 1 ) == 1 );
+        TASK_WAIT_UNTIL( task, RPI_ConsoleTxSpace() >= CONSOLE_ROOM );
+        handle_command( command );
+    }
+
+    TASK_END( task );
+}
+
+
+/* A minute between frame rate reports */
+#define FPS_PERIOD_US   60000000
+
+static task_t fps_task;
+
+static int fps_task_run( task_t* task )
+{
+    static uint64_t start;
+    uint64_t elapsed;
+    unsigned int frames;
+
+    TASK_BEGIN( task );
+
+    while( 1 )
+    {
+        start = clock_time_us();
+        frame_count = 0;
+
+        TASK_SLEEP( task, FPS_PERIOD_US );
+        TASK_WAIT_UNTIL( task, RPI_ConsoleTxSpace() >= CONSOLE_ROOM );
+
+        frames = frame_count;
+        elapsed = clock_time_us() - start;
+
+        LOG( "FPS: %.2f (%s, %d core(s))\r\n",
+             LOG_FLOAT( (float)frames * 1000000.0f / (float)elapsed ),
+             render_name,
+             ( render == strips_render ) ? strips_get_cores() : 1 );
+        print_uart_stats();
+    }
+
+    TASK_END( task );
+}
+
+
+/**
+    Console notify hook, run from the UART interrupt when bytes come in or
+    the transmit ring drains. Wakes every task that waits on the console,
+    the FPS task included, as it may be waiting for room to print
+*/
+static void console_notify( void* param )
+{
+    task_wake( &console_task );
+    task_wake( &fps_task );
+}
+
+
+/* Ten seconds between temperature readings */
+#define TEMPERATURE_PERIOD_US   10000000
+
+static uint32_t temperature_pt[16] __attribute__((aligned(CACHE_LINE_SIZE)));
+static rpi_property_t temperature_property;
+static task_t temperature_task;
+
+/**
+    Read the SoC temperature from the firmware now and again. The mailbox
+    interrupt wakes the task with the answer, so the render loop never waits
+    on the VideoCore for it
+*/
+static int temperature_task_run( task_t* task )
+{
+    rpi_tag_temperature_t* temperature;
+
+    TASK_BEGIN( task );
+
+    RPI_PropertyBufferInit( &temperature_property, temperature_pt,
+                            sizeof( temperature_pt ) / sizeof( temperature_pt[0] ) );
+
+    while( 1 )
+    {
+        RPI_PropertyBufferReset( &temperature_property );
+        temperature = RPI_PROPERTY_BUFFER_ADD( &temperature_property, TAG_GET_TEMPERATURE,
+                                               rpi_tag_temperature_t );
+        temperature->id = 0;
+
+        TASK_PROPERTY( task, &temperature_property );
+
+        if( ( temperature = RPI_PROPERTY_BUFFER_GET( &temperature_property, TAG_GET_TEMPERATURE,
+                                                     rpi_tag_temperature_t ) ) )
+            soc_temperature = temperature->value;
+
+        TASK_SLEEP( task, TEMPERATURE_PERIOD_US );
+    }
+
+    TASK_END( task );
+}
+
+
+/** Main function for cores 1-3, they run whatever is queued for them */
+void kernel_secondary_main( int core )
+{
+    workqueue_run( core );
+}
 
-typedef struct {
-    float r;
-    float g;
-    float b;
-    float a;
-    } colour_t;
 
 /** Main function - we'll never return from here */
 void kernel_main( unsigned int r0, unsigned int r1, unsigned int atags )
 {
     int width = SCREEN_WIDTH, height = SCREEN_HEIGHT, bpp = SCREEN_DEPTH;
-    int x, y, pitch = 0;
-    colour_t current_colour;
-    volatile unsigned char* fb = NULL;
-    int pixel_offset;
-    int r, g, b, a;
-    float cd = COLOUR_DELTA;
-    unsigned int frame_count = 0;
+    int pitch = 0;
+    gradient_target_t target;
+    fixed_t green = 0;
+    fixed_t cd = COLOUR_DELTA;
+    benchmark_memory_t uncached, cached;
+    const rpi_tag_u32_t* value;
+    const rpi_tag_mac_t* mac;
+    const rpi_tag_serial_t* serial;
+    const rpi_tag_memory_t* memory;
+    rpi_tag_clock_t* clock;
+    rpi_tag_set_clock_t* set_clock;
+    uint32_t max_clock = 0;
+    uint32_t boot_rounds, boot_us;
+    uint32_t heap_start;
+    int framebuffer_ok;
 
     /* Write 1 to the LED init nibble in the Function Select GPIO
        peripheral register to enable LED pin as an output */
     RPI_GetGpio()->LED_GPFSEL |= LED_GPFBIT;
 
-    /* Enable the timer interrupt IRQ */
-    RPI_GetIrqController()->Enable_Basic_IRQs = RPI_BASIC_ARM_TIMER_IRQ;
+    /* Start the cycle and event counters used for profiling */
+    pmu_init();
+
+    /* Turn on the MMU so the data cache is used, timing memory access on
+       either side of it */
+    benchmark_memory( &uncached );
+    mmu_init();
+    benchmark_memory( &cached );
+
+    /* malloc works from here on. The heap only gets a little memory to
+       start with, the rest is added once the firmware has said how much
+       the ARM has */
+    heap_init( &_end, HEAP_BOOT_SIZE );
+
+    /* Fill the fixed size object pools, they're ready for use by drivers
+       and IRQ handlers from here on */
+    pool_init();
+
+    /* Start with every interrupt source off and an empty vector table */
+    RPI_IrqInit();
+
+    /* Size the PC histogram to the kernel, a timer of its own feeds it */
+    sampler_init();
+
+    if( SAMPLE_ENABLE == 1 )
+        sampler_start();
+
+    /* Work out how fast the generic timer really runs, so its cheap
+       timestamps can be turned into microseconds */
+    clock_init();
 
-    /* Setup the system timer interrupt */
-    /* Timer frequency = Clk/256 * 0x400 */
-    RPI_GetArmTimer()->Load = 0x400;
+    /* Everything periodic runs from the system timer compare channel, which
+       is only ever set for the next deadline rather than ticking */
+    RPI_TimerInit();
+    RPI_TimerSetup( &kernel_tick_timer, kernel_tick, NULL );
+    RPI_TimerStart( &kernel_tick_timer, KERNEL_TICK_US, KERNEL_TICK_US );
 
-    /* Setup the ARM Timer */
-    RPI_GetArmTimer()->Control =
-            RPI_ARMTIMER_CTRL_23BIT |
-            RPI_ARMTIMER_CTRL_ENABLE |
-            RPI_ARMTIMER_CTRL_INT_ENABLE |
-            RPI_ARMTIMER_CTRL_PRESCALE_256;
+    if( SAMPLE_ENABLE == 1 )
+    {
+        RPI_TimerSetup( &sample_timer, sample_tick, NULL );
+        RPI_TimerStart( &sample_timer, SAMPLE_PERIOD_US, SAMPLE_PERIOD_US );
+    }
+
+    /* From here on kernel_main() is the "main" thread on core 0, and can be
+       preempted by higher priority threads it or an interrupt wakes */
+    thread_init( THREAD_PRIORITY_DEFAULT );
 
     /* Enable interrupts! */
     _enable_interrupts();
 
-    /* Initialise the UART */
-    RPI_AuxMiniUartInit( 115200, 8 );
+    /* Firmware calls complete from the mailbox interrupt, so the core can
+       get on with other work (or sleep) while the VideoCore is busy */
+    RPI_MailboxAsyncInit();
+
+    /* Initialise the UART, the mini UART or the PL011 depending on
+       CONSOLE_PL011 */
+    RPI_ConsoleInit();
+
+    /* Commands are read by the console task, which must never wait for them */
+    RPI_ConsoleSetRxMode( RPI_CONSOLE_RX_NONBLOCK );
 
     /* Print to the UART using the standard libc functions */
-    printf( "Valvers.com ARM Bare Metal Tutorials\r\n" );
-    printf( "Initialise UART console with standard libc\r\n\n" );
+    LOG( "Valvers.com ARM Bare Metal Tutorials\r\n" );
+    LOG( "Initialise UART console with standard libc\r\n\n" );
+
+    LOG( "Generic timer: %u Hz, CNTFRQ says %u Hz\r\n",
+         (unsigned int)clock_calibration.frequency,
+         (unsigned int)clock_calibration.reported );
+
+    benchmark_memory_print( "MMU off", &uncached );
+    benchmark_memory_print( "MMU on", &cached );
+
+    /* Query the firmware in as few round trips as possible. Everything that
+       doesn't depend on an earlier answer goes in the first buffer, the
+       framebuffer allocation included */
+    boot_rounds = RPI_PropertyGetStats()->round_trips;
+    boot_us = RPI_PropertyGetStats()->total_us;
 
     RPI_PropertyInit();
-    RPI_PropertyAddTag( TAG_GET_BOARD_MODEL );
-    RPI_PropertyAddTag( TAG_GET_BOARD_REVISION );
-    RPI_PropertyAddTag( TAG_GET_FIRMWARE_VERSION );
-    RPI_PropertyAddTag( TAG_GET_BOARD_MAC_ADDRESS );
-    RPI_PropertyAddTag( TAG_GET_BOARD_SERIAL );
-    RPI_PropertyAddTag( TAG_GET_MAX_CLOCK_RATE, TAG_CLOCK_ARM );
+    RPI_PropertyCacheAddTags();
+    clock = RPI_PROPERTY_ADD( TAG_GET_MAX_CLOCK_RATE, rpi_tag_clock_t );
+    clock->clock_id = TAG_CLOCK_ARM;
+    RPI_FramebufferAddTags( SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_DEPTH );
     RPI_PropertyProcess();
 
-    rpi_mailbox_property_t* mp;
-    mp = RPI_PropertyGet( TAG_GET_BOARD_MODEL );
+    /* The board details never change, keep them so nobody has to ask the
+       firmware again */
+    RPI_PropertyCacheParseTags();
 
-    if( mp )
-        printf( "Board Model: %d\r\n", mp->data.value_32 );
-    else
-        printf( "Board Model: NULL\r\n" );
+    /* Only use the DMA channels the firmware isn't */
+    if( ( value = RPI_PROPERTY_CACHE_GET( TAG_GET_DMA_CHANNELS, rpi_tag_u32_t ) ) )
+        RPI_DmaInit( value->value );
 
-    mp = RPI_PropertyGet( TAG_GET_BOARD_REVISION );
+#if( CONSOLE_DMA == 1 )
+    /* Hand console output to the DMA engine now there are channels */
+    if( RPI_ConsoleEnableDma() != 0 )
+        LOG( "Console DMA: no channel\r\n" );
+#endif
 
-    if( mp )
-        printf( "Board Revision: %d\r\n", mp->data.value_32 );
+    if( ( memory = RPI_PROPERTY_CACHE_GET( TAG_GET_ARM_MEMORY, rpi_tag_memory_t ) ) )
+    {
+        heap_start = (uint32_t)&_end + HEAP_BOOT_SIZE;
+        heap_add_region( (void*)heap_start, memory->base + memory->size - heap_start );
+    }
+
+    if( ( value = RPI_PROPERTY_CACHE_GET( TAG_GET_BOARD_MODEL, rpi_tag_u32_t ) ) )
+        LOG( "Board Model: %d\r\n", (int)value->value );
     else
-        printf( "Board Revision: NULL\r\n" );
+        LOG( "Board Model: NULL\r\n" );
 
-    mp = RPI_PropertyGet( TAG_GET_FIRMWARE_VERSION );
+    if( ( value = RPI_PROPERTY_CACHE_GET( TAG_GET_BOARD_REVISION, rpi_tag_u32_t ) ) )
+        LOG( "Board Revision: %d\r\n", (int)value->value );
+    else
+        LOG( "Board Revision: NULL\r\n" );
 
-    if( mp )
-        printf( "Firmware Version: %d\r\n", mp->data.value_32 );
+    if( ( value = RPI_PROPERTY_CACHE_GET( TAG_GET_FIRMWARE_VERSION, rpi_tag_u32_t ) ) )
+        LOG( "Firmware Version: %d\r\n", (int)value->value );
     else
-        printf( "Firmware Version: NULL\r\n" );
+        LOG( "Firmware Version: NULL\r\n" );
 
-    mp = RPI_PropertyGet( TAG_GET_BOARD_MAC_ADDRESS );
+    if( ( mac = RPI_PROPERTY_CACHE_GET( TAG_GET_BOARD_MAC_ADDRESS, rpi_tag_mac_t ) ) )
+        LOG( "MAC Address: %2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X\r\n",
+            mac->mac[0], mac->mac[1], mac->mac[2],
+            mac->mac[3], mac->mac[4], mac->mac[5] );
+    else
+        LOG( "MAC Address: NULL\r\n" );
 
-    if( mp )
-        printf( "MAC Address: %2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X\r\n",
-               mp->data.buffer_8[0], mp->data.buffer_8[1], mp->data.buffer_8[2],
-               mp->data.buffer_8[3], mp->data.buffer_8[4], mp->data.buffer_8[5] );
+    if( ( serial = RPI_PROPERTY_CACHE_GET( TAG_GET_BOARD_SERIAL, rpi_tag_serial_t ) ) )
+        LOG( "Serial Number: %8.8X%8.8X\r\n",
+             (unsigned int)serial->serial[0], (unsigned int)serial->serial[1] );
     else
-        printf( "MAC Address: NULL\r\n" );
+        LOG( "Serial Number: NULL\r\n" );
 
-    mp = RPI_PropertyGet( TAG_GET_BOARD_SERIAL );
+    if( ( memory = RPI_PROPERTY_CACHE_GET( TAG_GET_ARM_MEMORY, rpi_tag_memory_t ) ) )
+        LOG( "ARM Memory: %8.8X %uMB\r\n", (unsigned int)memory->base,
+             (unsigned int)( memory->size >> 20 ) );
 
-    if( mp )
-        printf( "Serial Number: %8.8X%8.8X\r\n",
-                mp->data.buffer_32[0], mp->data.buffer_32[1] );
+    if( ( memory = RPI_PROPERTY_CACHE_GET( TAG_GET_VC_MEMORY, rpi_tag_memory_t ) ) )
+        LOG( "VC Memory: %8.8X %uMB\r\n", (unsigned int)memory->base,
+             (unsigned int)( memory->size >> 20 ) );
+
+    if( ( clock = RPI_PROPERTY_GET( TAG_GET_MAX_CLOCK_RATE, rpi_tag_clock_t ) ) )
+    {
+        LOG( "Maximum ARM Clock Rate: %dHz\r\n", (int)clock->rate );
+        max_clock = clock->rate;
+    }
     else
-        printf( "Serial Number: NULL\r\n" );
+    {
+        LOG( "Maximum ARM Clock Rate: NULL\r\n" );
+    }
 
-    mp = RPI_PropertyGet( TAG_GET_MAX_CLOCK_RATE );
+    /* The responses are gone once the buffer is reused, so pick up the
+       framebuffer now. This remaps it uncached, which has to happen while
+       core 0 is the only one running */
+    framebuffer_ok = ( RPI_FramebufferParseTags() == 0 );
 
-    if( mp )
-        printf( "Maximum ARM Clock Rate: %dHz\r\n", mp->data.buffer_32[1] );
-    else
-        printf( "Maximum ARM Clock Rate: NULL\r\n" );
+    /* Wake the other cores up, they wait on their work queues. Frames are
+       split into strips across all of them */
+    strips_init( smp_init() );
+    LOG( "Cores online: %d\r\n", strips_get_cores() );
 
-    /* Ensure the ARM is running at it's maximum rate */
+    /* Second round, only needed because the clock can't be set until we know
+       its maximum. Ensure the ARM is running at it's maximum rate and read
+       back what it was set to */
     RPI_PropertyInit();
-    RPI_PropertyAddTag( TAG_SET_CLOCK_RATE, TAG_CLOCK_ARM, mp->data.buffer_32[1] );
-    RPI_PropertyProcess();
 
-    RPI_PropertyInit();
-    RPI_PropertyAddTag( TAG_GET_CLOCK_RATE, TAG_CLOCK_ARM );
-    RPI_PropertyProcess();
+    if( max_clock )
+    {
+        set_clock = RPI_PROPERTY_ADD( TAG_SET_CLOCK_RATE, rpi_tag_set_clock_t );
+        set_clock->clock_id = TAG_CLOCK_ARM;
+        set_clock->rate = max_clock;
+    }
 
-    mp = RPI_PropertyGet( TAG_GET_CLOCK_RATE );
+    clock = RPI_PROPERTY_ADD( TAG_GET_CLOCK_RATE, rpi_tag_clock_t );
+    clock->clock_id = TAG_CLOCK_ARM;
+    RPI_PropertyProcess();
 
-    if( mp )
-        printf( "Set ARM Clock Rate: %dHz\r\n", mp->data.buffer_32[1] );
+    if( ( clock = RPI_PROPERTY_GET( TAG_GET_CLOCK_RATE, rpi_tag_clock_t ) ) )
+        LOG( "Set ARM Clock Rate: %dHz\r\n", (int)clock->rate );
     else
-        printf( "Set ARM Clock Rate: NULL\r\n" );
-
-    /* Initialise a framebuffer... */
-    RPI_PropertyInit();
-    RPI_PropertyAddTag( TAG_ALLOCATE_BUFFER );
-    RPI_PropertyAddTag( TAG_SET_PHYSICAL_SIZE, SCREEN_WIDTH, SCREEN_HEIGHT );
-    RPI_PropertyAddTag( TAG_SET_VIRTUAL_SIZE, SCREEN_WIDTH, SCREEN_HEIGHT * 2 );
-    RPI_PropertyAddTag( TAG_SET_DEPTH, SCREEN_DEPTH );
-    RPI_PropertyAddTag( TAG_GET_PITCH );
-    RPI_PropertyAddTag( TAG_GET_PHYSICAL_SIZE );
-    RPI_PropertyAddTag( TAG_GET_DEPTH );
-    RPI_PropertyProcess();
+        LOG( "Set ARM Clock Rate: NULL\r\n" );
 
-    if( ( mp = RPI_PropertyGet( TAG_GET_PHYSICAL_SIZE ) ) )
-    {
-        width = mp->data.buffer_32[0];
-        height = mp->data.buffer_32[1];
+    boot_rounds = RPI_PropertyGetStats()->round_trips - boot_rounds;
+    boot_us = RPI_PropertyGetStats()->total_us - boot_us;
 
-        printf( "Initialised Framebuffer: %dx%d ", width, height );
-    }
+    LOG( "Boot firmware queries: %u round trip(s), %uus, %uus each\r\n",
+         (unsigned int)boot_rounds, (unsigned int)boot_us,
+         (unsigned int)( boot_us / ( boot_rounds ? boot_rounds : 1 ) ) );
 
-    if( ( mp = RPI_PropertyGet( TAG_GET_DEPTH ) ) )
+    if( framebuffer_ok )
     {
-        bpp = mp->data.buffer_32[0];
-        printf( "%dbpp\r\n", bpp );
+        fbi = RPI_GetFramebuffer();
+        width = fbi->width;
+        height = fbi->height;
+        bpp = fbi->bpp;
+        pitch = fbi->pitch;
+
+        LOG( "Initialised Framebuffer: %dx%d %dbpp\r\n", width, height, bpp );
+        LOG( "Pitch: %d bytes\r\n", pitch );
+        LOG( "Framebuffer address: %8.8X, %d page(s), %s flip\r\n",
+             (unsigned int)fbi->base, fbi->pages,
+             fbi->vsync ? "vsync" : "timed" );
     }
 
-    if( ( mp = RPI_PropertyGet( TAG_GET_PITCH ) ) )
-    {
-        pitch = mp->data.buffer_32[0];
-        printf( "Pitch: %d bytes\r\n", pitch );
-    }
+    target.fb = NULL;
+    target.width = width;
+    target.height = height;
+    target.pitch = pitch;
+    target.bpp = bpp;
 
-    if( ( mp = RPI_PropertyGet( TAG_ALLOCATE_BUFFER ) ) )
+    if( ( RENDER_REFERENCE == 1 ) || ( gradient_init( &target ) != 0 ) )
     {
-        fb = (unsigned char*)mp->data.buffer_32[0];
-        printf( "Framebuffer address: %8.8X\r\n", (unsigned int)fb );
+        render = gradient_render_reference;
+        render_name = "reference";
     }
 
-    /* Never exit as there is no OS to exit to! */
-    current_colour.r = 0;
-    current_colour.g = 0;
-    current_colour.b = 0;
-    current_colour.a = 1.0;
+    LOG( "Renderer: %s\r\n", render_name );
+
+    /* Everything that waits on the UART, a timer or the firmware runs as a
+       task between frames, so the render loop never spins on I/O */
+    task_start( &console_task, "console", console_task_run, NULL );
+    task_start( &fps_task, "fps", fps_task_run, NULL );
+    task_start( &temperature_task, "temperature", temperature_task_run, NULL );
+    RPI_ConsoleSetNotify( console_notify, NULL );
 
+    /* Never exit as there is no OS to exit to! */
     while( 1 )
     {
-        current_colour.r = 0;
-
-        /* Produce a colour spread across the screen */
-        for( y = 0; y < height; y++ )
-        {
-            current_colour.r += ( 1.0 / height );
-            current_colour.b = 0;
-
-            for( x = 0; x < width; x++ )
-            {
-                pixel_offset = ( x * ( bpp >> 3 ) ) + ( y * pitch );
-
-                r = (int)( current_colour.r * 0xFF ) & 0xFF;
-                g = (int)( current_colour.g * 0xFF ) & 0xFF;
-                b = (int)( current_colour.b * 0xFF ) & 0xFF;
-                a = (int)( current_colour.b * 0xFF ) & 0xFF;
-
-                if( bpp == 32 )
-                {
-                    /* Four bytes to write */
-                    fb[ pixel_offset++ ] = r;
-                    fb[ pixel_offset++ ] = g;
-                    fb[ pixel_offset++ ] = b;
-                    fb[ pixel_offset++ ] = a;
-                }
-                else if( bpp == 24 )
-                {
-                    /* Three bytes to write */
-                    fb[ pixel_offset++ ] = r;
-                    fb[ pixel_offset++ ] = g;
-                    fb[ pixel_offset++ ] = b;
-                }
-                else if( bpp == 16 )
-                {
-                    /* Two bytes to write */
-                    /* Bit pack RGB565 into the 16-bit pixel offset */
-                    *(unsigned short*)&fb[pixel_offset] = ( (r >> 3) << 11 ) | ( ( g >> 2 ) << 5 ) | ( b >> 3 );
-                }
-                else
-                {
-                    /* Palette mode. TODO: Work out a colour scheme for
-                       packing rgb into an 8-bit palette! */
-                }
-
-                current_colour.b += ( 1.0 / width );
-            }
-        }
+        /* Draw into the back page and then flip it onto the screen */
+        TRACE( TRACE_FRAME_BEGIN, frame_number, 0 );
+        target.fb = RPI_FramebufferAcquire();
+        PROFILE_BEGIN( render_marker );
+        render( &target, green );
+        PROFILE_END( render_marker );
+        RPI_FramebufferPresent();
+        TRACE( TRACE_FRAME_END, frame_number, 0 );
+        frame_number++;
 
         /* Scroll through the green colour */
-        current_colour.g += cd;
-        if( current_colour.g > 1.0 )
+        green += cd;
+        if( green > FX_ONE )
         {
-            current_colour.g = 1.0;
+            green = FX_ONE;
             cd = -COLOUR_DELTA;
         }
-        else if( current_colour.g < 0.0 )
+        else if( green < 0 )
         {
-            current_colour.g = 0.0;
+            green = 0;
             cd = COLOUR_DELTA;
         }
 
         frame_count++;
-        if( calculate_frame_count )
-        {
-            calculate_frame_count = 0;
-
-            /* Number of frames in a minute, divided by seconds per minute */
-            float fps = (float)frame_count / 60;
-            printf( "FPS: %.2f\r\n", fps );
 
-            frame_count = 0;
-        }
+        /* Run whatever I/O has moved on since the last frame */
+        task_poll();
     }
 }
@@ -0,0 +1,99 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pool.h"
+
+/* Every pool defined with POOL_DEFINE(), gathered by the linker script */
+extern pool_t __pool_table_start[];
+extern pool_t __pool_table_end[];
+
+
+/**
+    @brief Put every object of every pool on its free list
+
+    Must be called once the MMU is on, as the free lists need the exclusive
+    monitors, and before anything is allocated from a pool.
+*/
+void pool_init( void )
+{
+    pool_t* pool;
+    uint32_t i;
+
+    for( pool = __pool_table_start; pool < __pool_table_end; pool++ )
+    {
+        pool->free.head = NULL;
+        pool->in_use = 0;
+        pool->peak = 0;
+        pool->failures = 0;
+
+        /* Push in reverse so the objects are handed out in address order */
+        for( i = pool->count; i > 0; i-- )
+            lf_stack_push( &pool->free, pool->base + ( ( i - 1 ) * pool->size ) );
+    }
+}
+
+
+/**
+    @brief Take an object from a pool. Its contents are whatever was left in
+    it by the last user
+
+    @return The object, NULL if the pool is empty
+*/
+void* pool_alloc( pool_t* pool )
+{
+    void* object = lf_stack_pop( &pool->free );
+    uint32_t in_use, peak;
+
+    if( object == NULL )
+    {
+        __atomic_add_fetch( &pool->failures, 1, __ATOMIC_RELAXED );
+        return NULL;
+    }
+
+    in_use = __atomic_add_fetch( &pool->in_use, 1, __ATOMIC_RELAXED );
+
+    peak = pool->peak;
+    while( ( in_use > peak ) &&
+           !__atomic_compare_exchange_n( &pool->peak, &peak, in_use, 1,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+    {
+        /* BLANK */
+    }
+
+    return object;
+}
+
+
+/**
+    @brief Give an object back to the pool it came from. NULL is ignored
+*/
+void pool_free( pool_t* pool, void* object )
+{
+    if( object == NULL )
+        return;
+
+    __atomic_sub_fetch( &pool->in_use, 1, __ATOMIC_RELAXED );
+    lf_stack_push( &pool->free, object );
+}
+
+
+void pool_dump( void )
+{
+    pool_t* pool;
+
+    for( pool = __pool_table_start; pool < __pool_table_end; pool++ )
+    {
+        printf( "Pool %s: %u x %u bytes, %u in use, %u peak, %u failed\r\n",
+                pool->name, (unsigned int)pool->count, (unsigned int)pool->size,
+                (unsigned int)pool->in_use, (unsigned int)pool->peak,
+                (unsigned int)pool->failures );
+    }
+}
@@ -0,0 +1,73 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_POOL_H
+#define KERNEL_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arch/cache.h"
+#include "arch/lockfree.h"
+
+/** @brief Smallest alignment of a pool object, enough for any type */
+#define POOL_ALIGN              8
+
+/** @brief A pool of fixed size objects carved out of the .pools region.
+    Allocating and freeing are lock-free and safe from IRQ handlers and any
+    core. Pools are defined with POOL_DEFINE() and filled by pool_init() */
+typedef struct {
+    lf_stack_t free;
+
+    uint8_t* base;
+    uint32_t size;
+    uint32_t count;
+    const char* name;
+
+    /** Objects handed out now, the most ever handed out at once and the
+        number of allocations that found the pool empty */
+    volatile uint32_t in_use;
+    volatile uint32_t peak;
+    volatile uint32_t failures;
+    } pool_t;
+
+/** @brief Size of each object in a pool of type, rounded up to align */
+#define POOL_OBJECT_SIZE( type, align ) \
+    ( ( sizeof( type ) + ( align ) - 1 ) & ~( ( align ) - 1 ) )
+
+/** @brief Define a pool of count objects of type, each aligned to align
+    bytes. The storage goes in the .pools region and the pool in the
+    .pool_table list pool_init() works through */
+#define POOL_DEFINE_ALIGNED( name, type, count, align ) \
+    static uint8_t name##_storage[POOL_OBJECT_SIZE( type, align ) * ( count )] \
+        __attribute__((section(".pools"), aligned(CACHE_LINE_SIZE))); \
+    pool_t name __attribute__((section(".pool_table"), used)) = { \
+        { NULL }, name##_storage, POOL_OBJECT_SIZE( type, align ), ( count ), \
+        #name, 0, 0, 0 }
+
+#define POOL_DEFINE( name, type, count ) \
+    POOL_DEFINE_ALIGNED( name, type, count, POOL_ALIGN )
+
+/** @brief Declare typed name_alloc() and name_free() functions for a pool,
+    usually in the header of whoever owns it */
+#define POOL_DECLARE( name, type ) \
+    extern pool_t name; \
+    static inline type* name##_alloc( void ) \
+    { \
+        return (type*)pool_alloc( &name ); \
+    } \
+    static inline void name##_free( type* object ) \
+    { \
+        pool_free( &name, object ); \
+    }
+
+extern void pool_init( void );
+extern void* pool_alloc( pool_t* pool );
+extern void pool_free( pool_t* pool, void* object );
+extern void pool_dump( void );
+
+#endif
@@ -0,0 +1,126 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "profile.h"
+
+/* Every marker that has been used at least once */
+static profile_marker_t* markers = 0;
+
+
+/**
+    @brief Add a marker to the report, called the first time it is used
+*/
+void profile_register( profile_marker_t* marker )
+{
+    uint32_t cpsr;
+
+    /* A marker may first be used from an IRQ handler, so keep interrupts off
+       whilst the list is updated */
+    __asm__ __volatile__( "mrs %0, cpsr\n\tcpsid i" : "=r" (cpsr) :: "memory" );
+
+    if( !marker->registered )
+    {
+        marker->next = markers;
+        markers = marker;
+        marker->registered = 1;
+    }
+
+    __asm__ __volatile__( "msr cpsr_c, %0" :: "r" (cpsr) : "memory" );
+}
+
+
+/**
+    @brief Zero the counts of every marker
+*/
+void profile_reset( void )
+{
+    profile_marker_t* marker;
+    int counter;
+
+    for( marker = markers; marker; marker = marker->next )
+    {
+        marker->calls = 0;
+        marker->cycles = 0;
+
+        for( counter = 0; counter < PMU_COUNTERS; counter++ )
+            marker->events[counter] = 0;
+    }
+}
+
+
+/**
+    @brief Put the marker list in order of total cycles, most first
+*/
+static void profile_sort( void )
+{
+    profile_marker_t* sorted = 0;
+    profile_marker_t* marker;
+    profile_marker_t** link;
+    uint32_t cpsr;
+
+    /* Markers can be registered from IRQ handlers while this is going on */
+    __asm__ __volatile__( "mrs %0, cpsr\n\tcpsid i" : "=r" (cpsr) :: "memory" );
+
+    while( ( marker = markers ) != 0 )
+    {
+        markers = marker->next;
+
+        for( link = &sorted; *link && ( ( *link )->cycles >= marker->cycles ); link = &( *link )->next )
+            ;
+
+        marker->next = *link;
+        *link = marker;
+    }
+
+    markers = sorted;
+
+    __asm__ __volatile__( "msr cpsr_c, %0" :: "r" (cpsr) : "memory" );
+}
+
+
+/**
+    @brief Print a table of every marker to stdout (the UART), sorted by
+    cycles
+
+    Counts are inclusive, so a marker nested inside another is counted in
+    both. IPC is instructions per cycle to two decimal places.
+*/
+void profile_dump( void )
+{
+    profile_marker_t* marker;
+    uint32_t calls;
+    uint32_t ipc;
+
+    profile_sort();
+
+    printf( "%-24s %8s %12s %12s %5s %10s %10s %10s\r\n",
+            "Marker", "Calls", "Cycles", "Cycles/call", "IPC", "L1D miss",
+            "L2 miss", "Br miss" );
+
+    for( marker = markers; marker; marker = marker->next )
+    {
+        calls = marker->calls ? marker->calls : 1;
+
+        /* Hundredths of an instruction per cycle */
+        ipc = marker->cycles ?
+            (uint32_t)( ( marker->events[PMU_COUNTER_INSTRUCTIONS] * 100 ) / marker->cycles ) : 0;
+
+        printf( "%-24s %8u %12llu %12llu %2u.%02u %10llu %10llu %10llu\r\n",
+                marker->name,
+                (unsigned int)marker->calls,
+                (unsigned long long)marker->cycles,
+                (unsigned long long)( marker->cycles / calls ),
+                (unsigned int)( ipc / 100 ),
+                (unsigned int)( ipc % 100 ),
+                (unsigned long long)marker->events[PMU_COUNTER_L1D_MISSES],
+                (unsigned long long)marker->events[PMU_COUNTER_L2_MISSES],
+                (unsigned long long)marker->events[PMU_COUNTER_BRANCH_MISSES] );
+    }
+}
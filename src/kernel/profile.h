@@ -0,0 +1,105 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_PROFILE_H
+#define KERNEL_PROFILE_H
+
+#include <stdint.h>
+
+#include "arch/pmu.h"
+
+/** @brief Accumulated PMU counts for one profiling marker. Markers are
+    statically allocated with PROFILE_MARKER() and link themselves into the
+    report the first time they are used */
+typedef struct profile_marker {
+    const char* name;
+    uint32_t calls;
+    uint64_t cycles;
+    uint64_t events[PMU_COUNTERS];
+    struct profile_marker* next;
+    int registered;
+    } profile_marker_t;
+
+/** @brief The counter values at the start of one use of a marker. Scopes
+    live on the stack so markers can nest and be used from IRQ handlers.
+    A marker must only be used on one core */
+typedef struct {
+    profile_marker_t* marker;
+    uint32_t cycles;
+    uint32_t events[PMU_COUNTERS];
+    } profile_scope_t;
+
+extern void profile_register( profile_marker_t* marker );
+extern void profile_dump( void );
+extern void profile_reset( void );
+
+
+static inline void profile_begin( profile_marker_t* marker, profile_scope_t* scope )
+{
+    int counter;
+
+    if( !marker->registered )
+        profile_register( marker );
+
+    scope->marker = marker;
+
+    for( counter = 0; counter < PMU_COUNTERS; counter++ )
+        scope->events[counter] = pmu_read( counter );
+
+    /* Read the cycle counter last so the event reads aren't charged */
+    scope->cycles = pmu_cycles();
+}
+
+
+static inline void profile_end( profile_scope_t* scope )
+{
+    uint32_t cycles = pmu_cycles();
+    profile_marker_t* marker = scope->marker;
+    uint32_t cpsr;
+    int counter;
+
+    /* The 64-bit totals take two words each to update, keep a handler using
+       the same marker from getting in half way */
+    __asm__ __volatile__( "mrs %0, cpsr\n\tcpsid i" : "=r" (cpsr) :: "memory" );
+
+    marker->cycles += cycles - scope->cycles;
+
+    for( counter = 0; counter < PMU_COUNTERS; counter++ )
+        marker->events[counter] += pmu_read( counter ) - scope->events[counter];
+
+    marker->calls++;
+
+    __asm__ __volatile__( "msr cpsr_c, %0" :: "r" (cpsr) : "memory" );
+}
+
+
+/* Build with PROFILE_ENABLE=1 to have the markers counted, otherwise they
+   compile away to nothing */
+#if( PROFILE_ENABLE == 1 )
+
+    /** @brief Define a marker, the label is what appears in the report */
+    #define PROFILE_MARKER( marker, label ) \
+        static profile_marker_t marker = { label, 0, 0, { 0 }, 0, 0 }
+
+    /** @brief Start counting for a marker in the current scope */
+    #define PROFILE_BEGIN( marker ) \
+        profile_scope_t marker##_scope; \
+        profile_begin( &marker, &marker##_scope )
+
+    /** @brief Stop counting for a marker started in the same scope */
+    #define PROFILE_END( marker ) \
+        profile_end( &marker##_scope )
+
+#else
+
+    #define PROFILE_MARKER( marker, label )
+    #define PROFILE_BEGIN( marker )             do { } while( 0 )
+    #define PROFILE_END( marker )               do { } while( 0 )
+
+#endif
+
+#endif
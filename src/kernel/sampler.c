@@ -0,0 +1,105 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sampler.h"
+
+/* Start and end of the code, from the linker script */
+extern char __executable_start[];
+extern char _etext[];
+
+sampler_t kernel_sampler;
+
+
+/**
+    @brief Size the histogram to cover .text and clear it, sampling starts
+    off stopped
+*/
+void sampler_init( void )
+{
+    uint32_t size = (uint32_t)_etext - (uint32_t)__executable_start;
+
+    kernel_sampler.enabled = 0;
+    kernel_sampler.base = (uint32_t)__executable_start;
+
+    /* ARM instructions are word aligned, so a bucket is never smaller than
+       one instruction */
+    kernel_sampler.shift = 2;
+    while( ( SAMPLER_BUCKETS << kernel_sampler.shift ) < size )
+        kernel_sampler.shift++;
+
+    kernel_sampler.span = SAMPLER_BUCKETS << kernel_sampler.shift;
+
+    sampler_reset();
+}
+
+
+void sampler_start( void )
+{
+    kernel_sampler.enabled = 1;
+}
+
+
+void sampler_stop( void )
+{
+    kernel_sampler.enabled = 0;
+}
+
+
+void sampler_reset( void )
+{
+    int enabled = kernel_sampler.enabled;
+    int bucket;
+
+    kernel_sampler.enabled = 0;
+
+    kernel_sampler.total = 0;
+    kernel_sampler.outside = 0;
+
+    for( bucket = 0; bucket < SAMPLER_BUCKETS; bucket++ )
+        kernel_sampler.buckets[bucket] = 0;
+
+    kernel_sampler.enabled = enabled;
+}
+
+
+/**
+    @brief Print every non-empty bucket to stdout (the UART)
+
+    The output is meant for tools/samples.py, which resolves the bucket
+    addresses against the symbols in kernel.elf or kernel.map. Sampling is
+    paused while the histogram is printed so the dump is consistent.
+*/
+void sampler_dump( void )
+{
+    int enabled = kernel_sampler.enabled;
+    int bucket;
+
+    kernel_sampler.enabled = 0;
+
+    printf( "SAMPLES BEGIN base=%8.8X shift=%u total=%u outside=%u\r\n",
+            (unsigned int)kernel_sampler.base,
+            (unsigned int)kernel_sampler.shift,
+            (unsigned int)kernel_sampler.total,
+            (unsigned int)kernel_sampler.outside );
+
+    for( bucket = 0; bucket < SAMPLER_BUCKETS; bucket++ )
+    {
+        if( kernel_sampler.buckets[bucket] == 0 )
+            continue;
+
+        printf( "SAMPLE %8.8X %u\r\n",
+                (unsigned int)( kernel_sampler.base + ( bucket << kernel_sampler.shift ) ),
+                (unsigned int)kernel_sampler.buckets[bucket] );
+    }
+
+    printf( "SAMPLES END\r\n" );
+
+    kernel_sampler.enabled = enabled;
+}
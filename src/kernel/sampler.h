@@ -0,0 +1,63 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_SAMPLER_H
+#define KERNEL_SAMPLER_H
+
+#include <stdint.h>
+
+/** @brief Number of histogram buckets. The bucket width is the smallest
+    power of two that lets the buckets cover the whole of .text */
+#define SAMPLER_BUCKETS         4096
+
+/** @brief Statistical PC sampling profiler
+
+    A periodic interrupt handler calls sampler_record() with the interrupted
+    PC, which bumps one counter in a fixed histogram over the kernel's code.
+    There is no allocation and the per-sample cost is a compare, a shift and
+    an increment, so it can be left running.
+
+    Code that runs with interrupts masked is never sampled, its time is
+    charged to the instruction where interrupts are unmasked again. */
+typedef struct {
+    uint32_t base;
+    uint32_t shift;
+    uint32_t span;
+    uint32_t total;
+    uint32_t outside;
+    volatile int enabled;
+    uint32_t buckets[SAMPLER_BUCKETS];
+    } sampler_t;
+
+extern sampler_t kernel_sampler;
+
+extern void sampler_init( void );
+extern void sampler_start( void );
+extern void sampler_stop( void );
+extern void sampler_reset( void );
+extern void sampler_dump( void );
+
+
+/**
+    @brief Count one sample, called from interrupt context
+*/
+static inline void sampler_record( uint32_t pc )
+{
+    uint32_t offset = pc - kernel_sampler.base;
+
+    if( !kernel_sampler.enabled )
+        return;
+
+    kernel_sampler.total++;
+
+    if( offset < kernel_sampler.span )
+        kernel_sampler.buckets[offset >> kernel_sampler.shift]++;
+    else
+        kernel_sampler.outside++;
+}
+
+#endif
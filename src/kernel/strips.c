@@ -0,0 +1,184 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "arch/barrier.h"
+#include "arch/pmu.h"
+#include "arch/smp.h"
+
+#include "strips.h"
+#include "workqueue.h"
+
+/* The frame being rendered. Written by core 0 before the workers are
+   queued, only next changes whilst they run */
+static struct {
+    const gradient_target_t* target;
+    fixed_t green;
+    uint32_t strips;
+    volatile uint32_t next;
+    barrier_t barrier;
+    } frame;
+
+static strips_core_t per_core[SMP_CORES];
+
+/* Cores taking part, core 0 plus the first cores - 1 secondaries */
+static int cores = 1;
+static int cores_available = 1;
+
+/* Time core 0 spent in strips_render(), the wall clock for the busy figures */
+static uint64_t frame_cycles;
+static uint32_t frames;
+
+
+/**
+    @brief Claim and render strips until there are none left, then wait for
+    the other cores to finish theirs
+*/
+static void strips_worker( void* param )
+{
+    strips_core_t* self = &per_core[smp_core_id()];
+    uint32_t start = pmu_cycles();
+    uint32_t strip;
+    int first;
+
+    /* The add is a LDREX/STREX loop so every strip is claimed exactly once */
+    while( ( strip = __atomic_fetch_add( &frame.next, 1, __ATOMIC_RELAXED ) ) < frame.strips )
+    {
+        first = strip * STRIPS_ROWS;
+        gradient_render_rows( frame.target, frame.green, first, first + STRIPS_ROWS );
+        self->strips++;
+    }
+
+    self->busy_cycles += pmu_cycles() - start;
+
+    barrier_wait( &frame.barrier, &self->sense );
+}
+
+
+/**
+    @brief Set up the scheduler for the cores smp_init() brought up, all of
+    them are used
+*/
+void strips_init( int available )
+{
+    cores_available = ( available < 1 ) ? 1 : available;
+    strips_set_cores( cores_available );
+    strips_reset();
+}
+
+
+/**
+    @brief Change how many cores render each frame, must be called between
+    frames
+
+    @return The number of cores that will be used
+*/
+int strips_set_cores( int count )
+{
+    int core;
+
+    if( count < 1 )
+        count = 1;
+
+    if( count > cores_available )
+        count = cores_available;
+
+    /* Make sure no worker is still on its way out of the barrier before
+       resetting it */
+    for( core = 1; core < cores; core++ )
+        workqueue_wait( core );
+
+    cores = count;
+    barrier_init( &frame.barrier, cores );
+
+    for( core = 0; core < SMP_CORES; core++ )
+        per_core[core].sense = 0;
+
+    return cores;
+}
+
+
+int strips_get_cores( void )
+{
+    return cores;
+}
+
+
+/**
+    @brief Render a frame of the gradient split into strips across the cores
+
+    Returns once every strip is done, so the frame can be presented. The
+    target must have been passed to gradient_init() first.
+*/
+void strips_render( const gradient_target_t* target, fixed_t green )
+{
+    uint32_t start = pmu_cycles();
+    int core;
+
+    frame.target = target;
+    frame.green = green;
+    frame.strips = ( target->height + STRIPS_ROWS - 1 ) / STRIPS_ROWS;
+    frame.next = 0;
+
+    /* Every core that is taking part has to reach the barrier, so keep
+       trying should a queue be full */
+    for( core = 1; core < cores; core++ )
+    {
+        while( workqueue_submit( core, strips_worker, NULL ) != 0 )
+        {
+            /* BLANK */
+        }
+    }
+
+    strips_worker( NULL );
+
+    frame_cycles += pmu_cycles() - start;
+    frames++;
+}
+
+
+/**
+    @brief Print how much of the frame time each core spent rendering
+*/
+void strips_dump( void )
+{
+    uint64_t wall = frame_cycles ? frame_cycles : 1;
+    int core;
+
+    printf( "Strips: %d core(s), %u frames, %u cycles/frame\r\n", cores,
+            (unsigned int)frames,
+            (unsigned int)( frame_cycles / ( frames ? frames : 1 ) ) );
+
+    for( core = 0; core < cores_available; core++ )
+    {
+        printf( "Core %d: %u strips, %llu busy cycles, %u%% busy\r\n", core,
+                (unsigned int)per_core[core].strips,
+                (unsigned long long)per_core[core].busy_cycles,
+                (unsigned int)( ( per_core[core].busy_cycles * 100 ) / wall ) );
+    }
+}
+
+
+/**
+    @brief Zero the statistics, must be called between frames
+*/
+void strips_reset( void )
+{
+    int core;
+
+    for( core = 0; core < SMP_CORES; core++ )
+    {
+        per_core[core].busy_cycles = 0;
+        per_core[core].strips = 0;
+    }
+
+    frame_cycles = 0;
+    frames = 0;
+}
@@ -0,0 +1,36 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_STRIPS_H
+#define KERNEL_STRIPS_H
+
+#include <stdint.h>
+
+#include "arch/cache.h"
+
+#include "gradient.h"
+
+/** @brief Rows in each strip a core claims. Small enough that the cores
+    finish close together, big enough that claiming is cheap */
+#define STRIPS_ROWS             16
+
+/** @brief Per-core state and statistics, a cache line each so the cores
+    don't share lines */
+typedef struct {
+    uint64_t busy_cycles;
+    uint32_t strips;
+    uint32_t sense;
+    } __attribute__((aligned(CACHE_LINE_SIZE))) strips_core_t;
+
+extern void strips_init( int cores );
+extern int strips_set_cores( int cores );
+extern int strips_get_cores( void );
+extern void strips_render( const gradient_target_t* target, fixed_t green );
+extern void strips_dump( void );
+extern void strips_reset( void );
+
+#endif
@@ -0,0 +1,172 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "hal/interrupts.h"
+#include "hal/timer.h"
+
+#include "kernel/task.h"
+#include "kernel/trace.h"
+
+/* Every task that hasn't finished, in the order they were started */
+static task_t* tasks = NULL;
+
+static task_stats_t stats;
+
+
+static void task_timer_expired( rpi_timer_t* timer, void* param )
+{
+    task_wake( (task_t*)param );
+}
+
+
+/**
+    @brief Add a task to the executor, it is first polled by the next
+    task_poll(). The task_t must stay put until the task has finished
+*/
+void task_start( task_t* task, const char* name, task_func_t func, void* param )
+{
+    task_t** link = &tasks;
+    uint32_t cpsr;
+
+    task->name = name;
+    task->func = func;
+    task->param = param;
+    task->resume = 0;
+    task->running = 1;
+    task->polls = 0;
+    task->wakes = 0;
+    task->stalls = 0;
+    task->next = NULL;
+    RPI_TimerSetup( &task->timer, task_timer_expired, task );
+
+    /* On the end, so a task started by another task during task_poll() can't
+       disturb the walk */
+    while( *link )
+        link = &( *link )->next;
+
+    cpsr = RPI_InterruptsSave();
+    *link = task;
+    RPI_InterruptsRestore( cpsr );
+
+    task_wake( task );
+}
+
+
+/**
+    @brief Have the task polled again, safe from interrupt handlers
+*/
+void task_wake( task_t* task )
+{
+    __atomic_fetch_add( &task->wakes, 1, __ATOMIC_RELAXED );
+    task->ready = 1;
+}
+
+
+/**
+    @brief task_wake() for the HAL's void( void* ) callbacks, with the task
+    as the parameter
+*/
+void task_wake_callback( void* param )
+{
+    task_wake( (task_t*)param );
+}
+
+
+/**
+    @brief Property buffer callback for TASK_PROPERTY(), run from the mailbox
+    interrupt
+*/
+void task_property_done( rpi_property_t* property )
+{
+    task_wake( (task_t*)property->param );
+}
+
+
+/**
+    @brief Run every task that has been woken since it was last polled
+
+    Called from the main loop between other work, a task is never run from
+    anywhere else so tasks need no locking between themselves.
+
+    @return The number of tasks that were run
+*/
+int task_poll( void )
+{
+    task_t** link = &tasks;
+    task_t* task;
+    uint32_t resume;
+    int result;
+    int ran = 0;
+
+    stats.passes++;
+
+    while( ( task = *link ) != NULL )
+    {
+        if( task->ready )
+        {
+            /* Cleared first so a wake while it runs isn't lost */
+            task->ready = 0;
+            task->polls++;
+            stats.polls++;
+            ran++;
+
+            resume = task->resume;
+
+            TRACE( TRACE_TASK_BEGIN, task, resume );
+            result = task->func( task );
+            TRACE( TRACE_TASK_END, task, task->resume );
+
+            if( result == TASK_DONE )
+            {
+                *link = task->next;
+                task->running = 0;
+                continue;
+            }
+
+            if( task->resume == resume )
+                task->stalls++;
+        }
+
+        link = &task->next;
+    }
+
+    if( ran == 0 )
+        stats.idle_passes++;
+
+    return ran;
+}
+
+
+const task_stats_t* task_get_stats( void )
+{
+    return &stats;
+}
+
+
+void task_dump( void )
+{
+    const task_t* task;
+
+    printf( "Task              Polls    Wakes   Stalls\r\n" );
+
+    for( task = tasks; task; task = task->next )
+    {
+        printf( "%-14s %8u %8u %8u\r\n", task->name,
+                (unsigned int)task->polls,
+                (unsigned int)task->wakes,
+                (unsigned int)task->stalls );
+    }
+
+    printf( "Executor: %u passes, %u with nothing to do, %u polls\r\n",
+            (unsigned int)stats.passes,
+            (unsigned int)stats.idle_passes,
+            (unsigned int)stats.polls );
+}
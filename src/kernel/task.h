@@ -0,0 +1,134 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_TASK_H
+#define KERNEL_TASK_H
+
+#include <stdint.h>
+
+#include "hal/mailbox-interface.h"
+#include "hal/timer.h"
+
+/* Stackless tasks (protothreads) for I/O that would otherwise spin on a
+   status bit. A task is a function that is called again every time it is
+   woken and carries on from the last TASK_WAIT_UNTIL(), TASK_YIELD() or
+   TASK_SLEEP() it returned from. They all share the stack of whatever calls
+   task_poll(), so waiting costs a few words in the task_t rather than a
+   thread.
+
+   Because the resume point is a case label:
+   - Local variables don't survive a wait, keep state in the task or what
+     its param points to
+   - A task can't wait from inside a switch statement of its own
+   - Only one wait per line of source, the line number is the label
+
+   Tasks are woken by task_wake(), from an interrupt handler, a timer or a
+   property buffer callback, and are only ever run by task_poll() on the
+   core that started them. */
+
+/** @brief What a task function returns to the executor */
+#define TASK_WAITING    0
+#define TASK_DONE       1
+
+struct task;
+
+typedef int (*task_func_t)( struct task* task );
+
+typedef struct task {
+    const char* name;
+    task_func_t func;
+    void* param;
+
+    /** Where to carry on from, the line of the last wait or 0 to start
+        from the top */
+    uint32_t resume;
+
+    /** Set by task_wake(), cleared as the task is polled */
+    volatile int ready;
+
+    /** Set while the task is on the executor's list */
+    int running;
+
+    /** Wakes the task for TASK_SLEEP() */
+    rpi_timer_t timer;
+
+    /** Times polled, times woken, and polls that found the task still
+        waiting where it was, which were wasted */
+    uint32_t polls;
+    volatile uint32_t wakes;
+    uint32_t stalls;
+
+    struct task* next;
+    } task_t;
+
+/** @brief Executor statistics */
+typedef struct {
+    uint32_t passes;        /**< Calls to task_poll() */
+    uint32_t idle_passes;   /**< Calls that found nothing to run */
+    uint32_t polls;         /**< Task functions called */
+    } task_stats_t;
+
+
+#define TASK_BEGIN( task )                                                  \
+    switch( ( task )->resume )                                              \
+    {                                                                       \
+        case 0:
+
+#define TASK_END( task )                                                    \
+    }                                                                       \
+    ( task )->resume = 0;                                                   \
+    return TASK_DONE
+
+/** @brief Return to the executor until woken with condition true. The
+    condition is checked again every time the task is woken */
+#define TASK_WAIT_UNTIL( task, condition )                                  \
+    do                                                                      \
+    {                                                                       \
+        ( task )->resume = __LINE__;                                        \
+        case __LINE__:                                                      \
+        if( !( condition ) )                                                \
+            return TASK_WAITING;                                            \
+    } while( 0 )
+
+/** @brief Let the other tasks run, the task is polled again next time
+    round */
+#define TASK_YIELD( task )                                                  \
+    do                                                                      \
+    {                                                                       \
+        task_wake( task );                                                  \
+        ( task )->resume = __LINE__;                                        \
+        return TASK_WAITING;                                                \
+        case __LINE__:;                                                     \
+    } while( 0 )
+
+/** @brief Wait at least us microseconds on the timer service */
+#define TASK_SLEEP( task, us )                                              \
+    do                                                                      \
+    {                                                                       \
+        RPI_TimerStart( &( task )->timer, ( us ), 0 );                      \
+        TASK_WAIT_UNTIL( task, !RPI_TimerPending( &( task )->timer ) );     \
+    } while( 0 )
+
+/** @brief Send a property buffer to the firmware and wait for the answer.
+    If the buffer couldn't be sent this doesn't wait, and
+    RPI_PropertyBufferGet() finds no responses */
+#define TASK_PROPERTY( task, property )                                     \
+    do                                                                      \
+    {                                                                       \
+        RPI_PropertyBufferSubmit( ( property ), task_property_done, ( task ) ); \
+        TASK_WAIT_UNTIL( task, RPI_PropertyBufferDone( property ) );        \
+    } while( 0 )
+
+extern void task_start( task_t* task, const char* name, task_func_t func, void* param );
+extern void task_wake( task_t* task );
+extern void task_wake_callback( void* param );
+extern void task_property_done( rpi_property_t* property );
+extern int task_poll( void );
+extern const task_stats_t* task_get_stats( void );
+extern void task_dump( void );
+
+#endif
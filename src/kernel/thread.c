@@ -0,0 +1,698 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arch/smp.h"
+
+#include "hal/interrupts.h"
+#include "hal/timer.h"
+
+#include "kernel/clock.h"
+#include "kernel/heap.h"
+#include "kernel/pool.h"
+#include "kernel/thread.h"
+#include "kernel/trace.h"
+
+POOL_DECLARE( thread_pool, thread_t )
+POOL_DEFINE( thread_pool, thread_t, THREAD_MAX );
+
+/* See start.S */
+extern void _thread_switch( uint32_t** save_sp, uint32_t* load_sp );
+extern void _thread_start( void );
+
+/* kernel_main(), running on the boot stack */
+static thread_t boot_thread;
+
+static thread_t* current = NULL;
+
+/* A list per priority, and a bit per priority set while its list isn't
+   empty so the highest ready thread is found with a single CLZ */
+static thread_list_t ready[THREAD_PRIORITIES];
+static uint32_t ready_bitmap = 0;
+
+/* Every thread, for thread_dump() */
+static thread_t* threads[THREAD_MAX];
+
+/* Threads that have exited. Their stacks are freed by the idle thread, as
+   they can't be while the thread is still on them */
+static thread_list_t zombies;
+
+/* Set when a thread has been made ready that should run in place of the
+   current one, acted on by thread_preempt() on the way out of the
+   interrupt */
+static volatile int need_resched = 0;
+
+static rpi_timer_t slice_timer;
+
+static thread_stats_t stats = { 0, 0, 0, 0xFFFFFFFF, 0, 0 };
+
+static const char* state_names[] = { "ready", "running", "blocked", "dead" };
+
+
+static inline void list_init( thread_list_t* list )
+{
+    list->head = NULL;
+    list->tail = NULL;
+}
+
+
+static inline void list_append( thread_list_t* list, thread_t* thread )
+{
+    thread->next = NULL;
+
+    if( list->tail )
+        list->tail->next = thread;
+    else
+        list->head = thread;
+
+    list->tail = thread;
+}
+
+
+static inline thread_t* list_pop( thread_list_t* list )
+{
+    thread_t* thread = list->head;
+
+    if( thread )
+    {
+        list->head = thread->next;
+        if( list->head == NULL )
+            list->tail = NULL;
+
+        thread->next = NULL;
+    }
+
+    return thread;
+}
+
+
+/**
+    @brief Take the highest priority thread off a wait list, the first of
+    them if there are several
+*/
+static thread_t* list_pop_highest( thread_list_t* list )
+{
+    thread_t* best = list->head;
+    thread_t* best_prev = NULL;
+    thread_t* prev = NULL;
+    thread_t* thread;
+
+    if( best == NULL )
+        return NULL;
+
+    for( thread = list->head; thread; prev = thread, thread = thread->next )
+    {
+        if( thread->priority > best->priority )
+        {
+            best = thread;
+            best_prev = prev;
+        }
+    }
+
+    if( best_prev )
+        best_prev->next = best->next;
+    else
+        list->head = best->next;
+
+    if( list->tail == best )
+        list->tail = best_prev;
+
+    best->next = NULL;
+
+    return best;
+}
+
+
+/**
+    @brief The highest priority with a ready thread, the bitmap must not be
+    empty
+*/
+static inline int highest_ready( void )
+{
+    return 31 - __builtin_clz( ready_bitmap );
+}
+
+
+static void ready_push( thread_t* thread )
+{
+    thread->state = THREAD_READY;
+    list_append( &ready[thread->priority], thread );
+    ready_bitmap |= ( 1 << thread->priority );
+}
+
+
+static thread_t* ready_pop( void )
+{
+    int priority = highest_ready();
+    thread_t* thread = list_pop( &ready[priority] );
+
+    if( ready[priority].head == NULL )
+        ready_bitmap &= ~( 1 << priority );
+
+    return thread;
+}
+
+
+/**
+    @brief Start the time slice if another thread is waiting its turn at the
+    current priority. Nothing ticks while the current thread has its
+    priority to itself
+*/
+static void slice_arm( void )
+{
+    if( ( ready_bitmap & ( 1 << current->priority ) ) && !RPI_TimerPending( &slice_timer ) )
+        RPI_TimerStart( &slice_timer, THREAD_SLICE_US, 0 );
+}
+
+
+static void slice_expired( rpi_timer_t* timer, void* param )
+{
+    if( current && ready_bitmap && ( highest_ready() >= current->priority ) )
+        need_resched = 1;
+}
+
+
+/**
+    @brief Switch to the highest priority ready thread. The current thread
+    must already be on the ready queue, a wait list or the zombie list.
+    Called with interrupts masked
+*/
+static void schedule( void )
+{
+    thread_t* prev = current;
+    thread_t* next = ready_pop();
+    uint32_t latency;
+
+    need_resched = 0;
+    next->state = THREAD_RUNNING;
+
+    if( next == prev )
+        return;
+
+    /* Only threads that were woken count towards the latency, not ones
+       that were just waiting for their turn */
+    if( next->ready_ticks )
+    {
+        latency = (uint32_t)( clock_ticks() - next->ready_ticks );
+        next->ready_ticks = 0;
+
+        stats.latency_count++;
+        stats.latency_total += latency;
+        if( latency < stats.latency_min )
+            stats.latency_min = latency;
+        if( latency > stats.latency_max )
+            stats.latency_max = latency;
+    }
+
+    stats.switches++;
+    next->runs++;
+    current = next;
+
+    slice_arm();
+
+    TRACE( TRACE_THREAD_SWITCH, prev, next );
+    _thread_switch( &prev->sp, next->sp );
+}
+
+
+/**
+    @brief Make a blocked thread ready, from a thread or an interrupt
+    handler. Called with interrupts masked
+*/
+static void thread_wake( thread_t* thread )
+{
+    thread->ready_ticks = clock_ticks();
+    ready_push( thread );
+
+    if( current == NULL )
+        return;
+
+    if( thread->priority > current->priority )
+        need_resched = 1;
+    else
+        slice_arm();
+}
+
+
+/**
+    @brief Give the core up if a thread that outranks the current one was
+    woken. From an interrupt handler that has to wait for thread_preempt()
+*/
+static void resched( void )
+{
+    if( need_resched && !RPI_IrqActive() )
+    {
+        ready_push( current );
+        schedule();
+    }
+}
+
+
+/**
+    @brief Put the current thread to sleep on a wait list, or none for
+    thread_sleep(), and run something else. Called with interrupts masked
+*/
+static void block( thread_list_t* list )
+{
+    current->state = THREAD_BLOCKED;
+
+    if( list )
+        list_append( list, current );
+
+    schedule();
+}
+
+
+static void sleep_expired( rpi_timer_t* timer, void* param )
+{
+    thread_t* thread = (thread_t*)param;
+
+    if( thread->state == THREAD_BLOCKED )
+        thread_wake( thread );
+}
+
+
+static void thread_register( thread_t* thread )
+{
+    int i;
+
+    for( i = 0; i < THREAD_MAX; i++ )
+    {
+        if( threads[i] == NULL )
+        {
+            threads[i] = thread;
+            return;
+        }
+    }
+}
+
+
+static void thread_unregister( thread_t* thread )
+{
+    int i;
+
+    for( i = 0; i < THREAD_MAX; i++ )
+    {
+        if( threads[i] == thread )
+            threads[i] = NULL;
+    }
+}
+
+
+/**
+    @brief Free the threads that have exited
+*/
+static void reap( void )
+{
+    thread_t* thread;
+    uint32_t cpsr;
+
+    while( 1 )
+    {
+        cpsr = RPI_InterruptsSave();
+
+        if( ( thread = list_pop( &zombies ) ) != NULL )
+            thread_unregister( thread );
+
+        RPI_InterruptsRestore( cpsr );
+
+        if( thread == NULL )
+            return;
+
+        heap_free( thread->stack );
+        thread_pool_free( thread );
+    }
+}
+
+
+static void idle_main( void* arg )
+{
+    while( 1 )
+    {
+        reap();
+        __asm__ __volatile__( "wfi" );
+    }
+}
+
+
+/**
+    @brief Turn the caller into the first thread, at priority, and start the
+    idle thread. Needs the heap, the object pools and the timer service
+*/
+void thread_init( int priority )
+{
+    int i;
+
+    for( i = 0; i < THREAD_PRIORITIES; i++ )
+        list_init( &ready[i] );
+
+    list_init( &zombies );
+
+    boot_thread.name = "main";
+    boot_thread.priority = priority;
+    boot_thread.state = THREAD_RUNNING;
+    boot_thread.next = NULL;
+    boot_thread.stack = NULL;
+    boot_thread.stack_size = 0;
+    boot_thread.wait_mask = 0;
+    boot_thread.ready_ticks = 0;
+    boot_thread.runs = 1;
+    RPI_TimerSetup( &boot_thread.timer, sleep_expired, &boot_thread );
+
+    thread_register( &boot_thread );
+    current = &boot_thread;
+
+    RPI_TimerSetup( &slice_timer, slice_expired, NULL );
+
+    thread_create( "idle", idle_main, NULL, THREAD_PRIORITY_IDLE, 2048 );
+}
+
+
+/**
+    @brief Start a new thread running entry( arg ). It runs straight away if
+    it outranks the caller
+
+    @param stack_size Bytes of stack, THREAD_STACK_DEFAULT if 0
+
+    @return The thread, NULL if there is no memory or too many threads
+*/
+thread_t* thread_create( const char* name, thread_entry_t entry, void* arg,
+                         int priority, uint32_t stack_size )
+{
+    thread_t* thread;
+    uint32_t* sp;
+    uint32_t cpsr;
+    uint32_t i;
+
+    if( ( priority < 0 ) || ( priority > THREAD_PRIORITY_MAX ) )
+        return NULL;
+
+    if( stack_size == 0 )
+        stack_size = THREAD_STACK_DEFAULT;
+
+    stack_size = ( stack_size + 7 ) & ~7;
+
+    /* The idle thread only gets to free the dead when nothing else wants
+       the core, so make room here too */
+    reap();
+
+    if( ( thread = thread_pool_alloc() ) == NULL )
+        return NULL;
+
+    if( ( thread->stack = heap_malloc( stack_size ) ) == NULL )
+    {
+        thread_pool_free( thread );
+        return NULL;
+    }
+
+    thread->name = name;
+    thread->priority = priority;
+    thread->next = NULL;
+    thread->stack_size = stack_size;
+    thread->wait_mask = 0;
+    thread->ready_ticks = 0;
+    thread->runs = 0;
+    RPI_TimerSetup( &thread->timer, sleep_expired, thread );
+
+    for( i = 0; i < ( stack_size / 4 ); i++ )
+        thread->stack[i] = THREAD_STACK_PAINT;
+
+    /* The frame _thread_switch pops: FPSCR and a pad word, d8-d15, then
+       r4-r12 and the pc. r4 and r5 carry the entry point and its argument
+       to _thread_start */
+    sp = thread->stack + ( stack_size / 4 ) - 28;
+    memset( sp, 0, 28 * 4 );
+    sp[18] = (uint32_t)entry;
+    sp[19] = (uint32_t)arg;
+    sp[27] = (uint32_t)_thread_start;
+    thread->sp = sp;
+
+    cpsr = RPI_InterruptsSave();
+
+    thread_register( thread );
+    thread_wake( thread );
+    resched();
+
+    RPI_InterruptsRestore( cpsr );
+
+    return thread;
+}
+
+
+thread_t* thread_current( void )
+{
+    return current;
+}
+
+
+/**
+    @brief Let the other ready threads of the same priority run
+*/
+void thread_yield( void )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+
+    ready_push( current );
+    schedule();
+
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+/**
+    @brief Block for at least us microseconds
+*/
+void thread_sleep( uint32_t us )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+
+    RPI_TimerStart( &current->timer, us, 0 );
+    block( NULL );
+
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+/**
+    @brief End the calling thread, which is also what returning from its
+    entry point does
+*/
+void thread_exit( void )
+{
+    RPI_InterruptsSave();
+
+    current->state = THREAD_DEAD;
+
+    /* The boot stack isn't the heap's to free */
+    if( current->stack )
+        list_append( &zombies, current );
+
+    schedule();
+
+    while( 1 )
+    {
+        /* Never switched back to */
+    }
+}
+
+
+/**
+    @brief Called by _irq_entry once the handlers have run, with interrupts
+    masked. Switches to a thread the handlers woke if it outranks the one
+    that was interrupted, or to the next in line if its time slice is up
+*/
+void thread_preempt( void )
+{
+    if( !need_resched || ( current == NULL ) || ( smp_core_id() != 0 ) )
+        return;
+
+    need_resched = 0;
+
+    if( ( ready_bitmap == 0 ) || ( highest_ready() < current->priority ) )
+        return;
+
+    stats.preemptions++;
+
+    ready_push( current );
+    schedule();
+}
+
+
+void thread_sem_init( thread_sem_t* sem, int count )
+{
+    sem->count = count;
+    list_init( &sem->waiters );
+}
+
+
+/**
+    @brief Take one from the count, blocking until there is one to take
+*/
+void thread_sem_wait( thread_sem_t* sem )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+
+    /* Otherwise thread_sem_post() hands the count straight to us */
+    if( sem->count > 0 )
+        sem->count--;
+    else
+        block( &sem->waiters );
+
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+/**
+    @brief Add one to the count, or wake the highest priority waiter. Can be
+    called from an interrupt handler
+*/
+void thread_sem_post( thread_sem_t* sem )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+    thread_t* thread;
+
+    if( ( thread = list_pop_highest( &sem->waiters ) ) != NULL )
+        thread_wake( thread );
+    else
+        sem->count++;
+
+    resched();
+
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+void thread_event_init( thread_event_t* event )
+{
+    event->flags = 0;
+    list_init( &event->waiters );
+}
+
+
+/**
+    @brief Block until any of the flags in mask are set
+
+    @return The flags from mask that were set, which are cleared
+*/
+uint32_t thread_event_wait( thread_event_t* event, uint32_t mask )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+    uint32_t flags;
+
+    while( ( event->flags & mask ) == 0 )
+    {
+        current->wait_mask = mask;
+        block( &event->waiters );
+    }
+
+    flags = event->flags & mask;
+    event->flags &= ~flags;
+
+    RPI_InterruptsRestore( cpsr );
+
+    return flags;
+}
+
+
+/**
+    @brief Set flags, waking every thread waiting on any of them. Can be
+    called from an interrupt handler
+*/
+void thread_event_set( thread_event_t* event, uint32_t flags )
+{
+    uint32_t cpsr = RPI_InterruptsSave();
+    thread_list_t waiting = event->waiters;
+    thread_t* thread;
+
+    event->flags |= flags;
+
+    /* Whoever runs first takes the flags, the rest go back to waiting */
+    list_init( &event->waiters );
+
+    while( ( thread = list_pop( &waiting ) ) != NULL )
+    {
+        if( thread->wait_mask & flags )
+            thread_wake( thread );
+        else
+            list_append( &event->waiters, thread );
+    }
+
+    resched();
+
+    RPI_InterruptsRestore( cpsr );
+}
+
+
+const thread_stats_t* thread_get_stats( void )
+{
+    return &stats;
+}
+
+
+/**
+    @brief Deepest a thread's stack has been, in bytes
+*/
+static uint32_t stack_used( const thread_t* thread )
+{
+    uint32_t words = thread->stack_size / 4;
+    uint32_t i;
+
+    if( thread->stack == NULL )
+        return 0;
+
+    for( i = 0; ( i < words ) && ( thread->stack[i] == THREAD_STACK_PAINT ); i++ )
+    {
+        /* BLANK */
+    }
+
+    return ( words - i ) * 4;
+}
+
+
+static uint32_t ticks_to_ns( uint64_t ticks )
+{
+    if( clock_calibration.frequency == 0 )
+        return 0;
+
+    return (uint32_t)( ( ticks * 1000000000ULL ) / clock_calibration.frequency );
+}
+
+
+void thread_dump( void )
+{
+    const thread_t* thread;
+    int i;
+
+    printf( "Thread       Pri  State       Runs  Stack\r\n" );
+
+    for( i = 0; i < THREAD_MAX; i++ )
+    {
+        if( ( thread = threads[i] ) == NULL )
+            continue;
+
+        printf( "%-12s %3d  %-8s %7u  %u/%u\r\n",
+                thread->name, thread->priority, state_names[thread->state],
+                (unsigned int)thread->runs,
+                (unsigned int)stack_used( thread ),
+                (unsigned int)thread->stack_size );
+    }
+
+    printf( "Switches: %u, %u preemptions\r\n",
+            (unsigned int)stats.switches,
+            (unsigned int)stats.preemptions );
+
+    if( stats.latency_count )
+        printf( "Wake to run: %u min %u avg %u max ns over %u wakes\r\n",
+                (unsigned int)ticks_to_ns( stats.latency_min ),
+                (unsigned int)ticks_to_ns( stats.latency_total / stats.latency_count ),
+                (unsigned int)ticks_to_ns( stats.latency_max ),
+                (unsigned int)stats.latency_count );
+}
@@ -0,0 +1,134 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_THREAD_H
+#define KERNEL_THREAD_H
+
+#include <stdint.h>
+
+#include "hal/timer.h"
+
+/* Preemptive threads on core 0, the core that takes the interrupts. The
+   other cores stay on their work queues.
+
+   The highest priority ready thread always runs. Threads of the same
+   priority share the core in time slices, and a thread woken from an
+   interrupt handler that outranks the one interrupted runs as soon as the
+   handler returns. Higher numbers are higher priorities. */
+
+/** @brief Priorities 0 to 31, one bit each in the ready bitmap */
+#define THREAD_PRIORITIES           32
+
+#define THREAD_PRIORITY_IDLE        0
+#define THREAD_PRIORITY_DEFAULT     8
+#define THREAD_PRIORITY_MAX         ( THREAD_PRIORITIES - 1 )
+
+/** @brief Most threads that can exist at once, the idle thread included */
+#define THREAD_MAX                  16
+
+/** @brief Stack size used when thread_create() is given 0 */
+#define THREAD_STACK_DEFAULT        4096
+
+/** @brief How long a thread runs before another ready thread of the same
+    priority gets a turn */
+#define THREAD_SLICE_US             10000
+
+/** @brief Unused stack is filled with this, so the deepest the stack has
+    been can be found */
+#define THREAD_STACK_PAINT          0xA5A5A5A5
+
+typedef enum {
+    THREAD_READY = 0,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,
+    THREAD_DEAD,
+    } thread_state_t;
+
+typedef void (*thread_entry_t)( void* arg );
+
+struct thread;
+
+/** @brief A list of threads, the ready queues and anything threads wait on */
+typedef struct {
+    struct thread* head;
+    struct thread* tail;
+    } thread_list_t;
+
+/** @brief Thread control block */
+typedef struct thread {
+    /** Saved stack pointer while not running, see _thread_switch in
+        start.S */
+    uint32_t* sp;
+
+    const char* name;
+    int priority;
+    thread_state_t state;
+
+    /** Next thread in whichever list this thread is on */
+    struct thread* next;
+
+    /** The stack, NULL for the boot thread which runs on the boot stack */
+    uint32_t* stack;
+    uint32_t stack_size;
+
+    /** Wakes the thread from thread_sleep() */
+    rpi_timer_t timer;
+
+    /** The event bits a blocked thread is waiting for */
+    uint32_t wait_mask;
+
+    /** Generic timer count when last made ready, for the switch latency */
+    uint64_t ready_ticks;
+
+    /** Times switched to */
+    uint32_t runs;
+    } thread_t;
+
+/** @brief Counting semaphore */
+typedef struct {
+    volatile int count;
+    thread_list_t waiters;
+    } thread_sem_t;
+
+/** @brief A set of event flags threads can wait on any of */
+typedef struct {
+    volatile uint32_t flags;
+    thread_list_t waiters;
+    } thread_event_t;
+
+/** @brief Scheduler statistics. Latency is the time from a thread being
+    made ready to it running, in generic timer ticks */
+typedef struct {
+    uint32_t switches;
+    uint32_t preemptions;
+    uint32_t latency_count;
+    uint32_t latency_min;
+    uint32_t latency_max;
+    uint64_t latency_total;
+    } thread_stats_t;
+
+extern void thread_init( int priority );
+extern thread_t* thread_create( const char* name, thread_entry_t entry, void* arg,
+                                int priority, uint32_t stack_size );
+extern thread_t* thread_current( void );
+extern void thread_yield( void );
+extern void thread_sleep( uint32_t us );
+extern void thread_exit( void );
+extern void thread_preempt( void );
+
+extern void thread_sem_init( thread_sem_t* sem, int count );
+extern void thread_sem_wait( thread_sem_t* sem );
+extern void thread_sem_post( thread_sem_t* sem );
+
+extern void thread_event_init( thread_event_t* event );
+extern uint32_t thread_event_wait( thread_event_t* event, uint32_t mask );
+extern void thread_event_set( thread_event_t* event, uint32_t flags );
+
+extern const thread_stats_t* thread_get_stats( void );
+extern void thread_dump( void );
+
+#endif
@@ -0,0 +1,90 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "hal/console.h"
+
+#include "kernel/clock.h"
+#include "kernel/trace.h"
+
+trace_ring_t trace_rings[SMP_CORES];
+
+/* Cleared while the rings are being dumped so they hold still */
+volatile int trace_enabled = TRACE_ENABLE;
+
+/* start.S finds the rings and records with these */
+_Static_assert( offsetof( trace_ring_t, entries ) == TRACE_RING_ENTRIES, "TRACE_RING_ENTRIES" );
+_Static_assert( sizeof( trace_ring_t ) == TRACE_RING_SIZE, "TRACE_RING_SIZE" );
+_Static_assert( sizeof( trace_entry_t ) == 16, "trace_entry_t" );
+
+
+/**
+    @brief Send every core's ring over the UART
+
+    Each ring is a line of text followed by the records in binary, oldest
+    first, 16 bytes each in little endian:
+
+        TRACE BEGIN core=<n> count=<records> frequency=<Hz>
+        <count * 16 bytes>
+        TRACE END
+
+    which tools/trace2chrome.py picks out of a capture of the UART.
+    Recording stops while the dump is going out.
+*/
+void trace_dump( void )
+{
+    const trace_ring_t* ring;
+    const uint8_t* bytes;
+    uint32_t head;
+    uint32_t count;
+    uint32_t i;
+    int enabled = trace_enabled;
+    int core;
+    int b;
+
+    trace_enabled = 0;
+
+    for( core = 0; core < SMP_CORES; core++ )
+    {
+        ring = &trace_rings[core];
+        head = ring->head;
+        count = ( head > TRACE_ENTRIES ) ? TRACE_ENTRIES : head;
+
+        printf( "TRACE BEGIN core=%d count=%u frequency=%u\r\n", core,
+                (unsigned int)count, (unsigned int)clock_calibration.frequency );
+
+        /* Don't let the binary overtake text still in the stdio buffer */
+        fflush( stdout );
+
+        for( i = head - count; i != head; i++ )
+        {
+            bytes = (const uint8_t*)&ring->entries[i & ( TRACE_ENTRIES - 1 )];
+
+            for( b = 0; b < sizeof( trace_entry_t ); b++ )
+                RPI_ConsoleWrite( bytes[b] );
+        }
+
+        printf( "TRACE END\r\n" );
+    }
+
+    trace_enabled = enabled;
+}
+
+
+/**
+    @brief Empty every core's ring
+*/
+void trace_reset( void )
+{
+    int core;
+
+    for( core = 0; core < SMP_CORES; core++ )
+        trace_rings[core].head = 0;
+}
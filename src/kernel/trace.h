@@ -0,0 +1,131 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_TRACE_H
+#define KERNEL_TRACE_H
+
+/* Event trace. Each core has a ring of fixed size records, timestamped with
+   the generic timer, that old records are overwritten in. trace_dump()
+   sends the rings over the UART in binary and tools/trace2chrome.py turns
+   that into a Chrome/Perfetto trace.
+
+   Build with TRACE_ENABLE=1 to record, otherwise TRACE() compiles away to
+   nothing. This header is also included by start.S, so the event IDs are
+   plain defines. tools/trace2chrome.py has the same table, keep them in
+   step. */
+
+#define TRACE_IRQ_ENTER             1   /**< arg0 interrupted PC */
+#define TRACE_IRQ_EXIT              2
+#define TRACE_IRQ_HANDLER_BEGIN     3   /**< arg0 IRQ number */
+#define TRACE_IRQ_HANDLER_END       4   /**< arg0 IRQ number */
+#define TRACE_FRAME_BEGIN           5   /**< arg0 frame number */
+#define TRACE_FRAME_END             6   /**< arg0 frame number */
+#define TRACE_MAILBOX_SUBMIT        7   /**< arg0 channel, arg1 message */
+#define TRACE_MAILBOX_COMPLETE      8   /**< arg0 channel, arg1 message */
+#define TRACE_THREAD_SWITCH         9   /**< arg0 from, arg1 to thread_t */
+#define TRACE_TASK_BEGIN            10  /**< arg0 task_t */
+#define TRACE_TASK_END              11  /**< arg0 task_t */
+
+/** @brief IDs from here up are free for temporary instrumentation, they show
+    up as instant events */
+#define TRACE_USER                  0x100
+
+#ifndef TRACE_ENABLE
+    #define TRACE_ENABLE            0
+#endif
+
+/** @brief Records in each core's ring, must be a power of two. At 16 bytes
+    each that's 32KB a core */
+#ifndef TRACE_ENTRIES
+    #define TRACE_ENTRIES           2048
+#endif
+
+/* Where the records start in a trace_ring_t and the size of one, for the
+   IRQ entry in start.S which writes its records itself. trace.c checks
+   these against the struct */
+#define TRACE_RING_ENTRIES          64
+#define TRACE_RING_SIZE             ( TRACE_RING_ENTRIES + ( 16 * TRACE_ENTRIES ) )
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+#include "arch/cache.h"
+#include "arch/gtimer.h"
+#include "arch/smp.h"
+
+/** @brief One record, exactly as it is sent by trace_dump(). The timestamp
+    is the low 48 bits of the generic timer count, which takes months to
+    wrap */
+typedef struct {
+    uint32_t time_lo;
+    uint16_t time_hi;
+    uint16_t event;
+    uint32_t arg0;
+    uint32_t arg1;
+    } trace_entry_t;
+
+/** @brief A core's ring. Only ever written by its own core, so there's no
+    lock and no cache line is shared with another core. head counts every
+    record ever written, the ring holds the last TRACE_ENTRIES of them */
+typedef struct {
+    volatile uint32_t head;
+    trace_entry_t entries[TRACE_ENTRIES] __attribute__((aligned(CACHE_LINE_SIZE)));
+    } __attribute__((aligned(CACHE_LINE_SIZE))) trace_ring_t;
+
+extern trace_ring_t trace_rings[SMP_CORES];
+extern volatile int trace_enabled;
+
+extern void trace_dump( void );
+extern void trace_reset( void );
+
+
+/**
+    @brief Add a record to this core's ring
+
+    The slot is claimed with LDREX/STREX before it is filled in, so an
+    interrupt that traces part way through gets a slot of its own rather
+    than overwriting this one. The records can then be a few ticks out of
+    order, the converter sorts them.
+*/
+static inline void trace_write( uint32_t event, uint32_t arg0, uint32_t arg1 )
+{
+    trace_ring_t* ring = &trace_rings[smp_core_id()];
+    trace_entry_t* entry;
+    uint64_t now;
+
+    if( !trace_enabled )
+        return;
+
+    entry = &ring->entries[__atomic_fetch_add( &ring->head, 1, __ATOMIC_RELAXED ) &
+                           ( TRACE_ENTRIES - 1 )];
+
+    now = gtimer_count_unordered();
+
+    entry->time_lo = (uint32_t)now;
+    entry->time_hi = (uint16_t)( now >> 32 );
+    entry->event = event;
+    entry->arg0 = arg0;
+    entry->arg1 = arg1;
+}
+
+
+#if( TRACE_ENABLE == 1 )
+
+    /** @brief Record an event with two arguments */
+    #define TRACE( event, arg0, arg1 ) \
+        trace_write( ( event ), (uint32_t)( arg0 ), (uint32_t)( arg1 ) )
+
+#else
+
+    #define TRACE( event, arg0, arg1 )          do { } while( 0 )
+
+#endif
+
+#endif /* __ASSEMBLER__ */
+
+#endif
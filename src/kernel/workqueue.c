@@ -0,0 +1,128 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "workqueue.h"
+
+/* Each queue is in its own cache lines so the cores don't fight over them */
+static workqueue_t queues[SMP_CORES];
+
+
+/**
+    @brief Queue a function to be run on a core
+
+    Work is run in the order it was submitted. Must not be called from an
+    IRQ handler.
+
+    @return 0 on success, -1 if the core number is bad or its queue is full
+*/
+int workqueue_submit( int core, work_func_t func, void* param )
+{
+    workqueue_t* queue;
+    uint32_t head;
+
+    if( ( core < 0 ) || ( core >= SMP_CORES ) )
+        return -1;
+
+    queue = &queues[core];
+
+    spin_lock( &queue->lock );
+
+    head = queue->head;
+    if( ( head - queue->tail ) >= WORKQUEUE_SIZE )
+    {
+        spin_unlock( &queue->lock );
+        return -1;
+    }
+
+    queue->items[head & ( WORKQUEUE_SIZE - 1 )].func = func;
+    queue->items[head & ( WORKQUEUE_SIZE - 1 )].param = param;
+
+    /* The item has to be visible before the head that publishes it */
+    __asm__ __volatile__( "dmb" ::: "memory" );
+    queue->head = head + 1;
+
+    /* Unlocking also wakes the owner up if it is waiting in WFE */
+    spin_unlock( &queue->lock );
+
+    return 0;
+}
+
+
+/**
+    @brief Run everything waiting in a queue, must be called on the core
+    that owns it
+
+    @return The number of items run
+*/
+int workqueue_poll( int core )
+{
+    workqueue_t* queue = &queues[core];
+    uint32_t tail = queue->tail;
+    work_t work;
+    int count = 0;
+
+    while( tail != queue->head )
+    {
+        __asm__ __volatile__( "dmb" ::: "memory" );
+        work = queue->items[tail & ( WORKQUEUE_SIZE - 1 )];
+
+        work.func( work.param );
+        count++;
+
+        /* Anything the work wrote has to be visible before it is seen to be
+           done */
+        __asm__ __volatile__( "dmb" ::: "memory" );
+        queue->tail = ++tail;
+        __asm__ __volatile__( "dsb\n\tsev" ::: "memory" );
+    }
+
+    return count;
+}
+
+
+/**
+    @brief Wait until everything submitted to a core so far has been run
+
+    When called on the core that owns the queue the work is run here
+    instead.
+*/
+void workqueue_wait( int core )
+{
+    workqueue_t* queue = &queues[core];
+    uint32_t head = queue->head;
+
+    if( core == smp_core_id() )
+    {
+        workqueue_poll( core );
+        return;
+    }
+
+    while( (int32_t)( queue->tail - head ) < 0 )
+        __asm__ __volatile__( "wfe" );
+
+    __asm__ __volatile__( "dmb" ::: "memory" );
+}
+
+
+/**
+    @brief Run a core's work for ever, sleeping whenever its queue is empty
+*/
+void workqueue_run( int core )
+{
+    workqueue_t* queue = &queues[core];
+
+    while( 1 )
+    {
+        while( queue->tail == queue->head )
+            __asm__ __volatile__( "wfe" );
+
+        workqueue_poll( core );
+    }
+}
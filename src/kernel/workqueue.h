@@ -0,0 +1,43 @@
+/*
+    Part of VensPi
+    Copyright (c) 2016, Jeramie Vens
+
+    Released under the MIT License, see the LICENSE file for details.
+*/
+
+#ifndef KERNEL_WORKQUEUE_H
+#define KERNEL_WORKQUEUE_H
+
+#include <stdint.h>
+
+#include "arch/cache.h"
+#include "arch/smp.h"
+#include "arch/spinlock.h"
+
+/** @brief Items each core's queue can hold, must be a power of two */
+#define WORKQUEUE_SIZE          64
+
+typedef void (*work_func_t)( void* param );
+
+typedef struct {
+    work_func_t func;
+    void* param;
+    } work_t;
+
+/** @brief One core's queue of work. Any core may submit, only the owning
+    core runs the work. The head is advanced under the lock by submitters
+    and the tail by the owner once an item has finished, so head == tail
+    means everything submitted has been run */
+typedef struct {
+    spinlock_t lock;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    work_t items[WORKQUEUE_SIZE];
+    } __attribute__((aligned(CACHE_LINE_SIZE))) workqueue_t;
+
+extern int workqueue_submit( int core, work_func_t func, void* param );
+extern int workqueue_poll( int core );
+extern void workqueue_wait( int core );
+extern void workqueue_run( int core );
+
+#endif
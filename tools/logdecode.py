@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+#
+#   Part of VensPi
+#   Copyright (c) 2016, Jeramie Vens
+#
+#   Released under the MIT License, see the LICENSE file for details.
+#
+"""Format the LOG() lines of a LOG_DEFERRED kernel from its ELF file.
+
+Build with LOG_DEFERRED=1 and run on a binary capture of the UART, or on
+the UART itself:
+
+    tools/logdecode.py kernel.elf uart.bin
+    tools/logdecode.py kernel.elf < /dev/ttyUSB0
+
+Everything that isn't a LOG() frame, printf() output and command replies,
+is passed through as it is. Trace dumps are skipped, run
+tools/trace2chrome.py on the raw capture for those. The ELF must be the one
+the Pi is running, the frames only hold offsets into its .logstr section.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+SYNC = 0x1E                 # LOG_SYNC in src/kernel/log.h
+MAX_ARGS = 8                # LOG_MAX_ARGS
+
+SHT_NOBITS = 8
+SHF_ALLOC = 2
+
+TRACE = re.compile(rb"TRACE BEGIN core=(\d+) count=(\d+) frequency=(\d+)\r?\n")
+TRACE_PREFIX = b"TRACE BEGIN"
+TRACE_RECORD = 16
+
+SPEC = re.compile(r"%([-+ #0]*)(\d+|\*)?(?:\.(\d*|\*))?(hh|h|ll|l|j|z|t|L)?"
+                  r"([diouxXcspfFeEgGaA%])")
+
+
+def elf_sections(path):
+    """Return (.logstr address, .logstr bytes, [(address, bytes)] of every
+    loaded section) from a 32-bit little-endian ELF"""
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if data[:4] != b"\x7fELF" or data[4] != 1 or data[5] != 1:
+        sys.exit("%s: not a 32-bit little-endian ELF" % path)
+
+    e_shoff, = struct.unpack_from("<I", data, 0x20)
+    e_shentsize, e_shnum, e_shstrndx = struct.unpack_from("<HHH", data, 0x2E)
+
+    sections = []
+    for i in range(e_shnum):
+        sections.append(struct.unpack_from("<IIIIIIIIII", data,
+                                           e_shoff + i * e_shentsize))
+
+    names = sections[e_shstrndx][4]
+    logstr = None
+    loaded = []
+
+    for sh in sections:
+        sh_name, sh_type, sh_flags, sh_addr, sh_offset, sh_size = sh[:6]
+        contents = data[sh_offset:sh_offset + sh_size]
+
+        end = data.index(b"\0", names + sh_name)
+        name = data[names + sh_name:end]
+
+        if name == b".logstr":
+            logstr = (sh_addr, contents)
+        elif (sh_flags & SHF_ALLOC) and sh_type != SHT_NOBITS:
+            loaded.append((sh_addr, contents))
+
+    if logstr is None:
+        sys.exit("%s: no .logstr section, was it built with LOG_DEFERRED=1?"
+                 % path)
+
+    return logstr[0], logstr[1], loaded
+
+
+def c_string(contents, offset):
+    end = contents.find(b"\0", offset)
+    if end < 0:
+        end = len(contents)
+    return contents[offset:end].decode("ascii", "replace")
+
+
+class Decoder:
+    def __init__(self, elf):
+        self.logstr_addr, self.logstr, self.loaded = elf_sections(elf)
+        self.formats = {}
+        self.pending = b""
+
+    def format_string(self, offset):
+        """The format at an offset in .logstr, None if it isn't one"""
+        if offset not in self.formats:
+            position = offset - self.logstr_addr
+            if position < 0 or position >= len(self.logstr):
+                return None
+            self.formats[offset] = c_string(self.logstr, position)
+        return self.formats[offset]
+
+    def string_at(self, address):
+        """A %s argument, looked up in the loaded sections"""
+        for base, contents in self.loaded:
+            if base <= address < base + len(contents):
+                return c_string(contents, address - base)
+        return "<%08x?>" % address
+
+    def format(self, fmt, args):
+        """printf() on the host, with the 32-bit words the Pi sent"""
+        args = list(args)
+
+        def next_arg():
+            return args.pop(0) if args else 0
+
+        def convert(match):
+            flags, width, precision, _, conversion = match.groups()
+
+            if conversion == "%":
+                return "%"
+
+            if width == "*":
+                width = str(struct.unpack("<i", struct.pack("<I",
+                                                            next_arg()))[0])
+            if precision == "*":
+                precision = str(next_arg())
+
+            spec = "%" + flags + (width or "")
+            if precision is not None:
+                spec += "." + (precision or "0")
+
+            value = next_arg()
+
+            if conversion in "di":
+                return (spec + "d") % struct.unpack("<i", struct.pack("<I",
+                                                                      value))[0]
+            if conversion == "u":
+                return (spec + "d") % value
+            if conversion in "oxX":
+                return (spec + conversion) % value
+            if conversion == "c":
+                return (spec + "c") % chr(value & 0xFF)
+            if conversion == "s":
+                return (spec + "s") % self.string_at(value)
+            if conversion == "p":
+                return (spec + "s") % ("0x%x" % value)
+
+            number = struct.unpack("<f", struct.pack("<I", value))[0]
+            if conversion in "aA":
+                text = number.hex()
+                return (spec + "s") % (text.upper() if conversion == "A"
+                                       else text)
+            return (spec + conversion) % number
+
+        return SPEC.sub(convert, fmt)
+
+    def frame(self, data, position):
+        """Decode the frame at position. Returns (text, length), (None, 0)
+        if more data is needed, or (None, -1) if it isn't a frame"""
+        if position + 4 > len(data):
+            return None, 0
+
+        count = data[position + 1]
+        offset = data[position + 2] | (data[position + 3] << 8)
+
+        if count > MAX_ARGS:
+            return None, -1
+
+        fmt = self.format_string(offset)
+        if fmt is None:
+            return None, -1
+
+        args = []
+        cursor = position + 4
+        for _ in range(count):
+            value = 0
+            shift = 0
+            while True:
+                if cursor >= len(data):
+                    return None, 0
+                byte = data[cursor]
+                cursor += 1
+                value |= (byte & 0x7F) << shift
+                shift += 7
+                if not byte & 0x80:
+                    break
+                if shift > 28:
+                    return None, -1
+            args.append(value & 0xFFFFFFFF)
+
+        return self.format(fmt, args), cursor - position
+
+    def feed(self, chunk, final=False):
+        """Decode what can be of the capture so far, holding on to a frame
+        or trace dump that's been cut off part way"""
+        data = self.pending + chunk
+        out = []
+        position = 0
+        text = 0
+
+        while position < len(data):
+            if data[position] == SYNC:
+                line, length = self.frame(data, position)
+                if length == 0 and not final:
+                    break
+                if length > 0:
+                    out.append(data[text:position])
+                    out.append(line.encode("ascii", "replace"))
+                    position += length
+                    text = position
+                    continue
+
+            elif data.startswith(b"T", position):
+                match = TRACE.match(data, position)
+                if match:
+                    end = match.end() + int(match.group(2)) * TRACE_RECORD
+                    if end > len(data) and not final:
+                        break
+                    out.append(data[text:position])
+                    out.append(("[trace dump of core %s, %s records]\r\n" %
+                                (match.group(1).decode(),
+                                 match.group(2).decode())).encode())
+                    position = end
+                    text = position
+                    continue
+
+                # Might be the start of a header still on its way
+                tail = data[position:position + len(TRACE_PREFIX)]
+                if (not final and b"\n" not in data[position:] and
+                        TRACE_PREFIX.startswith(tail)):
+                    break
+
+            position += 1
+
+        out.append(data[text:position])
+        self.pending = data[position:]
+        return b"".join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("elf", help="kernel.elf the Pi is running")
+    parser.add_argument("capture", nargs="?", type=argparse.FileType("rb"),
+                        default=sys.stdin.buffer,
+                        help="binary capture of the UART, or the UART")
+    args = parser.parse_args()
+
+    decoder = Decoder(args.elf)
+    fd = args.capture.fileno()
+    out = sys.stdout.buffer
+
+    # os.read() returns whatever has arrived, so a live UART is decoded as
+    # it goes rather than at end of file
+    while True:
+        chunk = os.read(fd, 4096)
+        out.write(decoder.feed(chunk, final=not chunk))
+        out.flush()
+        if not chunk:
+            break
+
+
+if __name__ == "__main__":
+    main()
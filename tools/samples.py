@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+#
+#   Part of VensPi
+#   Copyright (c) 2016, Jeramie Vens
+#
+#   Released under the MIT License, see the LICENSE file for details.
+#
+"""Resolve a PC sample histogram dumped by the kernel into a flat profile.
+
+Capture the UART output after pressing 'h' and run:
+
+    tools/samples.py uart.log --elf kernel.elf
+    tools/samples.py uart.log --map kernel.map
+
+The last SAMPLES BEGIN/END block in the log is used. Each bucket is charged
+to the function containing its start address, so with wide buckets a small
+function can steal samples from its neighbour; the bucket width is printed
+to judge this.
+"""
+
+import argparse
+import bisect
+import re
+import struct
+import sys
+
+STT_FUNC = 2
+
+
+def read_dump(stream):
+    """Return (header, [(address, count)]) for the last dump in the log"""
+    header = None
+    buckets = []
+    dump = None
+
+    for line in stream:
+        line = line.strip()
+
+        match = re.match(r"SAMPLES BEGIN base=([0-9A-Fa-f]+) shift=(\d+) "
+                         r"total=(\d+) outside=(\d+)", line)
+        if match:
+            header = {
+                "base": int(match.group(1), 16),
+                "shift": int(match.group(2)),
+                "total": int(match.group(3)),
+                "outside": int(match.group(4)),
+            }
+            buckets = []
+            continue
+
+        if header is None:
+            continue
+
+        match = re.match(r"SAMPLE ([0-9A-Fa-f]+) (\d+)", line)
+        if match:
+            buckets.append((int(match.group(1), 16), int(match.group(2))))
+        elif line.startswith("SAMPLES END"):
+            dump = (header, buckets)
+            header = None
+
+    if dump is None:
+        sys.exit("no complete SAMPLES BEGIN/END block found")
+
+    return dump
+
+
+def elf_symbols(path):
+    """Function symbols from the .symtab of a 32-bit little-endian ELF"""
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if data[:4] != b"\x7fELF" or data[4] != 1 or data[5] != 1:
+        sys.exit("%s: not a 32-bit little-endian ELF" % path)
+
+    e_shoff, = struct.unpack_from("<I", data, 0x20)
+    e_shentsize, e_shnum = struct.unpack_from("<HH", data, 0x2E)
+
+    sections = []
+    for i in range(e_shnum):
+        sections.append(struct.unpack_from("<IIIIIIIIII", data,
+                                           e_shoff + i * e_shentsize))
+
+    symbols = []
+    for sh in sections:
+        sh_type, sh_offset, sh_size, sh_link, sh_entsize = \
+            sh[1], sh[4], sh[5], sh[6], sh[9]
+
+        if sh_type != 2:        # SHT_SYMTAB
+            continue
+
+        strtab = sections[sh_link][4]
+
+        for offset in range(sh_offset, sh_offset + sh_size, sh_entsize):
+            st_name, st_value, st_size, st_info = \
+                struct.unpack_from("<IIIB", data, offset)
+
+            if (st_info & 0xF) != STT_FUNC:
+                continue
+
+            end = data.index(b"\0", strtab + st_name)
+            name = data[strtab + st_name:end].decode("ascii", "replace")
+
+            # Clear the Thumb bit
+            symbols.append((st_value & ~1, st_size, name))
+
+    return symbols
+
+
+def map_symbols(path):
+    """Symbols from a GNU ld map file. Sizes aren't known per symbol, so each
+    one runs until the next"""
+    symbols = []
+    in_text = False
+
+    with open(path) as f:
+        for line in f:
+            if re.match(r"^\.text\s", line):
+                in_text = True
+                continue
+
+            if in_text and re.match(r"^\.\S", line):
+                in_text = False
+
+            if not in_text:
+                continue
+
+            match = re.match(r"^\s+0x([0-9a-fA-F]+)\s+([A-Za-z_.$][\w.$]*)\s*$",
+                             line)
+            if match:
+                symbols.append((int(match.group(1), 16), 0, match.group(2)))
+
+    return symbols
+
+
+def resolve(symbols, buckets):
+    symbols = sorted(set(symbols))
+    starts = [s[0] for s in symbols]
+    totals = {}
+
+    for address, count in buckets:
+        i = bisect.bisect_right(starts, address) - 1
+        name = "??"
+
+        if i >= 0:
+            start, size, sym = symbols[i]
+            if size == 0 or address < start + size:
+                name = sym
+
+        totals[name] = totals.get(name, 0) + count
+
+    return totals
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", type=argparse.FileType("r"),
+                        default=sys.stdin, help="captured UART output")
+    parser.add_argument("--elf", help="kernel.elf to take symbols from")
+    parser.add_argument("--map", help="kernel.map to take symbols from")
+    parser.add_argument("--top", type=int, default=30,
+                        help="number of functions to print")
+    args = parser.parse_args()
+
+    if not args.elf and not args.map:
+        parser.error("one of --elf or --map is required")
+
+    header, buckets = read_dump(args.log)
+
+    symbols = []
+    if args.elf:
+        symbols += elf_symbols(args.elf)
+    if args.map:
+        symbols += map_symbols(args.map)
+
+    totals = resolve(symbols, buckets)
+    total = header["total"] or 1
+
+    print("%d samples, %d outside .text, %d byte buckets" %
+          (header["total"], header["outside"], 1 << header["shift"]))
+    print("%8s %7s  %s" % ("Samples", "%", "Function"))
+
+    ranked = sorted(totals.items(), key=lambda item: item[1], reverse=True)
+    for name, count in ranked[:args.top]:
+        print("%8d %6.2f%%  %s" % (count, 100.0 * count / total, name))
+
+
+if __name__ == "__main__":
+    main()
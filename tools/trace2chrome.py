@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+#
+#   Part of VensPi
+#   Copyright (c) 2016, Jeramie Vens
+#
+#   Released under the MIT License, see the LICENSE file for details.
+#
+"""Convert an event trace dumped by the kernel into Chrome trace JSON.
+
+Build with TRACE_ENABLE=1, capture the UART in binary after pressing 'x'
+and run:
+
+    tools/trace2chrome.py uart.bin -o trace.json
+
+then load trace.json into chrome://tracing or https://ui.perfetto.dev. Each
+core is a thread, with frames, IRQs and tasks as nested slices and mailbox
+requests as async slices from submit to reply. The last dump in the capture
+is used.
+"""
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+RECORD = struct.Struct("<IHHII")
+
+# The IDs from src/kernel/trace.h
+IRQ_ENTER = 1
+IRQ_EXIT = 2
+IRQ_HANDLER_BEGIN = 3
+IRQ_HANDLER_END = 4
+FRAME_BEGIN = 5
+FRAME_END = 6
+MAILBOX_SUBMIT = 7
+MAILBOX_COMPLETE = 8
+THREAD_SWITCH = 9
+TASK_BEGIN = 10
+TASK_END = 11
+
+HEADER = re.compile(rb"TRACE BEGIN core=(\d+) count=(\d+) frequency=(\d+)\r?\n")
+
+
+def read_dump(data):
+    """Return {core: (frequency, [(ticks, event, arg0, arg1)])} from the last
+    dump in the capture. A later dump of a core replaces an earlier one"""
+    cores = {}
+    position = 0
+
+    while True:
+        match = HEADER.search(data, position)
+        if match is None:
+            break
+
+        core = int(match.group(1))
+        count = int(match.group(2))
+        frequency = int(match.group(3))
+        start = match.end()
+        end = start + count * RECORD.size
+
+        if end > len(data):
+            sys.exit("core %d: dump cut short, %d of %d bytes" %
+                     (core, len(data) - start, count * RECORD.size))
+
+        records = []
+        for offset in range(start, end, RECORD.size):
+            time_lo, time_hi, event, arg0, arg1 = \
+                RECORD.unpack_from(data, offset)
+            records.append(((time_hi << 32) | time_lo, event, arg0, arg1))
+
+        # Slots are claimed before they're timestamped, so an interrupt can
+        # leave a pair of records a few ticks out of order
+        records.sort(key=lambda record: record[0])
+
+        cores[core] = (frequency, records)
+        position = end
+
+    if not cores:
+        sys.exit("no TRACE BEGIN block found")
+
+    return cores
+
+
+def convert(cores):
+    """Chrome trace events for every core's records"""
+    events = []
+    first = min((records[0][0] for _, records in cores.values() if records),
+                default=0)
+
+    for core, (frequency, records) in sorted(cores.items()):
+        if frequency == 0:
+            sys.exit("core %d: no timer frequency in the dump" % core)
+
+        events.append({"ph": "M", "name": "thread_name", "pid": 0,
+                       "tid": core, "args": {"name": "core %d" % core}})
+
+        # The oldest records may be the ends of slices whose starts were
+        # overwritten, drop those rather than confuse the viewer
+        depth = 0
+
+        for ticks, event, arg0, arg1 in records:
+            ts = (ticks - first) * 1e6 / frequency
+            base = {"pid": 0, "tid": core, "ts": ts}
+
+            if event in (IRQ_ENTER, IRQ_HANDLER_BEGIN, FRAME_BEGIN,
+                         TASK_BEGIN):
+                depth += 1
+                base["ph"] = "B"
+                if event == IRQ_ENTER:
+                    base.update(name="IRQ", args={"pc": "%08x" % arg0})
+                elif event == IRQ_HANDLER_BEGIN:
+                    base.update(name="irq %d" % arg0)
+                elif event == FRAME_BEGIN:
+                    base.update(name="frame", args={"frame": arg0})
+                else:
+                    base.update(name="task %08x" % arg0,
+                                args={"resume": arg1})
+
+            elif event in (IRQ_EXIT, IRQ_HANDLER_END, FRAME_END, TASK_END):
+                if depth == 0:
+                    continue
+                depth -= 1
+                base["ph"] = "E"
+
+            elif event in (MAILBOX_SUBMIT, MAILBOX_COMPLETE):
+                base.update(ph="b" if event == MAILBOX_SUBMIT else "e",
+                            cat="mailbox", name="mailbox ch %d" % arg0,
+                            id="%x" % ((arg1 & ~0xF) | arg0))
+
+            elif event == THREAD_SWITCH:
+                base.update(ph="i", s="t", name="switch",
+                            args={"from": "%08x" % arg0, "to": "%08x" % arg1})
+
+            else:
+                base.update(ph="i", s="t", name="event %#x" % event,
+                            args={"arg0": arg0, "arg1": arg1})
+
+            events.append(base)
+
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", nargs="?", type=argparse.FileType("rb"),
+                        default=sys.stdin.buffer,
+                        help="binary capture of the UART")
+    parser.add_argument("-o", "--output", type=argparse.FileType("w"),
+                        default=sys.stdout, help="JSON file to write")
+    args = parser.parse_args()
+
+    cores = read_dump(args.capture.read())
+    events = convert(cores)
+
+    json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, args.output)
+
+    for core, (frequency, records) in sorted(cores.items()):
+        sys.stderr.write("core %d: %d records at %d Hz\n" %
+                         (core, len(records), frequency))
+
+
+if __name__ == "__main__":
+    main()